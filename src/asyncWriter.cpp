@@ -0,0 +1,126 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2017 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "asyncWriter.h"
+
+#include <deque>
+#include <iostream>
+
+#if USE_BOOST_THREAD
+    #include <boost/thread.hpp>
+    typedef boost::mutex                    AsyncMutex;
+    typedef boost::unique_lock< boost::mutex > AsyncLock;
+    typedef boost::condition_variable       AsyncCondition;
+    typedef boost::thread                   AsyncThread;
+#else
+    #include <condition_variable>
+    #include <mutex>
+    #include <thread>
+    typedef std::mutex                      AsyncMutex;
+    typedef std::unique_lock< std::mutex >  AsyncLock;
+    typedef std::condition_variable         AsyncCondition;
+    typedef std::thread                     AsyncThread;
+#endif
+
+namespace GIMLI {
+
+struct AsyncWriter::Queue{
+    Queue() : busy(0), stop(false), thread(0) { }
+
+    std::deque< std::function< void() > > jobs;
+    Index busy;
+    bool stop;
+
+    mutable AsyncMutex mutex;
+    AsyncCondition newJob;
+    AsyncCondition done;
+    AsyncThread * thread;
+};
+
+AsyncWriter::AsyncWriter(bool active)
+    : active_(active), queue_(new Queue()){
+}
+
+AsyncWriter::~AsyncWriter(){
+    flush();
+    if (queue_->thread){
+        {
+            AsyncLock lock(queue_->mutex);
+            queue_->stop = true;
+        }
+        queue_->newJob.notify_all();
+        queue_->thread->join();
+        delete queue_->thread;
+    }
+    delete queue_;
+}
+
+void AsyncWriter::push(const std::function< void() > & job){
+    if (!active_) {
+        job();
+        return;
+    }
+    {
+        AsyncLock lock(queue_->mutex);
+        queue_->jobs.push_back(job);
+        if (!queue_->thread) {
+            queue_->thread = new AsyncThread(&AsyncWriter::run_, this);
+        }
+    }
+    queue_->newJob.notify_one();
+}
+
+void AsyncWriter::run_(){
+    AsyncLock lock(queue_->mutex);
+    while (true){
+        while (queue_->jobs.empty() && !queue_->stop) queue_->newJob.wait(lock);
+        if (queue_->jobs.empty()) break;
+
+        std::function< void() > job(queue_->jobs.front());
+        queue_->jobs.pop_front();
+        queue_->busy ++;
+        lock.unlock();
+        try {
+            job();
+        } catch (std::exception & e){
+            std::cerr << WHERE_AM_I << " Warning asynchronous write failed: " << e.what() << std::endl;
+        } catch (...){
+            std::cerr << WHERE_AM_I << " Warning asynchronous write failed." << std::endl;
+        }
+        lock.lock();
+        queue_->busy --;
+        if (queue_->jobs.empty() && queue_->busy == 0) queue_->done.notify_all();
+    }
+}
+
+void AsyncWriter::flush(){
+    AsyncLock lock(queue_->mutex);
+    while (!queue_->jobs.empty() || queue_->busy > 0) queue_->done.wait(lock);
+}
+
+Index AsyncWriter::pending() const {
+    AsyncLock lock(queue_->mutex);
+    return queue_->jobs.size() + queue_->busy;
+}
+
+void AsyncWriter::setActive(bool active){
+    if (!active) flush();
+    active_ = active;
+}
+
+} // namespace GIMLI
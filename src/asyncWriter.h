@@ -0,0 +1,81 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2017 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_ASYNCWRITER__H
+#define _GIMLI_ASYNCWRITER__H
+
+#include "gimli.h"
+#include "vector.h"
+
+#include <functional>
+#include <memory>
+
+namespace GIMLI{
+
+/*! Background writer for diagnostic output.
+ * Jobs are queued and processed in order by one worker thread, so the
+ * caller only pays for the snapshot of the data. The worker is started
+ * with the first job. \ref flush waits until all queued jobs are done,
+ * the destructor flushes too. Exceptions thrown by a job are reported
+ * to std::cerr and do not stop the worker.
+ * If not active, all jobs are executed immediately by the caller. */
+class DLLEXPORT AsyncWriter {
+public:
+    AsyncWriter(bool active=true);
+
+    ~AsyncWriter();
+
+    /*! Queue a job. */
+    void push(const std::function< void() > & job);
+
+    /*! Queue the save of a snapshot of v, see \ref Vector::save. */
+    template < class ValueType >
+    void save(const Vector < ValueType > & v, const std::string & filename,
+              IOFormat format=Ascii){
+        std::shared_ptr< Vector < ValueType > > snap(new Vector< ValueType >(v));
+        push([snap, filename, format](){ snap->save(filename, format); });
+    }
+
+    /*! Block until all queued jobs are written. */
+    void flush();
+
+    /*! Return the number of queued and not yet finished jobs. */
+    Index pending() const;
+
+    /*! Set active (default) for asynchronous writing. Deactivation
+     * flushes the queue. */
+    void setActive(bool active);
+
+    inline bool active() const { return active_; }
+
+protected:
+    /*! Copyconstructor */
+    AsyncWriter(const AsyncWriter & w){ THROW_TO_IMPL }
+    AsyncWriter & operator = (const AsyncWriter & w){ THROW_TO_IMPL return *this; }
+
+    void run_();
+
+    bool active_;
+
+    struct Queue;
+    Queue * queue_;
+};
+
+} // namespace GIMLI
+
+#endif // _GIMLI_ASYNCWRITER__H
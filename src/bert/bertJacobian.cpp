@@ -38,12 +38,15 @@ namespace GIMLI{
     std::mutex eraseMutex__;
 #endif
 
-template < class ValueType > class CreateSensitivityColMT : public GIMLI::BaseCalcMT{
+//! Potentials can be stored with lower precision PotValueType, see
+//! ElementMatrix::mult for the summation.
+template < class ValueType, class PotValueType=ValueType >
+class CreateSensitivityColMT : public GIMLI::BaseCalcMT{
 public:
   CreateSensitivityColMT(Matrix < ValueType >          & S,
                          const std::vector < Cell * >  & para,
                          const DataContainerERT        & data,
-                         const Matrix < ValueType >    & pots,
+                         const Matrix < PotValueType > & pots,
                          const std::map< long, uint >  & currPatternIdx,
                          const RVector                 & weights,
                          const RVector                 & k,
@@ -77,11 +80,11 @@ public:
         Cell * cell = NULL;
         int modelIdx = 0;
 
-        const Vector < ValueType > *va;
-        const Vector < ValueType > *vb;
-        const Vector < ValueType > *vm;
-        const Vector < ValueType > *vn;
-        Vector < ValueType > dummy((*pots_)[0].size(), ValueType(0));
+        const Vector < PotValueType > *va;
+        const Vector < PotValueType > *vb;
+        const Vector < PotValueType > *vm;
+        const Vector < PotValueType > *vn;
+        Vector < PotValueType > dummy((*pots_)[0].size(), PotValueType(0));
 
         const RVector *da = &(*data_)("a");
         const RVector *db = &(*data_)("b");
@@ -133,17 +136,17 @@ public:
         int modelIdx = 0;
         Index si, sj;
 
-        const Vector < ValueType > *va;
-        const Vector < ValueType > *vb;
-        const Vector < ValueType > *vm;
-        const Vector < ValueType > *vn;
+        const Vector < PotValueType > *va;
+        const Vector < PotValueType > *vb;
+        const Vector < PotValueType > *vm;
+        const Vector < PotValueType > *vn;
 
         const RVector *da = &(*data_)("a");
         const RVector *db = &(*data_)("b");
         const RVector *dm = &(*data_)("m");
         const RVector *dn = &(*data_)("n");
 
-        Vector < ValueType > dummy((*pots_)[0].size(), ValueType(0));
+        Vector < PotValueType > dummy((*pots_)[0].size(), PotValueType(0));
 
         for (Index cellID = start_; cellID < end_; cellID ++) {
 
@@ -253,7 +256,7 @@ protected:
     Matrix < ValueType >            * S_;
     const std::vector < Cell * >    * para_;
     const DataContainerERT          * data_;
-    const Matrix < ValueType >      * pots_;
+    const Matrix < PotValueType >   * pots_;
     const std::map< long, uint >    * currPatternIdx_;
     const RVector                   * weights_;
     const RVector                   * k_;
@@ -264,11 +267,11 @@ protected:
 
 bool lessCellMarker(const Cell * c1, const Cell * c2) { return c1->marker() < c2->marker(); }
 
-template < class ValueType >
+template < class ValueType, class PotValueType >
 void createSensitivityCol_(Matrix < ValueType > & S,
                           const Mesh & mesh,
                           const DataContainerERT & data,
-                          const Matrix < ValueType > & pots,
+                          const Matrix < PotValueType > & pots,
                           const RVector & weights,
                           const RVector & k,
                           std::vector < std::pair < Index, Index > > & matrixClusterIds,
@@ -358,7 +361,7 @@ MEMINFO
             S *= ValueType(0);
 MEMINFO
 
-            distributeCalc(CreateSensitivityColMT< ValueType >(S, cellsCluster,
+            distributeCalc(CreateSensitivityColMT< ValueType, PotValueType >(S, cellsCluster,
                                                                data, pots,
                                                                currPatternIdx,
                                                                weights, k, verbose),
@@ -399,7 +402,7 @@ MEMINFO
 //swatch.stop(verbose);
         }
 
-        distributeCalc(CreateSensitivityColMT< ValueType >(S, cells, data,
+        distributeCalc(CreateSensitivityColMT< ValueType, PotValueType >(S, cells, data,
                                                            pots, currPatternIdx,
                                                            weights, k, verbose),
                         cells.size(), nThreads, verbose);
@@ -436,6 +439,17 @@ void createSensitivityCol(CMatrix & S,
 }
 
 
+void createSensitivityCol(RMatrix & S,
+                          const Mesh & mesh,
+                          const DataContainerERT & data,
+                          const Matrix < float > & pots,
+                          const RVector & weights,
+                          const RVector & k,
+                          std::vector < std::pair < Index, Index > > & matrixClusterIds,
+                          uint nThreads, bool verbose){
+    createSensitivityCol_(S, mesh, data, pots, weights, k, matrixClusterIds, nThreads, verbose);
+}
+
 void sensitivityDCFEMSingle(const std::vector < Cell * > & para, const RVector & p1, const RVector & p2,
 		       RVector & sens, bool verbose){
     uint nCells = para.size();
@@ -58,6 +58,17 @@ DLLEXPORT void createSensitivityCol(CMatrix & S,
                                     std::vector < std::pair < Index, Index > > & matrixClusterIds,
                                     uint nThreads, bool verbose);
 
+/*! Same as above with single precision potentials. The sensitivities are
+ * summed up in double precision. */
+DLLEXPORT void createSensitivityCol(RMatrix & S,
+                                    const Mesh & mesh,
+                                    const DataContainerERT & data,
+                                    const Matrix < float > & pots,
+                                    const RVector & weights,
+                                    const RVector & k,
+                                    std::vector < std::pair < Index, Index > > & matrixClusterIds,
+                                    uint nThreads, bool verbose);
+
 DLLEXPORT void sensitivityDCFEMSingle(const std::vector < Cell * > & para,
                                       const RVector & p1, const RVector & p2,
                                       RVector & sens, bool verbose);
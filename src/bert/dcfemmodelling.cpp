@@ -40,10 +40,21 @@
 #include <stopwatch.h>
 #include <vectortemplates.h>
 
-#undef HAVE_LIBBOOST_THREAD
-
-#ifdef HAVE_LIBBOOST_THREAD
-#include <boost/thread.hpp>
+#include <calculateMultiThread.h>
+
+#if USE_BOOST_THREAD
+    #include <boost/thread.hpp>
+    static boost::mutex __stiffnessCacheMutex__;
+    typedef boost::mutex                        PatternMutex;
+    typedef boost::unique_lock< boost::mutex >  PatternLock;
+    typedef boost::condition_variable           PatternCondition;
+#else
+    #include <condition_variable>
+    #include <mutex>
+    static std::mutex __stiffnessCacheMutex__;
+    typedef std::mutex                          PatternMutex;
+    typedef std::unique_lock< std::mutex >      PatternLock;
+    typedef std::condition_variable             PatternCondition;
 #endif
 
 namespace GIMLI{
@@ -158,14 +169,73 @@ void assembleStiffnessMatrixHomogenDirichletBC(SparseMatrix < ValueType > & S,
     assembleStiffnessMatrixHomogenDirichletBC(S, nodeID, rhs);
 }
 
+/*! Kernel for \ref assembleCells, adds 1/rho (K + k^2 M) of every cell. */
+template < class ValueType > class DCFEMCellKernel{
+public:
+    DCFEMCellKernel(SparseMatrix < ValueType > & S, const Mesh & mesh,
+                    const Vector < ValueType > & atts, double k,
+                    const MeshSparsityPattern & pattern)
+    : S_(&S), mesh_(&mesh), atts_(&atts), k_(k), pattern_(&pattern),
+      cached_(pattern.hasElementMatrices()){
+    }
+
+    /*! Copy without the element matrix workspace. */
+    DCFEMCellKernel(const DCFEMCellKernel & k)
+    : S_(k.S_), mesh_(k.mesh_), atts_(k.atts_), k_(k.k_), pattern_(k.pattern_),
+      cached_(k.cached_){
+    }
+
+    void operator()(Index i){
+        const Cell & cell = mesh_->cell(i);
+        ValueType rho = (*atts_)[cell.id()];
+        //** rho == 0.0 may happen while secondary field assemblation
+        if (GIMLI::abs(rho) <= TOLERANCE) return;
+
+        //** the geometric element matrices are cached with the pattern,
+        //** so the assembly is a scaled sum for every wavenumber
+        if (cached_){
+            S_->add(cell.nodeCount(), pattern_->cellStiffness(i),
+                    pattern_->cellMass(i), k_ * k_, 1./rho, pattern_->cellPos(i));
+            return;
+        }
+        if (k_ > 0.0){
+            Se_.u2(cell);
+            Se_ *= k_ * k_;
+            Se_ += Stmp_.ux2uy2uz2(cell);
+        } else {
+            Se_.ux2uy2uz2(cell);
+        }
+        S_->add(Se_, 1./rho, pattern_->cellPos(i));
+    }
+
+protected:
+    SparseMatrix < ValueType >  * S_;
+    const Mesh                  * mesh_;
+    const Vector < ValueType >  * atts_;
+    double k_;
+    const MeshSparsityPattern   * pattern_;
+    bool cached_;
+    ElementMatrix < double > Se_, Stmp_;
+};
+
 template < class ValueType >
 void dcfemDomainAssembleStiffnessMatrix(SparseMatrix < ValueType > & S, const Mesh & mesh,
                                         const Vector < ValueType > & atts,
-                                        double k, bool fix){
-    S.clean();
+                                        double k, bool fix,
+                                        const MeshSparsityPattern * pattern=NULL,
+                                        Index nThreads=1){
     uint countRho0 = 0, countforcedHomDirichlet = 0;
 
-    if (!S.valid()) S.buildSparsityPattern(mesh);
+    if (pattern){
+        if (pattern->cellCount() != mesh.cellCount()){
+            throwLengthError(1, WHERE_AM_I + " sparsity pattern does not match the mesh " +
+                             toStr(pattern->cellCount()) + " != " + toStr(mesh.cellCount()));
+        }
+        S.buildSparsityPattern(*pattern);
+    } else {
+        S.clean();
+        if (!S.valid()) S.buildSparsityPattern(mesh);
+    }
 
     ElementMatrix < double > Se, Stmp;
 
@@ -174,38 +244,43 @@ void dcfemDomainAssembleStiffnessMatrix(SparseMatrix < ValueType > & S, const Me
                        + " != " + toStr(mesh.cellCount()));
     }
     ValueType rho = 0.0;
-    Stopwatch swatch(true);
-    unsigned long sCount = 0;
-
-    for (uint i = 0; i < mesh.cellCount(); i++){
-        rho = atts[mesh.cell(i).id()];
-        //** rho == 0.0 may happen while secondary field assemblation
-        if (GIMLI::abs(rho) > TOLERANCE){
-            if (k > 0.0){
-//             Stmp = Se.u2(mesh.cell(i));
-//             Stmp *= k * k;
-//             Stmp += Se.ux2uy2uz2(mesh.cell(i));
 
-                Stopwatch s(true);
-                Se.u2(mesh.cell(i));
-                sCount += s.cycleCounter().toc();
-
-                Se *= k * k;
-                Se += Stmp.ux2uy2uz2(mesh.cell(i));
+    if (pattern){
+        //** cells of one colour share no node and are added concurrently
+        assembleCells(*pattern, DCFEMCellKernel< ValueType >(S, mesh, atts, k, *pattern),
+                      nThreads);
+        if (fix){
+            for (uint i = 0; i < mesh.cellCount(); i++){
+                if (atts[mesh.cell(i).id()] < ValueType(0.0)) countRho0++;
+            }
+        }
+    } else {
+        for (uint i = 0; i < mesh.cellCount(); i++){
+            rho = atts[mesh.cell(i).id()];
+            //** rho == 0.0 may happen while secondary field assemblation
+            if (GIMLI::abs(rho) > TOLERANCE){
+                if (k > 0.0){
+//                 Stmp = Se.u2(mesh.cell(i));
+//                 Stmp *= k * k;
+//                 Stmp += Se.ux2uy2uz2(mesh.cell(i));
+
+                    Se.u2(mesh.cell(i));
+                    Se *= k * k;
+                    Se += Stmp.ux2uy2uz2(mesh.cell(i));
 
+                } else {
+                    Se.ux2uy2uz2(mesh.cell(i));
+                }
+                S.add(Se, 1./rho);
+//                 Se *= 1.0 / rho;
+//                 S += Se;
             } else {
-                Se.ux2uy2uz2(mesh.cell(i));
+                //std::cout << WHERE_AM_I << " " << rho << std::endl;
             }
-            S.add(Se, 1./rho);
-//             Se *= 1.0 / rho;
-//             S += Se;
-        } else {
-            //std::cout << WHERE_AM_I << " " << rho << std::endl;
+            if (rho < ValueType(0.0) && fix) countRho0++;
         }
-        if (rho < ValueType(0.0) && fix) countRho0++;
     }
 
-    //std::cout << "assemble time: " << swatch.cycleCounter().toc() << " " << sCount << "  " << swatch.duration()  << std::endl;
     if (fix){
         IndexArray fixSingNodesID;
         for (uint i = 0; i < S.size(); i ++){
@@ -237,6 +312,20 @@ void dcfemDomainAssembleStiffnessMatrix(CSparseMatrix & S, const Mesh & mesh,
                                        k, fix);
 }
 
+void dcfemDomainAssembleStiffnessMatrix(RSparseMatrix & S, const Mesh & mesh,
+                                        const MeshSparsityPattern & pattern,
+                                        double k, bool fix, Index nThreads){
+    dcfemDomainAssembleStiffnessMatrix(S, mesh, mesh.cellAttributes(), k, fix,
+                                       &pattern, nThreads ? nThreads : threadCount());
+}
+
+void dcfemDomainAssembleStiffnessMatrix(CSparseMatrix & S, const Mesh & mesh,
+                                        const MeshSparsityPattern & pattern,
+                                        double k, bool fix, Index nThreads){
+    dcfemDomainAssembleStiffnessMatrix(S, mesh, getComplexResistivities(mesh),
+                                       k, fix, &pattern, nThreads ? nThreads : threadCount());
+}
+
 
 template < class ValueType >
 void dcfemBoundaryAssembleStiffnessMatrix(SparseMatrix < ValueType > & S,
@@ -535,6 +624,9 @@ DCMultiElectrodeModelling::~DCMultiElectrodeModelling(){
     if (primDataMap_) delete primDataMap_;
 
     for_each(electrodes_.begin(), electrodes_.end(), deletePtr());
+    clearStiffnessMatrices_();
+    if (linSolver_) delete linSolver_;
+    clearLinSolvers_();
 }
 
 void DCMultiElectrodeModelling::init_(){
@@ -555,6 +647,12 @@ void DCMultiElectrodeModelling::init_(){
     dipoleCurrentPattern_           = false;
 
     primDataMap_ = new DataMap();
+    linSolver_ = NULL;
+    keepFactorizations_ = false;
+    solverType_ = AUTOMATIC;
+    electrodePotentialsOnly_ = false;
+    singlePrecisionPotentials_ = false;
+    electrodeSolutions_ = false;
 
     byPassFile_ = "bypass.map";
 
@@ -565,6 +663,20 @@ void DCMultiElectrodeModelling::init_(){
 
 }
 
+void DCMultiElectrodeModelling::setSolverType(SolverType solverType){
+    solverType_ = solverType;
+    if (linSolver_) {
+        delete linSolver_;
+        linSolver_ = NULL;
+    }
+    clearLinSolvers_();
+}
+
+void DCMultiElectrodeModelling::clearLinSolvers_(){
+    for_each(linSolversK_.begin(), linSolversK_.end(), deletePtr());
+    linSolversK_.clear();
+}
+
 DataContainerERT & DCMultiElectrodeModelling::dataContainer() const{
     return dynamic_cast < DataContainerERT & >(*dataContainer_);
 }
@@ -572,6 +684,41 @@ DataContainerERT & DCMultiElectrodeModelling::dataContainer() const{
 void DCMultiElectrodeModelling::deleteMeshDependency_(){
     for_each(electrodes_.begin(), electrodes_.end(), deletePtr()); electrodes_.clear();
     electrodeRef_        = NULL;
+    clearStiffnessMatrices_();
+}
+
+void DCMultiElectrodeModelling::clearStiffnessMatrices_(){
+    for_each(stiffnessMatricesR_.begin(), stiffnessMatricesR_.end(), deletePtr());
+    for_each(stiffnessMatricesC_.begin(), stiffnessMatricesC_.end(), deletePtr());
+    stiffnessMatricesR_.clear();
+    stiffnessMatricesC_.clear();
+    meshPattern_.clear();
+}
+
+template < class ValueType >
+SparseMatrix < ValueType > & stiffnessMatrix__(std::vector < SparseMatrix < ValueType > * > & cache,
+                                               MeshSparsityPattern & pattern,
+                                               const Mesh & mesh, Index kIdx){
+#if USE_BOOST_THREAD
+    boost::mutex::scoped_lock lock(__stiffnessCacheMutex__);
+#else
+    std::unique_lock < std::mutex > lock(__stiffnessCacheMutex__);
+#endif
+    if (!pattern.valid()) {
+        pattern.build(mesh);
+        pattern.buildElementMatrices(mesh);
+    }
+    if (cache.size() <= kIdx) cache.resize(kIdx + 1, NULL);
+    if (!cache[kIdx]) cache[kIdx] = new SparseMatrix < ValueType >();
+    return *cache[kIdx];
+}
+
+RSparseMatrix & DCMultiElectrodeModelling::stiffnessMatrix_(Index kIdx, double){
+    return stiffnessMatrix__(stiffnessMatricesR_, meshPattern_, *mesh_, kIdx);
+}
+
+CSparseMatrix & DCMultiElectrodeModelling::stiffnessMatrix_(Index kIdx, Complex){
+    return stiffnessMatrix__(stiffnessMatricesC_, meshPattern_, *mesh_, kIdx);
 }
 
 void DCMultiElectrodeModelling::assembleStiffnessMatrixDCFEMByPass(RSparseMatrix & S){
@@ -681,6 +828,9 @@ void DCMultiElectrodeModelling::assembleStiffnessMatrixDCFEMByPass_(SparseMatrix
         }
     }
 
+    //** nothing to do, keep the sparsity pattern of _S
+    if (byPassNodesPair.empty()) return;
+
     RSparseMapMatrix S(_S);
     for (Index i = 0; i < byPassNodesPair.size(); i ++){
         Index a1 = byPassNodesPair[i].first;
@@ -700,6 +850,7 @@ void DCMultiElectrodeModelling::assembleStiffnessMatrixDCFEMByPass_(SparseMatrix
 void DCMultiElectrodeModelling::updateMeshDependency_(){
 
     if (subSolutions_) subSolutions_->clear();
+    clearStiffnessMatrices_();
 
     for_each(electrodes_.begin(), electrodes_.end(), deletePtr());
     electrodes_.clear();
@@ -1123,7 +1274,7 @@ RVector DCMultiElectrodeModelling::response(const RVector & model,
     RVector modelReciprocity((resp - respRez) / (resp + respRez) * 2.0);
 
     if (verbose_){
-        if (min(resp) < 0 && 1){
+        if (min(resp) < 0 && !electrodeSolutions_){
             std::cout << "found neg. resp, save and abort." << std::endl;
                 for (uint i = 0; i < resp.size(); i ++){
                     if (resp[i ] < 0) {
@@ -1228,7 +1379,7 @@ DataMap DCMultiElectrodeModelling::response_(const Vector < ValueType > & model,
 }
 
 template < class ValueType >
-Matrix < ValueType > * DCMultiElectrodeModelling::prepareJacobianT_(const Vector< ValueType > & model){
+MatrixBase * DCMultiElectrodeModelling::prepareJacobianT_(const Vector< ValueType > & model){
 //TIC__
     this->searchElectrodes_();
     if (dataContainer_){
@@ -1236,9 +1387,7 @@ Matrix < ValueType > * DCMultiElectrodeModelling::prepareJacobianT_(const Vector
             subpotOwner_ = true;
             subSolutions_ = new Matrix< ValueType >;
         }
-        Matrix< ValueType > *u = NULL;
-        u = dynamic_cast< Matrix< ValueType > * >(subSolutions_);
-        if (u->rows() == 0){
+        if (subSolutions_->rows() == 0){
 
 // //            std::cout << WHERE_AM_I << " " << mean(model) << " " << model.size() << std::endl;
 //__MS(toc__)
@@ -1266,10 +1415,15 @@ Matrix < ValueType > * DCMultiElectrodeModelling::prepareJacobianT_(const Vector
 
             DataContainerERT tmp(this->dataContainer());
 //__MS(toc__)
+            //** the sensitivities need the full potentials
+            bool oldElectrodeOnly = electrodePotentialsOnly_;
+            electrodePotentialsOnly_ = false;
             this->calculate(tmp);
+            electrodePotentialsOnly_ = oldElectrodeOnly;
 //__MS(toc__)
             /*! We have to scale subSolutions_ for the analytical solution to match the model */
-            if (this->analytical()){
+            Matrix< ValueType > * u = dynamic_cast< Matrix< ValueType > * >(subSolutions_);
+            if (this->analytical() && u){
                 if (verbose_) std::cout << "Scale subpotentials with " << model[0] << std::endl;
 
                 for (uint i = 0, imax = u->rows(); i < imax; i ++) {
@@ -1278,7 +1432,7 @@ Matrix < ValueType > * DCMultiElectrodeModelling::prepareJacobianT_(const Vector
             }
             this->setAnalytical(oldAna);
         } // if u.rows()
-        return u;
+        return subSolutions_;
     } else {
         throwError(1, WHERE_AM_I + " no data structure given");
     }
@@ -1286,14 +1440,26 @@ Matrix < ValueType > * DCMultiElectrodeModelling::prepareJacobianT_(const Vector
 }
 
 RMatrix * DCMultiElectrodeModelling::prepareJacobian_(const RVector & model){
-    return prepareJacobianT_(model);
+    return dynamic_cast< RMatrix * >(prepareJacobianT_(model));
 }
 CMatrix * DCMultiElectrodeModelling::prepareJacobian_(const CVector & model){
-    return prepareJacobianT_(model);
+    return dynamic_cast< CMatrix * >(prepareJacobianT_(model));
 }
 
 void DCMultiElectrodeModelling::createJacobian_(const RVector & model,
                                                 const RMatrix & u, RMatrix * J){
+    createJacobianT_(model, u, J);
+}
+
+void DCMultiElectrodeModelling::createJacobian_(const RVector & model,
+                                                const Matrix < float > & u, RMatrix * J){
+    createJacobianT_(model, u, J);
+}
+
+template < class PotValueType >
+void DCMultiElectrodeModelling::createJacobianT_(const RVector & model,
+                                                 const Matrix < PotValueType > & u,
+                                                 RMatrix * J){
 
     std::vector < std::pair < Index, Index > > matrixClusterIds;
 
@@ -1398,14 +1564,14 @@ void DCMultiElectrodeModelling::createJacobian_(const CVector & model,
 void DCMultiElectrodeModelling::createJacobian(const RVector & model){
     if (complex_){
 
-        CMatrix * u = prepareJacobianT_(toComplex(model(0, model.size()/2),
-                                         model(model.size()/2, model.size())));
+        prepareJacobianT_(toComplex(model(0, model.size()/2),
+                                    model(model.size()/2, model.size())));
 
         THROW_TO_IMPL
 
 
     } else {
-        RMatrix * u = prepareJacobianT_(model);
+        MatrixBase * u = prepareJacobianT_(model);
         if (!JIsRMatrix_){
             delete jacobian_;
             jacobian_ = new RMatrix();
@@ -1413,7 +1579,16 @@ void DCMultiElectrodeModelling::createJacobian(const RVector & model){
         }
 
         RMatrix * J = dynamic_cast< RMatrix * >(jacobian_);
-        createJacobian_(model, *u, J);
+        //** calculate stores the potentials in single precision already
+        Matrix < float > * uF = dynamic_cast< Matrix < float > * >(u);
+        if (uF){
+            if (verbose_) std::cout << "Single precision potentials: "
+                                    << mByte(long(uF->rows() * uF->cols() * sizeof(float)))
+                                    << " MB" << std::endl;
+            createJacobian_(model, *uF, J);
+        } else {
+            createJacobian_(model, *dynamic_cast< RMatrix * >(u), J);
+        }
     }
 }
 
@@ -1529,14 +1704,22 @@ void DCMultiElectrodeModelling::calculate(DataContainerERT & data, bool reciproc
                 if (buildCompleteElectrodeModel_){
                     u[i] = potentialsCEM_[currentIdx][data("m")[i]];
                 } else {
-                    u[i] = electrodes_[data("m")[i]]->pot(solutions_[currentIdx]);
+                    if (electrodeSolutions_){
+                        u[i] = solutions_[currentIdx][data("m")[i]];
+                    } else {
+                        u[i] = electrodes_[data("m")[i]]->pot(solutions_[currentIdx]);
+                    }
                 }
             }
             if (data("n")[i] > -1) {
                 if (buildCompleteElectrodeModel_){
                     u[i] -= potentialsCEM_[currentIdx][data("n")[i]];
                 } else {
-                    u[i] -= electrodes_[data("n")[i]]->pot(solutions_[currentIdx]);
+                    if (electrodeSolutions_){
+                        u[i] -= solutions_[currentIdx][data("n")[i]];
+                    } else {
+                        u[i] -= electrodes_[data("n")[i]]->pot(solutions_[currentIdx]);
+                    }
                 }
             }
 
@@ -1582,51 +1765,68 @@ void DCMultiElectrodeModelling::calculate(DataMap & dMap){
         if (verbose_) std::cout << "Building collectmatrix from CEM matrix appendix." << std::endl;
         dMap.collect(electrodes_, potentialsCEM_, buildCompleteElectrodeModel_);
     } else {
-        dMap.collect(electrodes_, solutions_);
+        //** electrode potentials are collected already
+        dMap.collect(electrodes_, solutions_, electrodeSolutions_);
     }
 }
 
-class CalculateMT{
-    public:
-    CalculateMT(DCMultiElectrodeModelling * fop, const std::vector < ElectrodeShape * > & eA,
-                 const std::vector < ElectrodeShape * > & eB,
-                 uint kIdx, RMatrix & mat)
-    : fop_(fop), eA_(&eA), eB_(&eB), kIdx_(kIdx), mat_(& mat) {
-    }
-    void operator()(){
-        fop_->calculateK(*eA_, *eB_, *mat_, kIdx_);
-    }
-
-    DCMultiElectrodeModelling * fop_;
-
-    const std::vector < ElectrodeShape * > * eA_;
-    const std::vector < ElectrodeShape * > * eB_;
-    uint kIdx_;
-    RMatrix * mat_;
-};
+//! Set or add (init=false) the single precision wavenumber potentials u
+//! weighted with w to the double precision potentials sum.
+static void addPotentials_(RVector & sum, const Vector < float > & u,
+                           double w, bool init){
+    if (init) sum *= 0.0;
+    for (Index j = 0; j < u.size(); j ++) sum[j] += w * double(u[j]);
+}
 
 void DCMultiElectrodeModelling::calculate(const std::vector < ElectrodeShape * > & eA,
                                           const std::vector < ElectrodeShape * > & eB){
 
+    uint nCurrentPattern = eA.size();
+
+    //** reduce to the electrodes that DataMap::collect takes
+    collectElectrodes_.clear();
+    electrodeSolutions_ = electrodePotentialsOnly_ && !analytical_ &&
+                          hasDefaultCalculateK_();
+
+    //** full potentials for the sensitivities are stored in single
+    //** precision right after the solve, see setSinglePrecisionPotentials
+    bool singleSolutions = singlePrecisionPotentials_ && !complex_ &&
+                           !analytical_ && !electrodeSolutions_ &&
+                           hasDefaultCalculateK_() &&
+                           (!subSolutions_ || subpotOwner_);
+
+    if (subSolutions_ && subpotOwner_ && !complex_ &&
+        singleSolutions != (dynamic_cast< Matrix < float > * >(subSolutions_) != NULL)){
+        delete subSolutions_;
+        subSolutions_ = NULL;
+    }
+
     if (!subSolutions_) {
         subpotOwner_ = true;
         if (complex_){
             subSolutions_ = new CMatrix(0);
+        } else if (singleSolutions){
+            subSolutions_ = new Matrix < float >(0);
         } else {
             subSolutions_ = new RMatrix(0);
         }
     }
+    if (electrodeSolutions_){
+        Index nElecs = 0;
+        for (Index i = 0; i < electrodes_.size(); i ++){
+            if (electrodes_[i] && electrodes_[i]->id() > -1) nElecs ++;
+        }
+        for (Index i = 0; i < nElecs; i ++) collectElectrodes_.push_back(electrodes_[i]);
+    }
+    Index nCols = electrodeSolutions_ ? collectElectrodes_.size() : mesh_->nodeCount();
 
-    uint nCurrentPattern = eA.size();
-
-    subSolutions_->resize(nCurrentPattern * kValues_.size(),
-                          mesh_->nodeCount());
+    subSolutions_->resize(nCurrentPattern * kValues_.size(), nCols);
 
     solutions_.clear();
     if (complex_){
-        solutions_.resize(2 * nCurrentPattern, mesh_->nodeCount());
+        solutions_.resize(2 * nCurrentPattern, nCols);
     } else {
-        solutions_.resize(nCurrentPattern, mesh_->nodeCount());
+        solutions_.resize(nCurrentPattern, nCols);
     }
     MEMINFO
 
@@ -1634,31 +1834,30 @@ void DCMultiElectrodeModelling::calculate(const std::vector < ElectrodeShape * >
 
     preCalculate(eA, eB);
 
-#ifdef HAVE_LIBBOOST_THREAD
-    uint kIdx = 0;
-    while (kIdx < kValues_.size()){
-        boost::thread_group threads;
-        for (uint thread = 0; thread < nThreads_; thread ++){
-            if (kIdx <  kValues_.size()){
-                threads.create_thread(CalculateMT(this,
-                                                  eA, eB,
-                                                  kIdx, *subSolutions_));
-                kIdx ++;
-            }
-        }
-        threads.join_all();
-    }
-#else
-    for (Index kIdx = 0; kIdx < kValues_.size(); kIdx ++){
-        //if (verbose_ && kValues_.size() > 1) std::cout << "\r" << kIdx + 1 << "/" << kValues_.size();
+    Matrix < float > * subSolutionsF = dynamic_cast< Matrix < float > * >(subSolutions_);
 
+    if (nThreads_ > 1 && !analytical_ && !buildCompleteElectrodeModel_ &&
+        kValues_.size() * nCurrentPattern > 1 && hasDefaultCalculateK_()){
         if (complex_){
-            calculateK(eA, eB, dynamic_cast< CMatrix & > (*subSolutions_), kIdx);
+            calculatePatternMT_(eA, eB, dynamic_cast< CMatrix & > (*subSolutions_));
+        } else if (subSolutionsF){
+            calculatePatternMT_(eA, eB, *subSolutionsF);
         } else {
-            calculateK(eA, eB, dynamic_cast< RMatrix & > (*subSolutions_), kIdx);
+            calculatePatternMT_(eA, eB, dynamic_cast< RMatrix & > (*subSolutions_));
+        }
+    } else {
+        for (Index kIdx = 0; kIdx < kValues_.size(); kIdx ++){
+            //if (verbose_ && kValues_.size() > 1) std::cout << "\r" << kIdx + 1 << "/" << kValues_.size();
+
+            if (complex_){
+                calculateK(eA, eB, dynamic_cast< CMatrix & > (*subSolutions_), kIdx);
+            } else if (subSolutionsF){
+                calculateK_(eA, eB, *subSolutionsF, kIdx);
+            } else {
+                calculateK(eA, eB, dynamic_cast< RMatrix & > (*subSolutions_), kIdx);
+            }
         }
     }
-#endif
     for (Index kIdx = 0; kIdx < kValues_.size(); kIdx ++){
         for (Index i = 0; i < nCurrentPattern; i ++) {
             if (kIdx == 0) {
@@ -1667,6 +1866,8 @@ void DCMultiElectrodeModelling::calculate(const std::vector < ElectrodeShape * >
                     RVector im(imag((dynamic_cast< CMatrix & > (*subSolutions_))[i + kIdx * nCurrentPattern]));
                     solutions_[i] = re * weights_[kIdx];
                     solutions_[i+ nCurrentPattern] = im * weights_[kIdx];
+                } else if (subSolutionsF){
+                    addPotentials_(solutions_[i], (*subSolutionsF)[i + kIdx * nCurrentPattern], weights_[kIdx], true);
                 } else {
                     solutions_[i] = (dynamic_cast< RMatrix & > (*subSolutions_))[i + kIdx * nCurrentPattern] * weights_[kIdx];
                 }
@@ -1676,6 +1877,8 @@ void DCMultiElectrodeModelling::calculate(const std::vector < ElectrodeShape * >
                     RVector im(imag((dynamic_cast< CMatrix & > (*subSolutions_))[i + kIdx * nCurrentPattern]));
                     solutions_[i] += re * weights_[kIdx];
                     solutions_[i + nCurrentPattern] += im * weights_[kIdx];
+                } else if (subSolutionsF){
+                    addPotentials_(solutions_[i], (*subSolutionsF)[i + kIdx * nCurrentPattern], weights_[kIdx], false);
                 } else {
                     solutions_[i] += (dynamic_cast< RMatrix & > (*subSolutions_))[i + kIdx * nCurrentPattern] * weights_[kIdx];
                 }
@@ -1683,6 +1886,12 @@ void DCMultiElectrodeModelling::calculate(const std::vector < ElectrodeShape * >
         }
     }
 
+    if (electrodeSolutions_){
+        //** no stale potentials for createJacobian
+        subSolutions_->clear();
+        collectElectrodes_.clear();
+    }
+
     if (verbose_) std::cout << "Forward: ";
     swatch.stop(verbose_);
     MEMINFO
@@ -1707,10 +1916,125 @@ void DCMultiElectrodeModelling::calculateKAnalyt(const std::vector < ElectrodeSh
     }
 }
 
+//! Maximum amount of values for a block of right hand sides in calculateK_.
+static const Index __RHS_BLOCK_VALUES__ = 16777216;
+
+//! Node count where AUTOMATIC switches from the direct solver to PCG.
+static const Index __PCG_MIN_NODES__ = 3000000;
+
+static inline double electrodePot_(const ElectrodeShape * e, const RVector & u){
+    return e->pot(u);
+}
+
+static inline Complex electrodePot_(const ElectrodeShape * e, const CVector & u){
+    return Complex(e->pot(real(u)), e->pot(imag(u)));
+}
+
+//! Value type of the FEM solve for the storage type of the potentials.
+//! Single precision potentials are solved in double precision.
+template < class StoreType > struct PotValueType_ { typedef StoreType Type; };
+template < > struct PotValueType_< float > { typedef double Type; };
+
+//! Copy the first n potentials from src to dst with conversion.
+template < class ValueType, class StoreType >
+static inline void setPotentials_(Vector < StoreType > & dst,
+                                  const Vector < ValueType > & src, Index n){
+    for (Index i = 0; i < n; i ++) dst[i] = StoreType(src[i]);
+}
+
 template < class ValueType >
+static inline void setPotentials_(Vector < ValueType > & dst,
+                                  const Vector < ValueType > & src, Index n){
+    dst.setVal(src, 0, n);
+}
+
+//! Solve the current pattern [iStart, iStart + nB) for wavenumber index kIdx
+//! with the factorized solver and store them in solutionK. Store only the
+//! potentials at the electrodes elecs if elecs is not empty. nThreads limits
+//! the threads of the residual product, 0 uses threadCount().
+template < class ValueType, class StoreType >
+static void solvePatternBlock_(LinSolver & solver, const SparseMatrix < ValueType > & S,
+                               const std::vector < ElectrodeShape * > & eA,
+                               const std::vector < ElectrodeShape * > & eB,
+                               Matrix < StoreType > & solutionK, Index kIdx,
+                               Index iStart, Index nB, Index oldMatSize,
+                               const std::vector < ElectrodeShape * > & elecs,
+                               Matrix < ValueType > & rhs,
+                               Matrix < ValueType > & sol,
+                               Matrix < ValueType > & res, Index nThreads){
+    Index nCurrentPattern = eA.size();
+
+    rhs.resize(nB, S.rows());
+    for (Index j = 0; j < nB; j ++){
+        Index i = iStart + j;
+        RVector rTmp(S.rows(), 0.0);
+        if (eA[i]) eA[i]->assembleRHS(rTmp,  1.0, oldMatSize);
+        if (eB[i]) eB[i]->assembleRHS(rTmp, -1.0, oldMatSize);
+        rhs[j] = Vector < ValueType >(rTmp);
+    }
+
+    if (solver.solverType() == PCG && elecs.empty()){
+        //** warm start with the potentials of the last call
+        sol.resize(nB, S.rows());
+        for (Index j = 0; j < nB; j ++){
+            sol[j].fill(ValueType(0.0));
+            setPotentials_(sol[j], solutionK[iStart + j + kIdx * nCurrentPattern], oldMatSize);
+        }
+    }
+
+    solver.solve(rhs, sol);
+
+    //** batched residual check: one sparse product for the whole block
+    sparseMatrixMult(S, sol, res, nThreads);
+
+    for (Index j = 0; j < nB; j ++){
+        Index i = iStart + j;
+        double resNorm = norml2(res[j] - rhs[j]);
+        if (resNorm / norml2(rhs[j]) > 1e-6){
+            std::cout   << " Ooops: Warning!!!! Solver: " << solver.solverName()
+                        << " fails with rms(A *x -b)/rms(b) > tol: "
+                        << resNorm << std::endl;
+        }
+        if (elecs.empty()){
+            setPotentials_(solutionK[i + kIdx * nCurrentPattern], sol[j], oldMatSize);
+        } else {
+            Vector < StoreType > & u = solutionK[i + kIdx * nCurrentPattern];
+            for (Index e = 0; e < elecs.size(); e ++) u[e] = electrodePot_(elecs[e], sol[j]);
+        }
+    }
+}
+
+LinSolver * DCMultiElectrodeModelling::createLinSolver_() const {
+    LinSolver * solver = new LinSolver(verbose_);
+    if (solverType_ == AUTOMATIC && mesh_->nodeCount() > __PCG_MIN_NODES__){
+        solver->setSolverType(PCG);
+    } else {
+        solver->setSolverType(solverType_);
+    }
+    return solver;
+}
+
+//! Analytical solutions are stored in the precision of the solve only.
+template < class ValueType >
+static void calculateKAnalyt_(const DCMultiElectrodeModelling & fop,
+                              const std::vector < ElectrodeShape * > & eA,
+                              const std::vector < ElectrodeShape * > & eB,
+                              Matrix < ValueType > & solutionK, double k, int kIdx){
+    fop.calculateKAnalyt(eA, eB, solutionK, k, kIdx);
+}
+
+static void calculateKAnalyt_(const DCMultiElectrodeModelling & fop,
+                              const std::vector < ElectrodeShape * > & eA,
+                              const std::vector < ElectrodeShape * > & eB,
+                              Matrix < float > & solutionK, double k, int kIdx){
+    throwError(1, WHERE_AM_I + " no single precision analytical potentials");
+}
+
+template < class StoreType >
 void DCMultiElectrodeModelling::calculateK_(const std::vector < ElectrodeShape * > & eA,
                                             const std::vector < ElectrodeShape * > & eB,
-                                            Matrix < ValueType > & solutionK, int kIdx){
+                                            Matrix < StoreType > & solutionK, int kIdx){
+    typedef typename PotValueType_< StoreType >::Type ValueType;
     bool debug = false;
     Stopwatch swatch(true);
 
@@ -1725,19 +2049,18 @@ void DCMultiElectrodeModelling::calculateK_(const std::vector < ElectrodeShape *
     }
 
     if (analytical_) {
-        return calculateKAnalyt(eA, eB, solutionK, k, kIdx);
+        return calculateKAnalyt_(*this, eA, eB, solutionK, k, kIdx);
     }
 
-    if (debug) std::cout << "build sparsity pattern ... " ;
-
-    SparseMatrix < ValueType > S_;
-    S_.buildSparsityPattern(*mesh_);
+    //** the matrix for this wavenumber is kept with the mesh sparsity
+    //** pattern, so reassembling is a pure scatter into its values
+    SparseMatrix < ValueType > & S_ = stiffnessMatrix_(kIdx, ValueType(0.0));
 
 MEMINFO
 
 //** START  assemble matrix
     if (verbose_) std::cout << "assemble matrix ... " ;
-    dcfemDomainAssembleStiffnessMatrix(S_, *mesh_, k);
+    dcfemDomainAssembleStiffnessMatrix(S_, *mesh_, meshPattern_, k);
     dcfemBoundaryAssembleStiffnessMatrix(S_, *mesh_, sourceCenterPos_, k);
 
     uint oldMatSize = mesh_->nodeCount();
@@ -1780,66 +2103,41 @@ MEMINFO
 
     //** START solving
 
-    LinSolver solver(verbose_);
+    //** all wavenumbers and calls share the sparsity pattern of the mesh,
+    //** so the ordering and symbolic factorization are reused.
+    //** CEM and bypasses change the pattern and lead to a full factorization.
+    if (!linSolver_) linSolver_ = createLinSolver_();
+    LinSolver & solver = *linSolver_;
     //solver.setSolverType(LDL);
     //    std::cout << "solver: " << solver.solverName() << std::endl;
 
     if (verbose_) std::cout << "Factorize (" << solver.solverName() << ") matrix ... ";
-    solver.setMatrix(S_, 1);
+    solver.refactorise(S_, 1);
 
 MEMINFO
 
-    Vector < ValueType > sol(S_.cols());
+    //** solve blocks of current pattern at once, the block size is limited
+    //** to bound the memory for rhs and solutions
+    Index nBlock = std::max(Index(1), std::min(Index(nCurrentPattern),
+                                               __RHS_BLOCK_VALUES__ / std::max(Index(1), S_.rows())));
+    Matrix < ValueType > rhs;
+    Matrix < ValueType > sol;
+    Matrix < ValueType > res;
 
-    for (uint i = 0; i < nCurrentPattern; i ++){
+    for (Index iStart = 0; iStart < nCurrentPattern; iStart += nBlock){
+        Index nB = std::min(nBlock, nCurrentPattern - iStart);
         if (verbose_ && k == 0){
-            std::cout << "\r " << i << " (" << swatch.duration(true) << "s)";
+            std::cout << "\r " << iStart + nB << " (" << swatch.duration(true) << "s)";
         }
 
-        RVector rTmp(S_.rows(), 0.0);
-        if (eA[i]) eA[i]->assembleRHS(rTmp,  1.0, oldMatSize);
-        if (eB[i]) eB[i]->assembleRHS(rTmp, -1.0, oldMatSize);
-        Vector < ValueType >rhs(rTmp);
-
-        solver.solve(rhs, sol);
-
-//         if (i==4){
-//             S_.save("S-gimli.matrix");
-//             rhs.save("rhs.vec");
-//             save(sol, "sol.vec");
-//             mesh_->addData("sol" + str((kIdx) * nCurrentPattern + i), sol);
-// //             mesh_->addData("rhs", rhs);
-// //             mesh_->addData("soll",abs(log(sol)));
-//             mesh_->exportVTK("sol");
-// //             exit(0);
-//         }
-//         mesh_->addData("sol" + str((kIdx) * nCurrentPattern + i), sol);
-//         S_.save("S-gimli.matrix");
-//         rhs.save("rhs.vec");
-
-//          save(rhs[i],  "rhs.vec");
-//          save(sol, "sol.vec");
-
-//         __MS(complex_)
-//         __MS(min(sol)<< " " << max(sol))
-//         __MS(i<< " " << k)
-        if (norml2(S_ * sol - rhs) / norml2(rhs) > 1e-6){
-//                 S_.save("S.matrix");
-//                 save(rhs[i], "rhs.vec");
-//                 save(sol, "sol.vec");
-            std::cout   << " Ooops: Warning!!!! Solver: " << solver.solverName()
-                            << " fails with rms(A *x -b)/rms(b) > tol: "
-                            << norml2(S_ * sol - rhs)<< std::endl;
-
-//             S_.save("S-gimli.matrix");
-//             rhs.save("rhs.vec");
-//             exit(0);
-        }
-        solutionK[i + kIdx * nCurrentPattern].setVal(sol, 0, oldMatSize);
+        solvePatternBlock_(solver, S_, eA, eB, solutionK, kIdx,
+                           iStart, nB, oldMatSize, collectElectrodes_,
+                           rhs, sol, res, 0);
 
         if (buildCompleteElectrodeModel_){
-            //__MS(sol(oldMatSize, sol.size()- passiveCEM_.size()));
-            potentialsCEM_[i] = TmpToRealHACK(sol(oldMatSize, sol.size() - passiveCEM_.size()));
+            for (Index j = 0; j < nB; j ++){
+                potentialsCEM_[iStart + j] = TmpToRealHACK(sol[j](oldMatSize, sol[j].size() - passiveCEM_.size()));
+            }
         }
 
         // no need for setSingValue here .. numerical primpotentials have
@@ -1850,10 +2148,178 @@ MEMINFO
 //         }
     }
 MEMINFO
-    // we dont need reserve the memory
-    S_.clean();
 }
 
+template < class ValueType >
+void DCMultiElectrodeModelling::factorizeK_(Index kIdx, LinSolver & solver){
+    SparseMatrix < ValueType > & S = stiffnessMatrix_(kIdx, ValueType(0.0));
+    double k = kValues_[kIdx];
+
+    //** every wavenumber task runs on its own thread already
+    dcfemDomainAssembleStiffnessMatrix(S, *mesh_, meshPattern_, k, true, 1);
+    dcfemBoundaryAssembleStiffnessMatrix(S, *mesh_, sourceCenterPos_, k);
+    this->assembleStiffnessMatrixDCFEMByPass(S);
+    assembleStiffnessMatrixHomogenDirichletBC(S, calibrationSourceIdx_);
+
+    solver.refactorise(S, 1);
+}
+
+/*! Worker for \ref DCMultiElectrodeModelling::calculatePatternMT_.
+ * All workers share one task list. The first nK tasks assemble and factorize
+ * the matrix for one wavenumber, all others solve one block of current
+ * pattern for one wavenumber and wait until its factorization is done.
+ * A free worker takes the next task, so wavenumbers and pattern blocks of
+ * different costs balance over all threads. The potentials are solved in
+ * double precision and stored as StoreType. */
+template < class StoreType > class CalculatePatternMT : public BaseCalcMT{
+public:
+    typedef typename PotValueType_< StoreType >::Type ValueType;
+
+    struct Tasks{
+        Tasks(Index nK, Index nBlockTasks)
+            : nK(nK), nTasks(nK + nBlockTasks), next(0),
+              factorized(nK, false), solveMutex(nK), failed(false){
+        }
+        Index nK;
+        Index nTasks;
+        Index next;
+        std::vector < bool > factorized;
+        std::vector < PatternMutex > solveMutex;
+        bool failed;
+        std::string error;
+        PatternMutex mutex;
+        PatternCondition ready;
+    };
+
+    CalculatePatternMT(DCMultiElectrodeModelling & fop,
+                       const std::vector < ElectrodeShape * > & eA,
+                       const std::vector < ElectrodeShape * > & eB,
+                       Matrix < StoreType > & solutionK,
+                       Index blockSize, Index nBlocks,
+                       Tasks & tasks, bool verbose)
+    : BaseCalcMT(0, verbose), fop_(&fop), eA_(&eA), eB_(&eB),
+      solutionK_(&solutionK), blockSize_(blockSize), nBlocks_(nBlocks),
+      tasks_(&tasks){
+    }
+
+    virtual ~CalculatePatternMT(){}
+
+    virtual void calc(Index tNr=0){
+        Matrix < ValueType > rhs;
+        Matrix < ValueType > sol;
+        Matrix < ValueType > res;
+        Index nCurrentPattern = eA_->size();
+        Index nK = tasks_->nK;
+
+        while (true){
+            Index task = 0;
+            {
+                PatternLock lock(tasks_->mutex);
+                if (tasks_->failed || tasks_->next == tasks_->nTasks) return;
+                task = tasks_->next ++;
+            }
+
+            try {
+                if (task < nK){
+                    fop_->factorizeK_< ValueType >(task, *fop_->linSolversK_[task]);
+                    {
+                        PatternLock lock(tasks_->mutex);
+                        tasks_->factorized[task] = true;
+                    }
+                    tasks_->ready.notify_all();
+                } else {
+                    Index kIdx = (task - nK) / nBlocks_;
+                    Index iStart = ((task - nK) % nBlocks_) * blockSize_;
+                    Index nB = std::min(blockSize_, nCurrentPattern - iStart);
+                    {
+                        PatternLock lock(tasks_->mutex);
+                        while (!tasks_->factorized[kIdx] && !tasks_->failed){
+                            tasks_->ready.wait(lock);
+                        }
+                        if (tasks_->failed) return;
+                    }
+                    LinSolver & solver = *fop_->linSolversK_[kIdx];
+                    const SparseMatrix < ValueType > & S =
+                        fop_->stiffnessMatrix_(kIdx, ValueType(0.0));
+
+                    if (solver.threadSafeSolve()){
+                        solvePatternBlock_(solver, S, *eA_, *eB_, *solutionK_,
+                                           kIdx, iStart, nB, fop_->mesh()->nodeCount(),
+                                           fop_->collectElectrodes_, rhs, sol, res, 1);
+                    } else {
+                        PatternLock lock(tasks_->solveMutex[kIdx]);
+                        solvePatternBlock_(solver, S, *eA_, *eB_, *solutionK_,
+                                           kIdx, iStart, nB, fop_->mesh()->nodeCount(),
+                                           fop_->collectElectrodes_, rhs, sol, res, 1);
+                    }
+                }
+            } catch (std::exception & e){
+                {
+                    PatternLock lock(tasks_->mutex);
+                    if (!tasks_->failed) tasks_->error = e.what();
+                    tasks_->failed = true;
+                }
+                tasks_->ready.notify_all();
+                return;
+            }
+        }
+    }
+
+protected:
+    DCMultiElectrodeModelling               * fop_;
+    const std::vector < ElectrodeShape * >  * eA_;
+    const std::vector < ElectrodeShape * >  * eB_;
+    Matrix < StoreType >                    * solutionK_;
+    Index blockSize_;
+    Index nBlocks_;
+    Tasks * tasks_;
+};
+
+template < class StoreType >
+void DCMultiElectrodeModelling::calculatePatternMT_(const std::vector < ElectrodeShape * > & eA,
+                                                    const std::vector < ElectrodeShape * > & eB,
+                                                    Matrix < StoreType > & solutionK){
+    typedef typename PotValueType_< StoreType >::Type ValueType;
+    Index nK = kValues_.size();
+    Index nCurrentPattern = eA.size();
+    Index nNodes = mesh_->nodeCount();
+
+    if (solutionK.rows() < nK * nCurrentPattern) {
+        throwLengthError(1, WHERE_AM_I + " workspace size insufficient" + toStr(solutionK.rows())
+            + " " + toStr(nK * nCurrentPattern));
+    }
+
+    //** the per wavenumber solvers keep their symbolic factorization
+    //** between the calls only if requested, see setKeepFactorizations
+    while (linSolversK_.size() < nK) linSolversK_.push_back(createLinSolver_());
+
+    //** split the pattern into enough blocks to feed all threads
+    //** but keep the rhs block memory bounded like calculateK_
+    Index nBlocksK = std::max(Index(1), (2 * nThreads_ + nK - 1) / nK);
+    Index blockSize = std::max(Index(1), (nCurrentPattern + nBlocksK - 1) / nBlocksK);
+    blockSize = std::min(blockSize, std::max(Index(1), __RHS_BLOCK_VALUES__ / std::max(Index(1), nNodes)));
+    nBlocksK = (nCurrentPattern + blockSize - 1) / blockSize;
+
+    if (verbose_) std::cout << "Calculate " << nK << " wavenumbers with "
+                            << nBlocksK << " pattern blocks each on "
+                            << nThreads_ << " threads ("
+                            << linSolversK_[0]->solverName() << ") ... ";
+
+    //** create the shared sparsity pattern and all matrices before the threads start
+    for (Index kIdx = 0; kIdx < nK; kIdx ++) stiffnessMatrix_(kIdx, ValueType(0.0));
+
+    typename CalculatePatternMT< StoreType >::Tasks tasks(nK, nK * nBlocksK);
+    Index nWorker = std::min(nThreads_, tasks.nTasks);
+
+    ALLOW_PYTHON_THREADS
+    distributeCalc(CalculatePatternMT< StoreType >(*this, eA, eB, solutionK,
+                                                   blockSize, nBlocksK,
+                                                   tasks, verbose_),
+                   nWorker, nWorker, verbose_);
+
+    if (!keepFactorizations_) clearLinSolvers_();
+    if (tasks.failed) throwError(1, WHERE_AM_I + " " + tasks.error);
+}
 
 void DCMultiElectrodeModelling::calculateK(const std::vector < ElectrodeShape * > & eA,
                                            const std::vector < ElectrodeShape * > & eB,
@@ -2086,23 +2552,22 @@ void DCSRMultiElectrodeModelling::calculateK(const std::vector < ElectrodeShape
     }
 MEMINFO
 
-    RSparseMatrix S_;
-    S_.buildSparsityPattern(*mesh_);
+    RSparseMatrix & S_ = stiffnessMatrix_(kIdx, 0.0);
     bool singleVerbose = verbose_;
 
 MEMINFO
 
-    dcfemDomainAssembleStiffnessMatrix(       S_, *mesh_, k);
+    dcfemDomainAssembleStiffnessMatrix(       S_, *mesh_, meshPattern_, k);
     dcfemBoundaryAssembleStiffnessMatrix(     S_, *mesh_, sourceCenterPos_, k);
     assembleStiffnessMatrixHomogenDirichletBC(S_, calibrationSourceIdx_);
 //     S_.save("S.mat");
 //     exit(1);
 
-    RSparseMatrix S1(S_);
+    RSparseMatrix S1;
 
 //     RVector tmpRho(mesh_->cellAttributes());
 //     mesh_->setCellAttributes(1.0);
-    dcfemDomainAssembleStiffnessMatrix(  S1, mesh1_, k);
+    dcfemDomainAssembleStiffnessMatrix(  S1, mesh1_, meshPattern_, k);
     dcfemBoundaryAssembleStiffnessMatrix(S1, mesh1_, sourceCenterPos_, k);
     assembleStiffnessMatrixHomogenDirichletBC(S1, calibrationSourceIdx_);
 
@@ -2110,8 +2575,9 @@ MEMINFO
     //mesh_->setCellAttributes(tmpRho);
 
 MEMINFO
-    LinSolver solver(false);
-    solver.setMatrix(S_, 1);
+    if (!linSolver_) linSolver_ = new LinSolver(false);
+    LinSolver & solver = *linSolver_;
+    solver.refactorise(S_, 1);
 //     if (verbose_) std::cout << "Factorize (" << solver.solverName() << ") matrix ... " << swatch.duration() << std::endl;
 
 MEMINFO
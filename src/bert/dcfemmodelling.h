@@ -22,6 +22,7 @@
 #include "bert.h"
 #include "datamap.h"
 
+#include <linSolver.h>
 #include <modellingbase.h>
 #include <sparsematrix.h>
 #include <pos.h>
@@ -38,6 +39,20 @@ DLLEXPORT void dcfemDomainAssembleStiffnessMatrix(RSparseMatrix & S, const Mesh
 DLLEXPORT void dcfemDomainAssembleStiffnessMatrix(CSparseMatrix & S, const Mesh & mesh,
                                                   double k=0.0, bool fix=true);
 
+/*! Same as above but S takes the sparsity pattern from a prebuild pattern
+ * of mesh and the element matrices are scattered without searching.
+ * The cells are added on nThreads threads by colour, see \ref assembleCells.
+ * nThreads = 0 takes \ref threadCount(). */
+DLLEXPORT void dcfemDomainAssembleStiffnessMatrix(RSparseMatrix & S, const Mesh & mesh,
+                                                  const MeshSparsityPattern & pattern,
+                                                  double k=0.0, bool fix=true,
+                                                  Index nThreads=0);
+
+DLLEXPORT void dcfemDomainAssembleStiffnessMatrix(CSparseMatrix & S, const Mesh & mesh,
+                                                  const MeshSparsityPattern & pattern,
+                                                  double k=0.0, bool fix=true,
+                                                  Index nThreads=0);
+
 // DLLEXPORT void assembleStiffnessMatrixHomogenDirichletBC(RSparseMatrix & S,
 //                                                          const IndexArray & nodeID);
 
@@ -132,6 +147,10 @@ public:
 
     virtual void createJacobian(const RVector & model);
 
+    /*! The Jacobian is built from the potentials of the last \ref response,
+     * so responses are never taken from the cache. */
+    virtual bool responseCacheable() const { return false; }
+
     virtual void createConstraints();
 
     DataContainerERT & dataContainer() const ;
@@ -259,32 +278,121 @@ public:
     /*! Return true if singular value estimation is switched on.*/
     bool isSetSingValue() const { return setSingValue_;}
 
+    /*! Set the solver for the FEM equation system. AUTOMATIC takes a direct
+     * solver and switches to the iterative PCG for meshes with more than
+     * 3 million nodes where factorization does not fit into memory.
+     * PCG starts with the potentials of the last call. */
+    void setSolverType(SolverType solverType);
+
+    /*! Return the requested solver type. */
+    SolverType solverType() const { return solverType_; }
+
+    /*! Keep only the potentials at the electrodes for the response.
+     * Every wavenumber solution is reduced to the electrode potentials
+     * right after the solve and summed up, so the memory for the potentials
+     * drops from nPattern * nK * nNodes to nPattern * nK * nElectrodes.
+     * \ref createJacobian calculates the full potentials again.
+     * PCG starts without the potentials of the last call then. Ignored for
+     * analytical solutions and if calculateK is overwritten. */
+    void setElectrodePotentialsOnly(bool e=true) { electrodePotentialsOnly_ = e; }
+
+    /*! Return true if only potentials at the electrodes are kept. */
+    bool electrodePotentialsOnly() const { return electrodePotentialsOnly_; }
+
+    /*! Store the full potentials of all wavenumbers in single precision.
+     * Every solved block is converted right after the solve, so the memory
+     * of the potentials for \ref createJacobian is halved with no double
+     * precision copy at any time. The FEM solver, the summation of the
+     * wavenumbers and of the sensitivities stay in double precision, the
+     * response has a relative accuracy of about 1e-7. Real valued models
+     * only, ignored for analytical solutions, for electrode potentials
+     * only and for potentials set with \ref collectSubPotentials. */
+    void setSinglePrecisionPotentials(bool s=true) { singlePrecisionPotentials_ = s; }
+
+    /*! Return true if the potentials for the sensitivities are stored in single precision. */
+    bool singlePrecisionPotentials() const { return singlePrecisionPotentials_; }
+
+    /*! Keep the factorizations of all wavenumbers of the threaded
+     * calculation between the calls, so the symbolic analysis is reused.
+     * This holds nK numeric factorizations in memory in addition to the one
+     * of the serial solver. Default is false, they are freed after every
+     * calculation. */
+    void setKeepFactorizations(bool k=true) {
+        keepFactorizations_ = k;
+        if (!k) clearLinSolvers_();
+    }
+
+    /*! Return true if the factorizations of all wavenumbers are kept. */
+    bool keepFactorizations() const { return keepFactorizations_; }
+
 private:
     void init_();
 
 protected:
+    template < class StoreType > friend class CalculatePatternMT;
 
-    template < class ValueType >
+    /*! Solve wavenumber index kIdx and store the potentials as StoreType.
+     * Matrix < float > is solved in double precision. */
+    template < class StoreType >
     void calculateK_(const std::vector < ElectrodeShape * > & eA,
                      const std::vector < ElectrodeShape * > & eB,
-                     Matrix < ValueType > & solutionK, int kIdx);
+                     Matrix < StoreType > & solutionK, int kIdx);
+
+    /*! Solve all wavenumbers and current pattern blocks as independent
+     * tasks on \ref threadCount() threads. Every wavenumber gets its own
+     * solver in \ref linSolversK_, see \ref setKeepFactorizations. */
+    template < class StoreType >
+    void calculatePatternMT_(const std::vector < ElectrodeShape * > & eA,
+                             const std::vector < ElectrodeShape * > & eB,
+                             Matrix < StoreType > & solutionK);
+
+    /*! Assemble the stiffness matrix for wavenumber index kIdx without
+     * complete electrode model and factorize it with solver. */
+    template < class ValueType >
+    void factorizeK_(Index kIdx, LinSolver & solver);
+
+    /*! Return true if the wavenumber solutions come from calculateK_, so
+     * \ref calculate may split the work into wavenumber and current pattern
+     * tasks and reduce them to electrode potentials. Overwrite and return
+     * false if calculateK is overwritten. */
+    virtual bool hasDefaultCalculateK_() const { return true; }
+
+    /*! Create a solver due to \ref solverType_. */
+    LinSolver * createLinSolver_() const;
+
+    void clearLinSolvers_();
 
     template < class ValueType >
     void assembleStiffnessMatrixDCFEMByPass_(SparseMatrix < ValueType > & S);
 
+    /*! Return the stiffness matrix for wavenumber index kIdx. It is kept
+     * between the calls and shares the sparsity pattern \ref meshPattern_.
+     * The second argument only selects the value type. */
+    RSparseMatrix & stiffnessMatrix_(Index kIdx, double);
+    CSparseMatrix & stiffnessMatrix_(Index kIdx, Complex);
+
+    void clearStiffnessMatrices_();
+
     template < class ValueType >
     DataMap response_(const Vector < ValueType > & model,
                                    ValueType background);
 
+    /*! Calculate the full potentials for the sensitivities if needed and
+     * return them. Matrix < float > for single precision potentials. */
     template < class ValueType >
-    Matrix < ValueType > * prepareJacobianT_(const Vector< ValueType > & model);
+    MatrixBase * prepareJacobianT_(const Vector< ValueType > & model);
 
     RMatrix * prepareJacobian_(const RVector & model);
     CMatrix * prepareJacobian_(const CVector & model);
 
     void createJacobian_(const RVector & model, const RMatrix & u, RMatrix * J);
+    void createJacobian_(const RVector & model, const Matrix < float > & u, RMatrix * J);
     void createJacobian_(const CVector & model, const CMatrix & u, CMatrix * J);
 
+    template < class PotValueType >
+    void createJacobianT_(const RVector & model, const Matrix < PotValueType > & u,
+                          RMatrix * J);
+
     virtual void deleteMeshDependency_();
     virtual void updateMeshDependency_();
     virtual void updateDataDependency_();
@@ -329,6 +437,24 @@ protected:
     RMatrix potentialsCEM_;
 
     DataMap * primDataMap_;
+
+    MeshSparsityPattern meshPattern_;
+    std::vector < RSparseMatrix * > stiffnessMatricesR_;
+    std::vector < CSparseMatrix * > stiffnessMatricesC_;
+
+    /*! Keeps the symbolic factorization for all wavenumbers and calls. */
+    LinSolver * linSolver_;
+    /*! Solver for each wavenumber for the threaded calculation. */
+    std::vector < LinSolver * > linSolversK_;
+    bool keepFactorizations_;
+    SolverType solverType_;
+
+    bool electrodePotentialsOnly_;
+    bool singlePrecisionPotentials_;
+    /*! True if solutions_ holds electrode potentials only. */
+    bool electrodeSolutions_;
+    /*! Electrodes for the reduction while \ref calculate, empty for full potentials. */
+    std::vector< ElectrodeShape * > collectElectrodes_;
 };
 
 class DLLEXPORT DCSRMultiElectrodeModelling : public DCMultiElectrodeModelling {
@@ -391,6 +517,8 @@ protected:
     virtual void updateMeshDependency_();
     virtual void updateDataDependency_();
 
+    virtual bool hasDefaultCalculateK_() const { return false; }
+
     void checkPrimpotentials_(const std::vector < ElectrodeShape * > & eA,
                                const std::vector < ElectrodeShape * > & eB);
 
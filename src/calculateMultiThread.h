@@ -42,9 +42,7 @@ public:
     void setRange(Index start, Index end, Index threadNumber=0){
         start_ = start;
         end_ = end;
-        if (threadNumber_ > 0){
-            threadNumber_ = threadNumber;
-        }
+        threadNumber_ = threadNumber;
     }
 
     virtual void calc(Index tNr=0)=0;
@@ -61,14 +59,12 @@ template < class T > void distributeCalc(T calc, uint nCalcs, uint nThreads, boo
         calc.setRange(0, nCalcs);
         calc();
     } else {
-        uint singleCalcCount = (uint)ceil((double)nCalcs / (double)nThreads);
-
         std::vector < T > calcObjs;
         for (uint i = 0; i < nThreads; i ++){
             calcObjs.push_back(calc);
-            Index start = singleCalcCount * i;
-            Index end   = singleCalcCount * (i + 1);
-            if (i == nThreads -1) end = nCalcs;
+            //! balanced split, every range lies within [0, nCalcs)
+            Index start = (Index)nCalcs * i / nThreads;
+            Index end   = (Index)nCalcs * (i + 1) / nThreads;
             if (debug()) std::cout << "Threaded calculation: " << i << ": " << start <<" " << end << std::endl;
             calcObjs.back().setRange(start, end, i);
         }
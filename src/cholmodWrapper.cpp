@@ -18,6 +18,7 @@
 
 #include "cholmodWrapper.h"
 #include "vector.h"
+#include "matrix.h"
 #include "sparsematrix.h"
 
 #if CHOLMOD_FOUND
@@ -283,6 +284,42 @@ int CHOLMODWrapper::factorise(){
     return 0;
 }
 
+template < class ValueType >
+int CHOLMODWrapper::refactorise_(SparseMatrix < ValueType > & S, bool isComplex){
+    if (dummy_ || useUmfpack_ || isComplex != isComplex_) return 0;
+#if USE_CHOLMOD
+    cholmod_sparse * A = (cholmod_sparse*)A_;
+    if (!A || !L_) return 0;
+
+    if (A->nrow != S.nRows() || A->ncol != S.nCols() || A->nzmax != S.nVals()){
+        return 0;
+    }
+    //** S may live in other memory than the initial matrix
+    A->p = (void*)S.colPtr();
+    A->i = (void*)S.rowIdx();
+    A->x = S.vals();
+
+    //** L_ holds the symbolic analysis, cholmod only recomputes the values
+    cholmod_factorize(A, (cholmod_factor*)L_, (cholmod_common*)c_);
+    if (((cholmod_common*)c_)->status != CHOLMOD_OK){
+        std::cerr << WHERE_AM_I << " Warning! cholmod refactorization status: "
+                  << ((cholmod_common*)c_)->status << std::endl;
+    }
+    return 1;
+#else
+    std::cerr << WHERE_AM_I << " cholmod not installed" << std::endl;
+#endif
+    return 0;
+}
+
+int CHOLMODWrapper::refactorise(RSparseMatrix & S){
+    return refactorise_(S, false);
+}
+
+int CHOLMODWrapper::refactorise(CSparseMatrix & S){
+    return refactorise_(S, true);
+}
+
 template < class ValueType >
     int CHOLMODWrapper::solveCHOL_(const Vector < ValueType > & rhs,
                                    Vector < ValueType > & solution){
@@ -328,6 +365,76 @@ template < class ValueType >
     return 0;
 }
 
+template < class ValueType >
+int CHOLMODWrapper::solveCHOL_(const Matrix < ValueType > & B,
+                               Matrix < ValueType > & X){
+    if (!dummy_){
+#if USE_CHOLMOD
+        Index nB = B.rows();
+        X.resize(nB, dim_);
+        if (nB == 0) return 1;
+
+        //** cholmod dense matrices are column major, one rhs per column
+        cholmod_dense * b = cholmod_zeros(((cholmod_sparse*)A_)->nrow,
+                                          nB,
+                                          ((cholmod_sparse*)A_)->xtype,
+                                          (cholmod_common*)c_);
+
+        ValueType * bx = (ValueType*)b->x;
+        for (Index j = 0; j < nB; j++){
+            const Vector < ValueType > & Bj = B[j];
+            for (uint i = 0; i < dim_; i++) bx[j * b->d + i] = Bj[i];
+        }
+
+        cholmod_dense * x = cholmod_solve(CHOLMOD_A,
+                                          (cholmod_factor *)L_,
+                                          b,
+                                          (cholmod_common *)c_);       /* solve AX=B */
+
+        if (((cholmod_sparse*)A_)->stype == 0){
+            cholmod_dense * r = cholmod_zeros(((cholmod_sparse*)A_)->nrow,
+                                              nB,
+                                              ((cholmod_sparse*)A_)->xtype,
+                                              (cholmod_common*)c_);
+            double al[2] = {0,0}, be[2] = {1,0};       /* basic scalars */
+            cholmod_sdmult((cholmod_sparse*)A_, 0, be, al, x, r, (cholmod_common*)c_);
+            bx = (ValueType *)r->x; /* ret = AX, see solveCHOL_ for vectors */
+            for (Index j = 0; j < nB; j++){
+                for (uint i = 0; i < dim_; i++) X[j][i] = conj(bx[j * r->d + i]);
+            }
+            cholmod_free_dense(&r, (cholmod_common*)c_);
+        } else {
+            bx = (ValueType *)x->x; /* ret = X */
+            for (Index j = 0; j < nB; j++){
+                for (uint i = 0; i < dim_; i++) X[j][i] = bx[j * x->d + i];
+            }
+        }
+        cholmod_free_dense(&x, (cholmod_common*)c_);
+        cholmod_free_dense(&b, (cholmod_common*)c_);
+        return 1;
+#else
+        std::cerr << WHERE_AM_I << " cholmod not installed" << std::endl;
+#endif
+    }
+    return 0;
+}
+
+int CHOLMODWrapper::solve(const RMatrix & B, RMatrix & X){
+    if (!dummy_){
+        if (useUmfpack_) return SolverWrapper::solve(B, X);
+        return solveCHOL_(B, X);
+    }
+    return 0;
+}
+
+int CHOLMODWrapper::solve(const CMatrix & B, CMatrix & X){
+    if (!dummy_){
+        if (useUmfpack_) return SolverWrapper::solve(B, X);
+        return solveCHOL_(B, X);
+    }
+    return 0;
+}
+
 int CHOLMODWrapper::solve(const RVector & rhs, RVector & solution){
     if (!dummy_){
 
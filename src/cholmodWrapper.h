@@ -36,10 +36,21 @@ public:
 
     int factorise();
 
+    /*! Numeric factorization only, reusing the ordering and the supernodal
+     * structure of the first \ref factorise. Not for the umfpack path. */
+    virtual int refactorise(RSparseMatrix & S);
+
+    virtual int refactorise(CSparseMatrix & S);
+
     virtual int solve(const RVector & rhs, RVector & solution);
 
     virtual int solve(const CVector & rhs, CVector & solution);
 
+    /*! Solve all rows of B with one multi column cholmod solve. */
+    virtual int solve(const RMatrix & B, RMatrix & X);
+
+    virtual int solve(const CMatrix & B, CMatrix & X);
+
 protected:
     void init();
 
@@ -53,9 +64,15 @@ protected:
     template < class ValueType >
     int initMatrixChol_(SparseMatrix < ValueType > & S, int xType);
 
+    template < class ValueType >
+    int refactorise_(SparseMatrix < ValueType > & S, bool isComplex);
+
     template < class ValueType >
     int solveCHOL_(const Vector < ValueType > & rhs, Vector < ValueType > & solution);
 
+    template < class ValueType >
+    int solveCHOL_(const Matrix < ValueType > & B, Matrix < ValueType > & X);
+
 
     template < class ValueType >
     int solveUmf_(const Vector < ValueType > & rhs, Vector < ValueType > & solution);
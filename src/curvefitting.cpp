@@ -109,6 +109,10 @@ HarmonicModelling::HarmonicModelling(size_t nh, const RVector & tvec, bool verbo
 }
 
 RVector HarmonicModelling::response(const RVector & par){
+    return response_mt(par);
+}
+
+RVector HarmonicModelling::response_mt(const RVector & par, Index i) const {
     return transMult (A_ , par);
 }
 
@@ -156,6 +160,11 @@ RVector PolynomialModelling::response(const RVector & par){
     return f_.fill(round(par, TOLERANCE))(referencePoints_);
 }
 
+RVector PolynomialModelling::response_mt(const RVector & par, Index i) const {
+    PolynomialFunction< double > f(f_);
+    return f.fill(round(par, TOLERANCE))(referencePoints_);
+}
+
 RVector PolynomialModelling::startModel(){
     if (startModel_.size() == powInt(f_.size(), 3)) return startModel_;
 
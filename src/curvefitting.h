@@ -93,6 +93,10 @@ public:
     /*! the main thing - the forward operator: return f(x) */
     virtual RVector response(const RVector & par);
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian and \ref responses, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & par, Index i=0) const;
+
     /*! an additional forward operator for another time basis */
     virtual RVector response(const RVector & par, const RVector tvec);
 
@@ -121,6 +125,11 @@ public:
 
     virtual RVector response(const RVector & par);
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian. Works on a copy of the polynomial function, so
+     * \ref polynomialFunction is not changed. */
+    virtual RVector response_mt(const RVector & par, Index i=0) const;
+
     /*! Create starting model. The dimension is recognized here \n
         * one-dimensional:         p[0][0][*] = 1 \n
         * two-dimensional:         p[0][*][*] = 1 \n
@@ -80,6 +80,10 @@ RVector DC1dModelling::createDefaultStartModel() {
 }
 
 RVector DC1dModelling::response(const RVector & model) {
+    return response_mt(model);
+}
+
+RVector DC1dModelling::response_mt(const RVector & model, Index i) const {
 
     if (model.size() < (nlayers_ * 2 - 1)){
         throwError(1, WHERE_AM_I + " model vector to small: nlayers_ * 2 - 1 = " + toStr(nlayers_ * 2 - 1) + " > " + toStr(model.size()));
@@ -95,15 +99,15 @@ RVector DC1dModelling::response(const RVector & model) {
     return rhoa(rho, thk);
 }
 
-RVector DC1dModelling::rhoa(const RVector & rho, const RVector & thk) {
-    tmp_ = pot1d(am_, rho, thk);
-    tmp_ -= pot1d(an_, rho, thk);
-    tmp_ -= pot1d(bm_, rho, thk);
-    tmp_ += pot1d(bn_, rho, thk);
-    return tmp_ * k_ + rho[0];
+RVector DC1dModelling::rhoa(const RVector & rho, const RVector & thk) const {
+    RVector tmp(pot1d(am_, rho, thk));
+    tmp -= pot1d(an_, rho, thk);
+    tmp -= pot1d(bm_, rho, thk);
+    tmp += pot1d(bn_, rho, thk);
+    return tmp * k_ + rho[0];
 }
 
-RVector DC1dModelling::kern1d(const RVector & lam, const RVector & rho, const RVector & h) {
+RVector DC1dModelling::kern1d(const RVector & lam, const RVector & rho, const RVector & h) const {
     size_t nr = rho.size();
     size_t nl = lam.size();
     RVector z(nl, rho[nr - 1]);
@@ -119,7 +123,7 @@ RVector DC1dModelling::kern1d(const RVector & lam, const RVector & rho, const RV
     return ehl / (1.0 - ehl) * rho[0] / 2.0 / PI ;
 }
 
-RVector DC1dModelling::pot1d(const RVector & R, const RVector & rho, const RVector & thk) {
+RVector DC1dModelling::pot1d(const RVector & R, const RVector & rho, const RVector & thk) const {
     RVector z0(R.size());
     double rabs;
     for (size_t i = 0; i < R.size(); i++) {
@@ -424,6 +428,10 @@ DC1dModellingC::DC1dModellingC(size_t nlayers,
 }
 
 RVector DC1dModellingC::response(const RVector & model) {
+    return response_mt(model);
+}
+
+RVector DC1dModellingC::response_mt(const RVector & model, Index i) const {
     if (model.size() < (nlayers_ * 3 - 1)){
         throwError(1, WHERE_AM_I + " model vector to small: nlayers_ * 3 - 1 = " + toStr(nlayers_ * 3 - 1) + " > " + toStr(model.size()));
     }
@@ -55,17 +55,21 @@ public:
      * For n = nlayers. */
     RVector response(const RVector & model);
 
-    RVector rhoa(const RVector & rho, const RVector & thk);
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & model, Index i=0) const;
 
-    RVector kern1d(const RVector & lam, const RVector & rho, const RVector & h);
+    RVector rhoa(const RVector & rho, const RVector & thk) const;
 
-    RVector pot1d(const RVector & R, const RVector & rho, const RVector & thk);
+    RVector kern1d(const RVector & lam, const RVector & rho, const RVector & h) const;
+
+    RVector pot1d(const RVector & R, const RVector & rho, const RVector & thk) const;
 
     inline RVector getK() { return k_; }
 
     inline RVector geometricFactor() { return k_; }
 
-    template < class Vec > Vec rhoaT(const Vec & rho, const RVector & thk){
+    template < class Vec > Vec rhoaT(const Vec & rho, const RVector & thk) const {
         Vec tmp;
         tmp  = pot1dT<Vec>(am_, rho, thk);
         tmp -= pot1dT<Vec>(an_, rho, thk);
@@ -74,7 +78,7 @@ public:
         return tmp * k_ + rho[ 0 ];
     }
     template < class Vec > Vec kern1dT(const RVector & lam, const Vec & rho,
-                                       const RVector & h){
+                                       const RVector & h) const {
         size_t nr = rho.size();
         size_t nl = lam.size();
         Vec z(nl, rho[ nr - 1 ]);
@@ -90,7 +94,7 @@ public:
         return ehl / (1.0 - ehl) * rho[0] / 2.0 / PI ;
     }
     template < class Vec > Vec pot1dT(const RVector & R, const Vec & rho,
-                                      const RVector & thk){
+                                      const RVector & thk) const {
         Vec z0(R.size());
         //double rabs;
         RVector rabs(abs(R));
@@ -118,7 +122,6 @@ protected:
     RVector bm_;
     RVector bn_;
     RVector k_;
-    RVector tmp_;
 
     RVector myx_;
     RVector myw_;
@@ -140,6 +143,8 @@ public:
     virtual ~DC1dModellingC() { }
 
     RVector response(const RVector & model);
+
+    virtual RVector response_mt(const RVector & model, Index i=0) const;
 };
 
 /*! DC1dRhoModelling - Variant of DC 1D modelling with fixed parameterization
@@ -170,6 +175,10 @@ public:
 
     RVector response(const RVector & rho) {  return rhoa(rho, thk_); }
 
+    virtual RVector response_mt(const RVector & rho, Index i=0) const {
+        return rhoa(rho, thk_);
+    }
+
     RVector createDefaultStartModel() {
         return RVector(thk_.size() + 1, meanrhoa_);
     }
@@ -157,14 +157,14 @@ public:
         return ret;
     }
 
-        /*! Return (S * (a-b)) * (m-n) */
-    template < class Val > Val mult_(const Vector < Val > & a,
+        /*! Return (S * (a-b)) * (m-n), summed up with value type Sum */
+    template < class Val, class Sum=Val > Sum mult_(const Vector < Val > & a,
                    const Vector < Val> & b,
                    const Vector < Val> & m,
                    const Vector < Val> & n){
-        Val ret = 0;
+        Sum ret = 0;
         for (Index i = 0; i < size(); i ++) {
-            Val t = 0;
+            Sum t = 0;
             for (Index j = 0; j < size(); j ++) {
                 t += mat_[i][j] * (a[idx_[j]]-b[idx_[j]]);
             }
@@ -181,6 +181,11 @@ public:
                 const CVector & m, const CVector & n){
         return mult_(a, b, m, n);
     }
+    /*! Single precision potentials, summed up in double precision. */
+    double mult(const Vector < float > & a, const Vector < float > & b,
+                const Vector < float > & m, const Vector < float > & n){
+        return mult_< float, double >(a, b, m, n);
+    }
 
 
 protected:
@@ -25,7 +25,7 @@
 
 namespace GIMLI {
 
-RVector MT1dModelling::rhoaphi(const RVector & rho, const RVector & thk) { // after mtmod.c by R.-U. B�rner
+RVector MT1dModelling::rhoaphi(const RVector & rho, const RVector & thk) const { // after mtmod.c by R.-U. B�rner
     size_t nperiods = periods_.size();
     RVector rhoa(nperiods), phi(nperiods);
 
@@ -56,12 +56,16 @@ RVector MT1dModelling::rhoa(const RVector & model){ //! app. res. for thk/res ve
 
     /*! the actual (full) forward operator returning app.res.+phase for thickness+resistivity */
 RVector MT1dModelling::response(const RVector & model) {
+    return response_mt(model);
+}
+
+RVector MT1dModelling::response_mt(const RVector & model, Index i) const {
     if (model.size() != nlay_ * 2 - 1) return EXIT_VECTOR_SIZE_INVALID;
     RVector thk(model, 0, nlay_ - 1), rho(model, nlay_ - 1, 2 * nlay_ - 1);
     return rhoaphi(rho, thk);
 }
 
-RVector MT1dModelling::rhoa(const RVector & rho, const RVector & thk) { // after mtmod.c by R.-U. B�rner
+RVector MT1dModelling::rhoa(const RVector & rho, const RVector & thk) const { // after mtmod.c by R.-U. B�rner
     size_t nperiods = periods_.size();
     return rhoaphi(rho, thk)(0,nperiods);
     //CR not needed?
@@ -130,7 +134,7 @@ Complex btp(double u, double f, RVector rho, RVector d){
     return b;
 }
 
-RVector FDEM1dModelling::calc(const RVector & rho, const RVector & thk){
+RVector FDEM1dModelling::calc(const RVector & rho, const RVector & thk) const {
     double hankelJ0[100]={
         2.89878288E-07,3.64935144E-07,4.59426126E-07,5.78383226E-07,
         7.28141338E-07,9.16675639E-07,1.15402625E-06,1.45283298E-06,
@@ -181,11 +185,19 @@ RVector FDEM1dModelling::calc(const RVector & rho, const RVector & thk){
 }
 
 RVector FDEM1dModelling::response(const RVector & model){
+    return response_mt(model);
+}
+
+RVector FDEM1dModelling::response_mt(const RVector & model, Index i) const {
     RVector thk(model, 0, nlay_ - 1), rho(model, nlay_ - 1, 2 * nlay_ - 1);
     return calc(rho, thk);
 }
 
 RVector MRSModelling::response(const RVector & model) {
+    return response_mt(model);
+}
+
+RVector MRSModelling::response_mt(const RVector & model, Index i) const {
     RVector outreal(*KR_ * model);
     RVector outimag(*KI_ * model);
     return RVector(sqrt(outreal * outreal + outimag * outimag));
@@ -205,6 +217,17 @@ void MRSModelling::createJacobian(const RVector & model) {
 }
 
 RVector MRS1dBlockModelling::response(const RVector & model){
+    RVector wcvec(waterContent(model));
+    if (verbose_) save(wcvec, "wctmp.vec");
+    //! call original forward response and return;
+    return MRSModelling::response_mt(wcvec);
+}
+
+RVector MRS1dBlockModelling::response_mt(const RVector & model, Index i) const {
+    return MRSModelling::response_mt(waterContent(model));
+}
+
+RVector MRS1dBlockModelling::waterContent(const RVector & model) const {
         //! extract water content and thickness from model vector
         RVector wc(model, nlay_ - 1 , nlay_ * 2 - 1);
         RVector thk(model, 0 , nlay_ - 1);
@@ -226,9 +249,7 @@ RVector MRS1dBlockModelling::response(const RVector & model){
             iz1 = iz2 + 1;
         }
 
-        if (verbose_) save(wcvec, "wctmp.vec");
-        //! call original forward response and return;
-        return MRSModelling::response(wcvec);
+        return wcvec;
     }
 
 
@@ -44,9 +44,9 @@ public:
     virtual ~MT1dModelling() { }
 
     /*! different sub-forward operators for alternate use */
-    virtual RVector rhoaphi(const RVector & rho, const RVector & thk); //! app. res. and phase
+    virtual RVector rhoaphi(const RVector & rho, const RVector & thk) const; //! app. res. and phase
 
-    virtual RVector rhoa(const RVector & rho, const RVector & thk);    //! only app. res.
+    virtual RVector rhoa(const RVector & rho, const RVector & thk) const;    //! only app. res.
 
     virtual RVector rhoa(const RVector & model);
     //! app. res. for thk/res vector
@@ -55,6 +55,10 @@ public:
     /*! the actual (full) forward operator returning app.res.+phase for thickness+resistivity */
     virtual RVector response(const RVector & model);
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & model, Index i=0) const;
+
 protected:
     RVector periods_;
     size_t nlay_;
@@ -78,6 +82,12 @@ public:
 
     virtual RVector response(const RVector & rho) { return rhoaphi(rho, thk_); }
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & rho, Index i=0) const {
+        return rhoaphi(rho, thk_);
+    }
+
     virtual RVector rhoa(const RVector & rho) { return MT1dModelling::rhoa(rho, thk_); }
 
 protected:
@@ -103,12 +113,16 @@ public:
 
     virtual RVector response(const RVector & model);
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & model, Index i=0) const;
+
     /*! Return reference to the freeAirSolution.
      * This will be automatic filled by and init() call during
      * instance construction. */
     const RVector & freeAirSolution() const { return freeAirSolution_; }
 
-    RVector calc(const RVector & rho, const RVector & thk);
+    RVector calc(const RVector & rho, const RVector & thk) const;
 
 
 protected:
@@ -143,6 +157,12 @@ public:
 
     RVector response(const RVector & model){ return calc(model, thk_); }
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & model, Index i=0) const {
+        return calc(model, thk_);
+    }
+
 protected:
     RVector thk_;
 };
@@ -164,6 +184,10 @@ public:
     /*! return response voltage for a given water content vector */
     RVector response(const RVector & model);
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & model, Index i=0) const;
+
     /*! create jacobian matrix (AmplitudeJacobian) */
     void createJacobian(const RVector & model);
 
@@ -191,6 +215,13 @@ public:
     /*! return voltage for a given block model vector */
     RVector response(const RVector & model);
 
+    /*! Read only variant of \ref response for the threaded brute force
+     * Jacobian, see \ref setMultiThreadJacobian. */
+    virtual RVector response_mt(const RVector & model, Index i=0) const;
+
+    /*! return the water content for the zvector of a given block model vector */
+    RVector waterContent(const RVector & model) const;
+
     /*! use default (brute-force) jacobian generator (override the smooth one) */
     void createJacobian(const RVector & model){
         ModellingBase::createJacobian(model);
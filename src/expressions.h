@@ -34,6 +34,8 @@
 
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <stdint.h>
 
 namespace std{
     // make std::less happy .. this wont work without this namespace
@@ -171,6 +173,70 @@ inline double acot(const double & a) { return PI / 2.0 * std::atan(a); }
 inline double sign(const double & a) { return a > 0.0 ? 1.0 : (a < 0.0 ? -1.0 : 0.0); }
 inline double exp10(const double & a) { return std::pow(10.0, a); }
 
+//** Branch free exp and log for the element-wise vector kernels. libm calls
+//** block the vectorizer, so these use integer bit tricks and masked selects
+//** only (no control flow even with -ftrapping-math). Both are within 1 ulp.
+inline uint64_t doubleBits_(double a){ uint64_t u; std::memcpy(&u, &a, sizeof(u)); return u; }
+inline double bitsDouble_(uint64_t u){ double a; std::memcpy(&a, &u, sizeof(a)); return a; }
+inline double selectDouble_(bool c, double a, double b){
+    uint64_t m = uint64_t(0) - uint64_t(c);
+    return bitsDouble_((doubleBits_(a) & m) | (doubleBits_(b) & ~m));
+}
+//! 2^k for integral k in [-1022, 1023], k + 1.5*2^52 holds k in the low bits.
+inline double pow2Int_(double k){
+    const double shift = 6755399441055744.0;
+    return bitsDouble_((doubleBits_(k + shift) - doubleBits_(shift) + 1023) << 52);
+}
+
+/*! Vectorizable exp(a). Cody-Waite reduction a = k ln2 + r and the
+ * rational remez kernel from fdlibm. */
+inline double simdExp(double a){
+    const double shift = 6755399441055744.0;
+    const double ln2Hi = 6.93147180369123816490e-01;
+    const double ln2Lo = 1.90821492927058770002e-10;
+    double x = selectDouble_(a < -746.0, -746.0, selectDouble_(a > 710.0, 710.0, a));
+    double k = (x * 1.44269504088896338700e+00 + shift) - shift;
+    double hi = x - k * ln2Hi;
+    double lo = k * ln2Lo;
+    double r = hi - lo;
+    double t = r * r;
+    double c = r - t * (1.66666666666666019037e-01 + t * (-2.77777777770155933842e-03 +
+                   t * (6.61375632143793436117e-05 + t * (-1.65339022054652515390e-06 +
+                   t * 4.13813679705723846039e-08))));
+    double y = 1.0 - ((lo - (r * c) / (2.0 - c)) - hi);
+    // split 2^k to reach the subnormal and the overflow range
+    double k1 = (k * 0.5 + shift) - shift;
+    y = y * pow2Int_(k1) * pow2Int_(k - k1);
+    return selectDouble_(a != a, a, y);
+}
+
+/*! Vectorizable log(a). a = 2^k m with m in [sqrt(2)/2, sqrt(2)) and the
+ * log1p kernel from fdlibm. */
+inline double simdLog(double a){
+    const double shift = 6755399441055744.0;
+    const double ln2Hi = 6.93147180369123816490e-01;
+    const double ln2Lo = 1.90821492927058770002e-10;
+    bool sub = a < 2.2250738585072014e-308;
+    uint64_t u = doubleBits_(a * selectDouble_(sub, 18014398509481984.0, 1.0));
+    double m = bitsDouble_((u & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL);
+    bool big = m > 1.41421356237309504880;
+    m = m * selectDouble_(big, 0.5, 1.0);
+    double k = (bitsDouble_(doubleBits_(shift) + (u >> 52)) - shift)
+                - selectDouble_(sub, 1077.0, 1023.0) + selectDouble_(big, 1.0, 0.0);
+    double f = m - 1.0;
+    double s = f / (2.0 + f);
+    double z = s * s;
+    double R = z * (6.666666666666735130e-01 + z * (3.999999999940941908e-01 +
+               z * (2.857142874366239149e-01 + z * (2.222219843214978396e-01 +
+               z * (1.818357216161805012e-01 + z * (1.531383769920937332e-01 +
+               z * 1.479819860511658591e-01))))));
+    double hfsq = 0.5 * f * f;
+    double y = k * ln2Hi - ((hfsq - (s * (hfsq + R) + k * ln2Lo)) - f);
+    y = selectDouble_(a == 0.0, -HUGE_VAL, y);
+    y = selectDouble_(!(a >= 0.0), NAN, y);
+    return selectDouble_(a == HUGE_VAL, a, y);
+}
+
 
 // template < class T > inline T square(const T & a) { return a * a; }
 // template < class T > inline T cot(const T & a) { return 1.0 / std::tan(a); }
@@ -186,9 +252,7 @@ DEFINE_UNARY_OPERATOR__(COT , cot)
 DEFINE_UNARY_OPERATOR__(TAN , std::tan)
 DEFINE_UNARY_OPERATOR__(ATAN, std::atan)
 DEFINE_UNARY_OPERATOR__(TANH, std::tanh)
-DEFINE_UNARY_OPERATOR__(LOG , std::log)
 DEFINE_UNARY_OPERATOR__(LOG10, std::log10)
-DEFINE_UNARY_OPERATOR__(EXP , std::exp)
 DEFINE_UNARY_OPERATOR__(EXP10, exp10)
 DEFINE_UNARY_OPERATOR__(SQRT, std::sqrt)
 DEFINE_UNARY_OPERATOR__(SIGN, sign)
@@ -196,6 +260,15 @@ DEFINE_UNARY_OPERATOR__(SQR,  square)
 
 #undef DEFINE_UNARY_OPERATOR__
 
+struct LOG {
+    template < class T > T operator()(const T & a) const { return std::log(a); }
+    double operator()(const double & a) const { return simdLog(a); }
+};
+struct EXP {
+    template < class T > T operator()(const T & a) const { return std::exp(a); }
+    double operator()(const double & a) const { return simdExp(a); }
+};
+
 #define DEFINE_UNARY_IF_FUNCTION__(OP, FUNCT) \
 struct OP { template < class T > bool operator()(const T & a) const { return FUNCT(a); } }; \
 
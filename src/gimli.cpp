@@ -38,6 +38,7 @@ namespace GIMLI{
 static bool __SAVE_PYTHON_GIL__ = false;
 static bool __GIMLI_DEBUG__ = false;
 static Index __GIMLI_THREADCOUNT__ = numberOfCPU();
+static thread_local Index __GIMLI_LOCAL_THREADCOUNT__ = 0;
 
 // //** end forward declaration
 // // static here gives every .cpp its own static bool
@@ -59,9 +60,20 @@ void setThreadCount(Index nThreads){
 }
 
 Index threadCount(){
+    if (__GIMLI_LOCAL_THREADCOUNT__ > 0){
+        return std::min(__GIMLI_LOCAL_THREADCOUNT__, __GIMLI_THREADCOUNT__);
+    }
     return __GIMLI_THREADCOUNT__;
 }
 
+void setLocalThreadCount(Index nThreads){
+    __GIMLI_LOCAL_THREADCOUNT__ = nThreads;
+}
+
+Index localThreadCount(){
+    return __GIMLI_LOCAL_THREADCOUNT__;
+}
+
 
 void PythonGILSave::save() {
     if (!saved_) {
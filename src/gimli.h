@@ -290,8 +290,28 @@ DLLEXPORT bool debug();
 /*! Set maximum amount of threads used by thirdparty software (e.g. openblas).
 Default is number of CPU. */
 DLLEXPORT void setThreadCount(Index nThreads);
+
+/*! Return the maximum amount of threads, limited by \ref setLocalThreadCount
+for the calling thread. */
 DLLEXPORT Index threadCount();
 
+/*! Limit \ref threadCount() for the calling thread only, e.g., for the
+products of tasks that run on threads already. 0 removes the limit.
+Thirdparty software (e.g. openblas) is not affected. */
+DLLEXPORT void setLocalThreadCount(Index nThreads);
+DLLEXPORT Index localThreadCount();
+
+/*! Set \ref setLocalThreadCount for the lifetime of this object. */
+class DLLEXPORT LocalThreadCount {
+public:
+    LocalThreadCount(Index nThreads) : old_(localThreadCount()) {
+        setLocalThreadCount(nThreads);
+    }
+    ~LocalThreadCount() { setLocalThreadCount(old_); }
+protected:
+    Index old_;
+};
+
 /*! For some debug purposes only */
 DLLEXPORT void showSizes();
 
@@ -21,6 +21,7 @@
 #define _GIMLI_INVERSION__H
 
 #include "vector.h"
+#include "calculateMultiThread.h"
 #include "inversionBase.h"
 #include "mesh.h"
 #include "modellingbase.h"
@@ -33,6 +34,11 @@
 #include "vector.h"
 
 #include "ipcClient.h"
+#include "asyncWriter.h"
+#include "memwatch.h"
+
+#include <fstream>
+#include <typeinfo>
 
 namespace GIMLI{
 
@@ -69,6 +75,94 @@ template < class Vec > Vec getIRLSWeightsP(const Vec & a, int p, double locut =
     return tmp;
 }
 
+/*! Forward responses for a set of line search models, distributed over
+ * threads. Needs a read only \ref ModellingBase::response_mt. */
+class LineSearchMT : public BaseCalcMT {
+public:
+    LineSearchMT(const ModellingBase & fop,
+                 const std::vector < RVector > & models,
+                 std::vector < RVector > & responses,
+                 std::vector < std::string > & errors)
+    : BaseCalcMT(), fop_(&fop), models_(&models), responses_(&responses),
+      errors_(&errors){
+    }
+
+    virtual ~LineSearchMT(){}
+
+    virtual void calc(Index tNr=0){
+        Index end = std::min(end_, Index(models_->size()));
+        for (Index i = start_; i < end; i ++){
+            try{
+                (*responses_)[i] = fop_->response_mt((*models_)[i], tNr);
+            } catch(std::exception & e){
+                (*errors_)[i] = e.what();
+            }
+        }
+    }
+
+protected:
+    const ModellingBase             * fop_;
+    const std::vector < RVector >   * models_;
+    std::vector < RVector >         * responses_;
+    std::vector < std::string >     * errors_;
+};
+
+/*! Timings in s, solver statistics and misfit of one inversion iteration.
+ * See \ref Inversion::setStatisticsFile. */
+struct IterationStatistics{
+    IterationStatistics(){ clear(); }
+
+    void clear(){
+        iter = 0;
+        timeJacobian = 0.0; timeSolve = 0.0; timeResponse = 0.0;
+        timeLineSearch = 0.0; timeTotal = 0.0;
+        solver = "cgls"; solverIter = 0; solverResidual = 0.0;
+        memoryPeak = 0.0;
+        chi2 = 0.0; phiD = 0.0; phiM = 0.0; lambda = 0.0; tau = 0.0;
+    }
+
+    /*! Return this record as single line JSON object. */
+    std::string toJSON() const {
+        std::stringstream str;
+        str.precision(10);
+        str << "{\"iter\": " << iter
+            << ", \"timeJacobian\": " << timeJacobian
+            << ", \"timeSolve\": " << timeSolve
+            << ", \"timeResponse\": " << timeResponse
+            << ", \"timeLineSearch\": " << timeLineSearch
+            << ", \"timeTotal\": " << timeTotal
+            << ", \"solver\": \"" << solver << "\""
+            << ", \"solverIter\": " << solverIter
+            << ", \"solverResidual\": " << solverResidual
+            << ", \"memoryPeak\": " << memoryPeak
+            << ", \"chi2\": " << chi2
+            << ", \"phiD\": " << phiD
+            << ", \"phiM\": " << phiM
+            << ", \"lambda\": " << lambda
+            << ", \"tau\": " << tau << "}";
+        return str.str();
+    }
+
+    int iter;
+    double timeJacobian;
+    double timeSolve;
+    double timeResponse;
+    double timeLineSearch;
+    double timeTotal;
+    /*! cgls, dataspace or lcurve */
+    std::string solver;
+    Index solverIter;
+    /*! Final squared residual norm of the CGLS solver */
+    double solverResidual;
+    /*! Peak resident memory in MByte */
+    double memoryPeak;
+    double chi2;
+    double phiD;
+    double phiM;
+    double lambda;
+    double tau;
+};
+
 /*! Inversion template using a Generalized Minimization Approach, atm fixed to Gauss-Newton solver
     Inversion(bool verbose, bool dosave
     Inversion(RVector data, FOP f, bool verbose, bool dosave
@@ -166,10 +260,15 @@ protected:
         isRobust_           = false;
         isBlocky_           = false;
         useLinesearch_      = true;
+        nLineSearchSteps_   = 0;
+        dataSpace_          = false;
         optimizeLambda_     = false;
         recalcJacobian_     = true;
         jacobiNeedRecalc_   = true;
         doBroydenUpdate_    = false;
+        broydenRecalcInterval_ = 0;
+        checkpointJacobian_ = false;
+        resume_             = false;
         localRegularization_= false;
         abort_              = false;
         stopAtChi1_         = true;
@@ -328,10 +427,45 @@ public:
     /*! Set and get verbose behaviour */
     inline void saveModelHistory(bool doSaveModelHistory){ saveModelHistory_ = doSaveModelHistory; }
 
+    /*! Append a \ref IterationStatistics record in JSON format, one line
+     * per iteration, to filename. The file is truncated here.
+     * An empty filename (default) disables it. */
+    void setStatisticsFile(const std::string & filename){
+        if (statisticsFile_.is_open()) statisticsFile_.close();
+        if (filename.empty()) return;
+        statisticsFile_.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        if (!statisticsFile_.good()){
+            std::cerr << WHERE_AM_I << " Warning unable to open " << filename << std::endl;
+        }
+    }
+
+    /*! Return the statistics of the last iteration */
+    inline const IterationStatistics & iterationStatistics() const { return stats_; }
+
+    /*! Write the debug and model history output of the iterations in a
+     * background thread (default) or directly. \ref run waits for all
+     * pending output before it returns. */
+    inline void setAsyncSave(bool async){ writer_.setActive(async); }
+    inline bool asyncSave() const { return writer_.active(); }
+
+    /*! Solve the Gauss-Newton step in data space (Occam type, see
+     * \ref solveDataSpaceCDWWhtrans) instead of the model space CGLS.
+     * This pays off for nData << nModel and needs a RMatrix Jacobian
+     * and RSparseMapMatrix constraints, else CGLS is used. */
+    inline void setDataSpaceSolver(bool dataSpace) { dataSpace_ = dataSpace; }
+    inline bool dataSpaceSolver() const { return dataSpace_; }
+
     /*! Set and get line search */
     inline void setLineSearch(bool linesearch) { useLinesearch_ = linesearch; }
     inline bool lineSearch() const { return useLinesearch_; }
 
+    /*! Evaluate the step lengths tau = k / nSteps (k = 1 .. nSteps) of the
+     * line search concurrently with the forward operators
+     * \ref ModellingBase::response_mt and choose the best one.
+     * 0 or 1 (default) uses the serial line search. */
+    inline void setLineSearchParallel(Index nSteps) { nLineSearchSteps_ = nSteps; }
+    inline Index lineSearchParallel() const { return nLineSearchSteps_; }
+
     /*! Set and get blocky model behaviour (by L1 reweighting of constraints) */
     inline void setBlockyModel(bool isBlocky) { isBlocky_ = isBlocky; }
     inline bool blockyModel() const { return isBlocky_; }
@@ -455,7 +589,8 @@ public:
         }
         Stopwatch swatch(true);
         if (verbose_) std::cout << "calculating jacobian matrix ...";
-        forward_->createJacobian(model_);
+        createJacobian_();
+        jacobiNeedRecalc_ = false;
         if (verbose_) std::cout << "... " << swatch.duration(true) << " s" << std::endl;
     }
 
@@ -466,18 +601,22 @@ public:
     }
     bool recalcJacobian() const { return recalcJacobian_; }
 
-    /*! Enable/disable broyden update (which enforces scaling by transform function derivatives */
+    /*! Enable/disable Broyden update. Instead of recalculating the Jacobian
+     * in each iteration it is corrected by a rank-1 update fulfilling the
+     * secant condition J * dm = response(m + dm) - response(m).
+     * Works in place for RMatrix and RSparseMapMatrix Jacobians, the latter
+     * keeps its sparsity pattern (Schubert update). */
     void setBroydenUpdate(bool broydenUpdate){
         doBroydenUpdate_ = broydenUpdate;
         if (doBroydenUpdate_) recalcJacobian_ = false;
-        //** puts transformation functions into jacobian since it is not changed anymore;
-        if (broydenUpdate) {
-            THROW_TO_IMPL
-            //scaleMatrix(*J_, tD_->deriv(response_), Vec(1.0 / tM_->deriv(model_)));
-        }
     }
     inline bool broydenUpdate() const { return doBroydenUpdate_; }
 
+    /*! Recalculate the full Jacobian every n iterations while Broyden
+     * updates are active. 0 (default) means never. */
+    inline void setBroydenRecalcInterval(int n){ broydenRecalcInterval_ = n; }
+    inline int broydenRecalcInterval() const { return broydenRecalcInterval_; }
+
     /*! Set model vector .
      * If you call \ref run() the inversion starts with this model,
      * otherwise it will start with fop.startModel(). */
@@ -725,8 +864,8 @@ public:
                 minTau = tau;
             }
         }
-        DOSAVE save(phiVector,  "linesearchPhi");
-        DOSAVE save(phiDVector, "linesearchPhiD");
+        DOSAVE writer_.save(phiVector,  "linesearchPhi");
+        DOSAVE writer_.save(phiDVector, "linesearchPhiD");
 
         tau = minTau;
 
@@ -736,7 +875,7 @@ public:
             if (verbose_) std::cout << "tau = " << tau
                             << ". Trying parabolic line search with step length " << tauquad;
             RVector modelQuad(tM_->update(model_, dModel * tauquad));
-            RVector responseQuad (forward_->response(modelQuad));
+            RVector responseQuad (forward_->cachedResponse(modelQuad));
             tau = linesearchQuad(modelNew, responseNew, modelQuad, responseQuad, tauquad);
             if (verbose_) std::cout << " ==> tau = " << tau;
             if (tau > 1.0) { //! too large
@@ -760,6 +899,115 @@ public:
         return tau;
     }
 
+    /*! Line search with true forward responses for tau = k / nSteps,
+     * calculated concurrently (see \ref setLineSearchParallel).
+     * The current model is the candidate tau = 0. A parabola through the
+     * best grid point and its neighbours gives one more, refined candidate.
+     * If no candidate decreases the objective function, a small step of
+     * tau = 0.03 is used like in \ref linesearch.
+     * modelNew need to be the full step and is, together with responseNew,
+     * replaced by the model and response of the best step length. */
+    double linesearchParallel(Vec & modelNew, Vec & responseNew) const {
+        Index nSteps = max(Index(2), nLineSearchSteps_);
+        Vec dModel(tM_->trans(modelNew) - tM_->trans(model_));
+
+        //** grid candidates tau = k / nSteps, k = 1 .. nSteps
+        std::vector < double > taus(nSteps + 1);
+        std::vector < RVector > models(nSteps);
+        for (Index k = 0; k <= nSteps; k ++) taus[k] = double(k) / nSteps;
+        for (Index k = 1; k <= nSteps; k ++){
+            models[k - 1] = (k == nSteps) ? modelNew : tM_->update(model_, dModel * taus[k]);
+        }
+        std::vector < RVector > responses(linesearchResponses_(models));
+
+        std::vector < double > phis(nSteps + 1);
+        phis[0] = linesearchPhi_(model_, response_);
+        Index best = 0;
+        for (Index k = 1; k <= nSteps; k ++){
+            phis[k] = linesearchPhi_(models[k - 1], responses[k - 1]);
+            if (verbose_) std::cout << "tau = " << taus[k] << " Phi = " << phis[k] << std::endl;
+            if (phis[k] < phis[best]) best = k;
+        }
+
+        //** refine with a parabola through the best grid point and its
+        //** neighbours, the fallback step is calculated together with it
+        Index c = std::min(std::max(best, Index(1)), nSteps - 1);
+        double h = 1.0 / nSteps;
+        double curv = phis[c - 1] - 2.0 * phis[c] + phis[c + 1];
+        std::vector < double > extraTaus;
+        if (curv > 0.0){
+            double tauOpt = taus[c] + 0.5 * h * (phis[c - 1] - phis[c + 1]) / curv;
+            tauOpt = std::min(std::max(tauOpt, taus[c - 1]), taus[c + 1]);
+            if (std::fabs(tauOpt - taus[best]) > 0.05 * h && tauOpt > 0.0 && tauOpt < 1.0){
+                extraTaus.push_back(tauOpt);
+            }
+        }
+        if (best == 0) extraTaus.push_back(0.03);
+
+        std::vector < RVector > extraModels(extraTaus.size());
+        for (Index i = 0; i < extraTaus.size(); i ++){
+            extraModels[i] = tM_->update(model_, dModel * extraTaus[i]);
+        }
+        std::vector < RVector > extraResponses(linesearchResponses_(extraModels));
+
+        double tau = taus[best];
+        double minPhi = phis[best];
+        if (best > 0){
+            modelNew = models[best - 1];
+            responseNew = responses[best - 1];
+        }
+        for (Index i = 0; i < extraTaus.size(); i ++){
+            double phi = linesearchPhi_(extraModels[i], extraResponses[i]);
+            if (verbose_) std::cout << "tau = " << extraTaus[i] << " Phi = " << phi << std::endl;
+            //** the last one is the fallback if nothing is better than tau = 0
+            if (phi < minPhi || (tau == 0.0 && i == extraTaus.size() - 1)){
+                minPhi = phi;
+                tau = extraTaus[i];
+                modelNew = extraModels[i];
+                responseNew = extraResponses[i];
+            }
+        }
+
+        if (verbose_) std::cout << "Linesearch (parallel) tau = " << tau << std::endl;
+        return tau;
+    }
+
+    /*! Create the Jacobian for the current model. A brute force Jacobian
+     * perturbs the model in the transformed model space of the inversion
+     * if a model transformation is set. */
+    void createJacobian_(){
+        Trans< RVector > * tM = forward_->jacobianTrans();
+        if (tM_ != transModelDefault_) forward_->setJacobianTrans(tM_);
+        try {
+            forward_->createJacobian(model_);
+        } catch (...) {
+            forward_->setJacobianTrans(tM);
+            throw;
+        }
+        forward_->setJacobianTrans(tM);
+    }
+
+    /*! Objective function value for the line search. */
+    double linesearchPhi_(const Vec & model, const Vec & response) const {
+        return localRegularization_ ? getPhiD(response) : getPhi(model, response);
+    }
+
+    /*! Responses for the line search models on up to \ref threadCount() threads. */
+    std::vector < RVector > linesearchResponses_(const std::vector < RVector > & models) const {
+        Index n = models.size();
+        std::vector < RVector > responses(n);
+        std::vector < std::string > errors(n);
+        if (n == 0) return responses;
+
+        distributeCalc(LineSearchMT(*forward_, models, responses, errors),
+                       n, min(n, threadCount()), verbose_);
+
+        for (Index k = 0; k < n; k ++){
+            if (errors[k].size()) throwError(1, WHERE_AM_I + " " + errors[k]);
+        }
+        return responses;
+    }
+
     /*! Compute objective function for old (tau=0), new (tau=1) and another model */
     double linesearchQuad(const Vec & modelNew, const Vec & responseNew,
                            const Vec & modelQuad, const Vec & responseQuad,
@@ -799,6 +1047,19 @@ public:
     /*! One iteration step. Return true if the step can be calculated successfully else false is returned. */
     bool oneStep();
 
+    /*! True if the products of A can be called from several threads, i.e.,
+     * A is one of the plain C++ matrix types. */
+    bool concurrentMult_(const MatrixBase * A) const {
+        return typeid(*A) == typeid(RMatrix) ||
+               typeid(*A) == typeid(RSparseMapMatrix) ||
+               typeid(*A) == typeid(RSparseMatrix);
+    }
+
+    /*! Broyden rank-1 update of the Jacobian for the model step dm
+     * that changed the response by dr. Return false if the Jacobian
+     * type is not supported and needs to be recalculated. */
+    bool broydenUpdate_(const Vec & dm, const Vec & dr);
+
     /*! Start the inversion with specific data.*/
     const Vec & invert(const Vec & data);
 
@@ -850,9 +1111,32 @@ public:
 
     /*! Resets this inversion to the given startmodel. */
     void reset(){
+        resume_ = false;
         this->setModel(forward_->startModel());
     }
 
+    /*! Write a checkpoint to filename after every iteration of \ref run.
+     * An empty filename (default) disables checkpointing.
+     * If withJacobian is set, a dense Jacobian is stored too. */
+    inline void setCheckpointFile(const std::string & filename, bool withJacobian=false){
+        checkpointFile_ = filename;
+        checkpointJacobian_ = withJacobian;
+    }
+    inline const std::string & checkpointFile() const { return checkpointFile_; }
+
+    /*! Save the current inversion state in binary format:
+     * iteration counter, lambda, model, response, (reweighted) data error,
+     * reference model, data/model/constraint weights and optional the (dense) Jacobian.
+     * Return false if the file cannot be written. */
+    bool saveCheckpoint(const std::string & filename, bool withJacobian=false) const;
+
+    /*! Load an inversion state written by \ref saveCheckpoint.
+     * The next call of \ref run continues with the stored iteration
+     * without recalculating the response and, if stored, the Jacobian.
+     * Data, errors, forward operator and transformations need to be set
+     * as for the interrupted run. Return false if the file cannot be read. */
+    bool loadCheckpoint(const std::string & filename);
+
 protected:
 
     Vec                   data_;
@@ -895,10 +1179,13 @@ protected:
     bool isRobust_;
     bool isRunning_;
     bool useLinesearch_;
+    Index nLineSearchSteps_;
+    bool dataSpace_;
     bool optimizeLambda_;
     bool abort_;
     bool stopAtChi1_;
     bool doBroydenUpdate_;
+    int broydenRecalcInterval_;
     bool localRegularization_;
     bool haveReferenceModel_;
     bool recalcJacobian_;
@@ -911,6 +1198,20 @@ protected:
     /*! Hold old models, for debuging */
     std::vector < RVector > modelHist_;
 
+    std::string checkpointFile_;
+    bool checkpointJacobian_;
+    /*! Continue the next run from a loaded checkpoint */
+    bool resume_;
+
+    IterationStatistics stats_;
+    std::ofstream statisticsFile_;
+
+    /*! Background writer for the DOSAVE and model history output */
+    mutable AsyncWriter writer_;
+
+    /*! Scratch vectors of the CGLS solver, reused for all iterations */
+    CGLSWorkspace< Vec > cglsWorkspace_;
+
     IPCClientSHM ipc_;
 };
 
@@ -947,8 +1248,18 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
     //** check if transfunctions are valid
     this->checkTransFunctions();
 
+    //! continue from a loaded checkpoint
+    bool resume = resume_;
+    resume_ = false;
+    if (resume && response_.size() != data_.size()){
+        std::cerr << WHERE_AM_I << " Warning checkpoint response has the wrong size, "
+                  << "restart from iteration 0." << std::endl;
+        resume = false;
+    }
+    Vec dataWeight0(dataWeight_), modelWeight0(modelWeight_), constraintsWeight0(constraintsWeight_);
+
     //! calculation of initial modelresponse
-    response_ = forward_->response(model_);
+    if (!resume) response_ = forward_->cachedResponse(model_);
     //response_ = forward_->response(forward_->startModel());
 
     //! () clear the model history
@@ -988,6 +1299,13 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
         constraintsH_.resize(cc);
     }
 
+    //! restore the (maybe reweighted) weights of the checkpoint
+    if (resume){
+        if (dataWeight0.size() == dataWeight_.size()) dataWeight_ = dataWeight0;
+        if (modelWeight0.size() == modelWeight_.size()) modelWeight_ = modelWeight0;
+        if (constraintsWeight0.size() == constraintsWeight_.size()) constraintsWeight_ = constraintsWeight0;
+    }
+
     if (haveReferenceModel_) {
         constraintsH_ = (*forward_->constraints() * Vec(tM_->trans(modelRef_) * modelWeight_)) * constraintsWeight_; //!!!template
         size_t ircc = forward_->regionManager().interRegionConstraintsCount();
@@ -995,17 +1313,18 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
     }
 
     //! validate and rebuild the jacobian if necessary
-    this->checkJacobian(jacobiNeedRecalc_);
+    //! (a resumed run with recalcJacobian recalculates it in the first step anyway)
+    if (!(resume && recalcJacobian_)) this->checkJacobian(jacobiNeedRecalc_);
 
     //** End preparation
 
-    if (saveModelHistory_) { save(model_    , "model_0"  ); }
-    DOSAVE save(response_ , "response_0");
-    DOSAVE save(modelRef_ , "modelRef_0");
-    DOSAVE save(RVector(response_ / data_ -1.0), "deltaData_0");
+    if (saveModelHistory_) { writer_.save(model_    , "model_0"  ); }
+    DOSAVE writer_.save(response_ , "response_0");
+    DOSAVE writer_.save(modelRef_ , "modelRef_0");
+    DOSAVE writer_.save(RVector(response_ / data_ -1.0), "deltaData_0");
     DOSAVE forward_->constraints()->save("constraint.matrix");
-    DOSAVE save(constraintsWeight_, "cweight_0");
-    DOSAVE save(modelWeight_, "mweight_0");
+    DOSAVE writer_.save(constraintsWeight_, "cweight_0");
+    DOSAVE writer_.save(modelWeight_, "mweight_0");
     DOSAVE save(*forward_->jacobian(), "sens.bmat");
 
     DOSAVE std::cout << "C size: " << forward_->constraints()->cols()
@@ -1032,8 +1351,12 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
     }
 
     //** Start iteration
-    iter_ = 0;
-    double oldphi = phiD;
+    if (resume) {
+        if (verbose_) std::cout << "Resume from checkpoint at iteration " << iter_ << std::endl;
+    } else {
+        iter_ = 0;
+    }
+    double oldphi = resume ? getPhi() : phiD;
 
     //** store initial model
     modelHist_.push_back(model_);
@@ -1048,7 +1371,7 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
         if (!oneStep()) break;
         //** no idea why this should be saved
         //DOSAVE save(*forward_->jacobian() * model_, "dataJac_"  + toStr(iter_) PLUS_TMP_VECSUFFIX);
-        DOSAVE save(response_,    "response_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
+        DOSAVE writer_.save(response_,    "response_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
 
         modelHist_.push_back(model_);
 
@@ -1072,16 +1395,181 @@ const Vector < ModelValType > & Inversion< ModelValType >::run(){ ALLOW_PYTHON_T
         if (isBlocky_) constrainBlocky();
         if (lambdaFactor_ > 0.0) max(lambdaMin_, lambda_ *= lambdaFactor_);
 
+        if (!checkpointFile_.empty()) saveCheckpoint(checkpointFile_, checkpointJacobian_);
+
     } //** while iteration;
+    writer_.flush();
     isRunning_ = false;
     ipc_.setBool("running", false);
     return model_;
 } //** run
 
+#define INVERSION_CHECKPOINT_MAGIC 0x544E50434D4C4947 // "GIMLCPNT"
+#define INVERSION_CHECKPOINT_VERSION 1
+
+template < class ValueType >
+bool writeCheckpointVector_(FILE * file, const Vector < ValueType > & v){
+    int64 size = v.size();
+    if (fwrite(&size, sizeof(int64), 1, file) != 1) return false;
+    if (size == 0) return true;
+    return fwrite(&v[0], sizeof(ValueType), size, file) == Index(size);
+}
+
+//! Remaining bytes of file behind the current position, -1 on failure.
+inline int64 checkpointBytesLeft_(FILE * file){
+    long pos = ftell(file);
+    if (pos < 0 || fseek(file, 0, SEEK_END) != 0) return -1;
+    long end = ftell(file);
+    if (end < pos || fseek(file, pos, SEEK_SET) != 0) return -1;
+    return int64(end - pos);
+}
+
+template < class ValueType >
+bool readCheckpointVector_(FILE * file, Vector < ValueType > & v){
+    int64 size = 0;
+    if (fread(&size, sizeof(int64), 1, file) != 1 || size < 0) return false;
+    //** do not trust the size before allocating
+    if (size > checkpointBytesLeft_(file) / int64(sizeof(ValueType))) return false;
+    v.resize(size);
+    if (size == 0) return true;
+    return fread(&v[0], sizeof(ValueType), size, file) == Index(size);
+}
+
+template < class ModelValType >
+bool Inversion< ModelValType >::saveCheckpoint(const std::string & filename,
+                                               bool withJacobian) const {
+    //** write to a temporary file first, so an interrupt while writing
+    //** does not destroy the last valid checkpoint
+    std::string tmpName(filename + ".tmp");
+    FILE * file; file = fopen(tmpName.c_str(), "w+b");
+    if (!file) {
+        std::cerr << WHERE_AM_I << " " << tmpName << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    const RMatrix * J = NULL;
+    if (withJacobian && forward_) {
+        J = dynamic_cast< const RMatrix * >(forward_->jacobian());
+        if (!J) std::cerr << WHERE_AM_I << " Warning only dense Jacobians can be stored." << std::endl;
+    }
+
+    uint64 magic = INVERSION_CHECKPOINT_MAGIC;
+    int32 version = INVERSION_CHECKPOINT_VERSION;
+    int32 iter = iter_;
+    int32 haveJacobian = (J != NULL);
+    bool ok = fwrite(&magic, sizeof(uint64), 1, file) == 1 &&
+              fwrite(&version, sizeof(int32), 1, file) == 1 &&
+              fwrite(&iter, sizeof(int32), 1, file) == 1 &&
+              fwrite(&lambda_, sizeof(double), 1, file) == 1 &&
+              writeCheckpointVector_(file, model_) &&
+              writeCheckpointVector_(file, response_) &&
+              writeCheckpointVector_(file, error_) &&
+              writeCheckpointVector_(file, haveReferenceModel_ ? modelRef_ : Vec()) &&
+              writeCheckpointVector_(file, dataWeight_) &&
+              writeCheckpointVector_(file, modelWeight_) &&
+              writeCheckpointVector_(file, constraintsWeight_) &&
+              fwrite(&haveJacobian, sizeof(int32), 1, file) == 1;
+
+    if (ok && J) {
+        int64 rows = J->rows(), cols = J->cols();
+        ok = fwrite(&rows, sizeof(int64), 1, file) == 1 &&
+             fwrite(&cols, sizeof(int64), 1, file) == 1;
+        for (Index i = 0; ok && i < J->rows(); i ++){
+            ok = fwrite(&(*J)[i][0], sizeof(double), cols, file) == Index(cols);
+        }
+    }
+    fclose(file);
+
+    if (!ok || rename(tmpName.c_str(), filename.c_str()) != 0) {
+        std::cerr << WHERE_AM_I << " Warning unable to write checkpoint " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template < class ModelValType >
+bool Inversion< ModelValType >::loadCheckpoint(const std::string & filename){
+    FILE * file; file = fopen(filename.c_str(), "r+b");
+    if (!file) {
+        std::cerr << WHERE_AM_I << " " << filename << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    uint64 magic = 0;
+    int32 version = 0, iter = 0, haveJacobian = 0;
+    double lambda = 0.0;
+    bool ok = fread(&magic, sizeof(uint64), 1, file) == 1 &&
+              magic == INVERSION_CHECKPOINT_MAGIC &&
+              fread(&version, sizeof(int32), 1, file) == 1 &&
+              version == INVERSION_CHECKPOINT_VERSION;
+    if (!ok) {
+        fclose(file);
+        std::cerr << WHERE_AM_I << " Warning " << filename << " is no valid checkpoint." << std::endl;
+        return false;
+    }
+
+    Vec model, response, error, modelRef, dataWeight, modelWeight, constraintsWeight;
+    ok = fread(&iter, sizeof(int32), 1, file) == 1 &&
+         fread(&lambda, sizeof(double), 1, file) == 1 &&
+         readCheckpointVector_(file, model) &&
+         readCheckpointVector_(file, response) &&
+         readCheckpointVector_(file, error) &&
+         readCheckpointVector_(file, modelRef) &&
+         readCheckpointVector_(file, dataWeight) &&
+         readCheckpointVector_(file, modelWeight) &&
+         readCheckpointVector_(file, constraintsWeight) &&
+         fread(&haveJacobian, sizeof(int32), 1, file) == 1;
+
+    RMatrix * J = NULL;
+    if (ok && haveJacobian) {
+        int64 rows = 0, cols = 0;
+        ok = fread(&rows, sizeof(int64), 1, file) == 1 &&
+             fread(&cols, sizeof(int64), 1, file) == 1 &&
+             rows == int64(response.size()) && cols == int64(model.size()) &&
+             (cols == 0 || rows <= checkpointBytesLeft_(file) / int64(cols * sizeof(double)));
+        if (ok && forward_) J = dynamic_cast< RMatrix * >(forward_->jacobian());
+        if (ok && J) {
+            J->resize(rows, cols);
+            for (Index i = 0; ok && i < Index(rows); i ++){
+                ok = fread(&(*J)[i][0], sizeof(double), cols, file) == Index(cols);
+            }
+        } else if (ok) {
+            std::cerr << WHERE_AM_I << " Warning forward operator has no dense Jacobian, "
+                      << "ignoring the stored one." << std::endl;
+        }
+    }
+    fclose(file);
+
+    if (!ok) {
+        std::cerr << WHERE_AM_I << " Warning " << filename << " is truncated or corrupt." << std::endl;
+        if (J) jacobiNeedRecalc_ = true;
+        return false;
+    }
+
+    iter_       = iter;
+    lambda_     = lambda;
+    model_      = model;
+    response_   = response;
+    if (error.size() > 0) error_ = error;
+    dataWeight_ = dataWeight;
+    modelWeight_ = modelWeight;
+    constraintsWeight_ = constraintsWeight;
+    if (modelRef.size() > 0) setReferenceModel(modelRef);
+    jacobiNeedRecalc_ = (J == NULL);
+    resume_     = true;
+    return true;
+}
+
 template < class Vec > bool Inversion< Vec>::oneStep() {
     iter_++;
     ipc_.setInt("Iter", iter_);
 
+    Stopwatch swatchTotal(true);
+    Stopwatch swatch(true);
+    stats_.clear();
+    stats_.iter = iter_;
+    stats_.lambda = lambda_;
+
     deltaModelIter_.resize(model_.size());
     deltaModelIter_ *= 0.0;
     deltaDataIter_ = (tD_->trans(data_) - tD_->trans(response_));
@@ -1095,11 +1583,16 @@ template < class Vec > bool Inversion< Vec>::oneStep() {
     Vec responseNew( data_.size());
     Vec roughness(constraintsH_.size(), 0.0);
 
-    if ((recalcJacobian_ && iter_ > 1) || jacobiNeedRecalc_ ) {
-        Stopwatch swatch(true);
+    bool broydenRecalc = doBroydenUpdate_ && broydenRecalcInterval_ > 0 &&
+                         iter_ > 1 && (iter_ - 1) % broydenRecalcInterval_ == 0;
+
+    if ((recalcJacobian_ && iter_ > 1) || jacobiNeedRecalc_ || broydenRecalc) {
+        swatch.restart();
         if (verbose_) std::cout << "recalculating jacobian matrix ...";
-        forward_->createJacobian(model_);
-        if (verbose_) std::cout << swatch.duration(true) << " s" << std::endl;
+        createJacobian_();
+        jacobiNeedRecalc_ = false;
+        stats_.timeJacobian = swatch.duration(true);
+        if (verbose_) std::cout << stats_.timeJacobian << " s" << std::endl;
     }
 
     if (!localRegularization_) {
@@ -1121,9 +1614,13 @@ template < class Vec > bool Inversion< Vec>::oneStep() {
         /////////////*********************
         // fix this!!!!!!!!!!!!!1 constraintsH != deltaModel0
         /////////////*********************
+        swatch.restart();
         deltaModelIter_ = optLambda(deltaDataIter_, constraintsH_);
+        stats_.timeSolve = swatch.duration(true);
+        stats_.solver = "lcurve";
+        stats_.lambda = lambda_;
     } else {
-        DOSAVE save(deltaDataIter_, "dd_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
+        DOSAVE writer_.save(deltaDataIter_, "dd_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
         DOSAVE echoMinMax(data_,      "data");
         DOSAVE echoMinMax(dataWeight_,  "dW");
         DOSAVE echoMinMax(deltaDataIter_,  "dd");
@@ -1135,16 +1632,11 @@ template < class Vec > bool Inversion< Vec>::oneStep() {
         DOSAVE echoMinMax(response_, "resp");
 //        DOSAVE echoMinMax(deltaModel0, "dM0");
         DOSAVE echoMinMax(constraintsH_, "constraintsH");
-        DOSAVE save(constraintsH_, "constraintsH");
-        DOSAVE save(tM_->deriv(model_), "modelTrans");
-        DOSAVE save(tD_->deriv(response_), "responseTrans");
-
-        if (doBroydenUpdate_) { //!!! h-variante
-           if (verbose_) std::cout << "solve CGLSCDWW with lambda = " << lambda_ << std::endl;
-                THROW_TO_IMPL
-//                solveCGLSCDWW(*J_, forward_->constraints(), dataWeight_, deltaDataIter_, deltaModelIter_, constraintsWeight_,
-//                                modelWeight_, lambda_, deltaModel0, maxCGLSIter_, dosave_);
-        } else {
+        DOSAVE writer_.save(constraintsH_, "constraintsH");
+        DOSAVE writer_.save(tM_->deriv(model_), "modelTrans");
+        DOSAVE writer_.save(tD_->deriv(response_), "responseTrans");
+
+        {
             if (verbose_) std::cout << "solve CGLSCDWWtrans with lambda = " << lambda_ << std::endl;
 //             solveCGLSCDWWtrans(*J_, forward_->constraints(), dataWeight_, deltaDataIter_, deltaModelIter_, constraintsWeight_,
 //                                  modelWeight_, tM_->deriv(model_), tD_->deriv(response_),
@@ -1158,71 +1650,154 @@ template < class Vec > bool Inversion< Vec>::oneStep() {
 //             solveCGLSCDWWhtransWB(scaledJacobian, weightedConstraints, dataWeight_, deltaDataIter_, deltaModelIter_,
 //                                    lambda_, roughness, maxCGLSIter_, verbose_);
 
-            solveCGLSCDWWhtrans(*forward_->jacobian(), *forward_->constraints(),
-                                dataWeight_, deltaDataIter_, deltaModelIter_,
-                                constraintsWeight_, modelWeight_,
-                                tM_->deriv(model_), tD_->deriv(response_),
-                                lambda_, roughness, maxCGLSIter_, CGLStol_,
-                                dosave_);
-        } // else no broyden
+            RMatrix * J = dynamic_cast< RMatrix * >(forward_->jacobian());
+            RSparseMapMatrix * C = dynamic_cast< RSparseMapMatrix * >(forward_->constraints());
+
+            swatch.restart();
+
+            if (dataSpace_ && J && C && data_.size() < model_.size() &&
+                solveDataSpaceCDWWhtrans(*J, *C, dataWeight_, deltaDataIter_,
+                                         deltaModelIter_, constraintsWeight_,
+                                         modelWeight_, tM_->deriv(model_),
+                                         tD_->deriv(response_), lambda_,
+                                         roughness, 1e-6, verbose_)){
+                if (verbose_) std::cout << "solved data space system with lambda = " << lambda_ << std::endl;
+                stats_.solver = "dataspace";
+            } else {
+                if (dataSpace_ && verbose_) std::cout << "data space solver not applicable, use CGLS" << std::endl;
+                solveCGLSCDWWhtrans(*forward_->jacobian(), *forward_->constraints(),
+                                    dataWeight_, deltaDataIter_, deltaModelIter_,
+                                    constraintsWeight_, modelWeight_,
+                                    tM_->deriv(model_), tD_->deriv(response_),
+                                    lambda_, roughness, cglsWorkspace_,
+                                    maxCGLSIter_, CGLStol_,
+                                    dosave_);
+                stats_.solverIter = cglsWorkspace_.iterations;
+                stats_.solverResidual = cglsWorkspace_.residual;
+            }
+            stats_.timeSolve = swatch.duration(true);
+        }
     } // else no optimization
 
     DOSAVE echoMinMax(deltaModelIter_, "dm");
 
     modelNew = tM_->update(model_, deltaModelIter_);
 
-    DOSAVE save(model_, "oldmodel");
-    DOSAVE save(deltaModelIter_, "deltaModel");
+    DOSAVE writer_.save(model_, "oldmodel");
+    DOSAVE writer_.save(deltaModelIter_, "deltaModel");
 
     if (dosave_) {
-        save(modelNew, "model_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
+        writer_.save(modelNew, "model_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
     } else {
-        if (saveModelHistory_) save(modelNew, "modelLS");
+        if (saveModelHistory_) writer_.save(modelNew, "modelLS");
     }
 
+    Vec modelLast(model_);
     Vec responseLast(response_);
-    responseNew = forward_->response(modelNew);
 
     double tau = 1.0;
-    if (useLinesearch_){
-        tau = linesearch(modelNew, responseNew);
-    }
-
-    if (tau >= 0.95){ //! full step possible;
+    swatch.restart();
+    if (useLinesearch_ && nLineSearchSteps_ > 1){
+        //** all candidates are true forward responses, no extra call needed
+        tau = linesearchParallel(modelNew, responseNew);
         response_ = responseNew;
-    } else { //! normal line search parameter between 0.03 and 0.94
-        modelNew = tM_->update(model_, deltaModelIter_ * tau);
-        response_ = forward_->response(modelNew);
+        stats_.timeLineSearch = swatch.duration(true);
+    } else {
+        responseNew = forward_->cachedResponse(modelNew);
+        stats_.timeResponse = swatch.duration(true);
+
+        if (useLinesearch_){
+            tau = linesearch(modelNew, responseNew);
+            stats_.timeLineSearch = swatch.duration(true);
+        }
+
+        if (tau >= 0.95){ //! full step possible;
+            response_ = responseNew;
+        } else { //! normal line search parameter between 0.03 and 0.94
+            modelNew = tM_->update(model_, deltaModelIter_ * tau);
+            response_ = forward_->cachedResponse(modelNew);
+            stats_.timeResponse += swatch.duration(true);
+        }
     }
+    stats_.tau = tau;
 
     model_ = modelNew;
-    if (saveModelHistory_) save(model_, "model_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
+    if (saveModelHistory_) writer_.save(model_, "model_" + toStr(iter_) PLUS_TMP_VECSUFFIX);
 
     if (verbose_) echoStatus();
 
-    ipc_.setDouble("Chi2", getPhiD() / data_.size());
+    stats_.phiD = getPhiD();
+    stats_.phiM = getPhiM();
+    stats_.chi2 = stats_.phiD / data_.size();
+    ipc_.setDouble("Chi2", stats_.chi2);
 
     if (doBroydenUpdate_) { //** perform Broyden update;
-    // did not yet reflect moving jacobian into modellingbase
-    THROW_TO_IMPL
-//         if (verbose_) std::cout << "perform Broyden update" << std::endl;
-//         Vec u(tD_->trans(response_) - tD_->trans(responseLast) - (*J_ * deltaModelIter_));
-//         Vec v(deltaModelIter_ / dot(deltaModelIter_, deltaModelIter_));
-//         rank1Update(*J_, u, v);
+        if (verbose_) std::cout << "perform Broyden update" << std::endl;
+        swatch.restart();
+        if (!broydenUpdate_(Vec(model_ - modelLast), Vec(response_ - responseLast))){
+            jacobiNeedRecalc_ = true;
+        }
+        stats_.timeJacobian += swatch.duration(true);
     }
 
     //!** temporary stuff
     if (forward_->mesh()){
 // this forces pygimli/generatecode.py to create a ugly log10 declaration, which overwrites the valid log10 declarion
 //        DOSAVE forward_->mesh()->addExportData("F-op-model(log10)", log10(forward_->mesh()->cellAttributes()));
-        DOSAVE forward_->mesh()->addExportData("F-op-model", forward_->mesh()->cellAttributes());
-        DOSAVE forward_->mesh()->exportVTK("fop-model" + toStr(iter_));
-        DOSAVE forward_->mesh()->clearExportData();
+        //** export a snapshot, the forward operator may change or delete its mesh before the job runs
+        DOSAVE {
+            std::shared_ptr< const Mesh > mesh(new Mesh(*forward_->mesh()));
+            std::map< std::string, RVector > data;
+            data["F-op-model"] = mesh->cellAttributes();
+            data["_Attribute"] = data["F-op-model"];
+            std::string name("fop-model" + toStr(iter_));
+            writer_.push([mesh, data, name](){ mesh->exportVTK(name, data); });
+        }
+    }
+
+    stats_.memoryPeak = memoryPeak();
+    stats_.timeTotal = swatchTotal.duration();
+    if (statisticsFile_.is_open()){
+        statisticsFile_ << stats_.toJSON() << std::endl;
     }
 
     return true;
 }
 
+template < class Vec > bool Inversion< Vec >::broydenUpdate_(const Vec & dm,
+                                                            const Vec & dr) {
+    double dm2 = dot(dm, dm);
+    if (dm2 < TOLERANCE * TOLERANCE) return true;
+
+    MatrixBase * J = forward_->jacobian();
+    //** u = dr - J * dm, zero if J already fulfills the secant condition
+    Vec u(dr - J->mult(dm));
+
+    if (RMatrix * D = dynamic_cast< RMatrix * >(J)){
+        rank1Update(*D, u, Vec(dm / dm2));
+        return true;
+    }
+
+    if (RSparseMapMatrix * S = dynamic_cast< RSparseMapMatrix * >(J)){
+        //** Schubert: each row i gets u_i * dm_j / |dm restricted to the pattern of row i|^2
+        Vec rowNorm(S->rows(), 0.0);
+        for (RSparseMapMatrix::const_iterator it = S->begin(); it != S->end(); it ++){
+            rowNorm[S->idx1(it)] += dm[S->idx2(it)] * dm[S->idx2(it)];
+        }
+        for (RSparseMapMatrix::iterator it = S->begin(); it != S->end(); it ++){
+            Index i = S->idx1(it);
+            if (rowNorm[i] > TOLERANCE * TOLERANCE){
+                S->val(it) += u[i] * dm[S->idx2(it)] / rowNorm[i];
+            }
+        }
+        return true;
+    }
+
+    std::cerr << WHERE_AM_I << " no Broyden update for Jacobian of type "
+              << J->rtti() << ". Recalculate it instead." << std::endl;
+    return false;
+}
+
 template < class ModelValType >
 Vector < ModelValType > Inversion< ModelValType >
     ::optLambda(const Vector < ModelValType > & deltaData,
@@ -1253,7 +1828,7 @@ ALLOW_PYTHON_THREADS
 
     DOSAVE echoMinMax(modelWeight_,  "mW");
     DOSAVE echoMinMax(constraintsH_, "constraintsH");
-    DOSAVE save(constraintsH_, "constraintsH");
+    DOSAVE writer_.save(constraintsH_, "constraintsH");
 
 //    solveCGLSCDWWtrans(*J_, forward_->constraints(), dataWeight_, deltaData, deltaModel, constraintsWeight_,
 //                        modelWeight_, tM_->deriv(model_), tD_->deriv(response_),
@@ -1262,10 +1837,11 @@ ALLOW_PYTHON_THREADS
                         dataWeight_, deltaDataIter_, deltaModel,
                         constraintsWeight_, modelWeight_,
                         tM_->deriv(model_), tD_->deriv(response_),
-                        lambda_, roughness, maxCGLSIter_, dosave_);
+                        lambda_, roughness, cglsWorkspace_,
+                        maxCGLSIter_, CGLStol_);
 
     Vec appModelStart(tM_->invTrans(tModel + deltaModel));
-    DOSAVE save(appModelStart, "appModel");
+    DOSAVE writer_.save(appModelStart, "appModel");
     double phiMNorm = (getPhiM(appModelStart));
     double phiDNorm = (getPhiD());
 
@@ -1277,53 +1853,72 @@ ALLOW_PYTHON_THREADS
     phiD.push_back(std::log(getPhiD())); phiDNorm = 1.0;
     if(verbose_) std::cout << "lambda(0) = inf" << " PhiD = " << phiD.back() << " PhiM = " << phiM.back()  << std::endl;
 
+    //** Consecutive lambdas are solved in batches concurrently, all of a batch
+    //** are warm started with the last solution. The L-curve is evaluated in
+    //** the original order so a batch size of 1 is the classic serial sweep.
+    Index nBatch = 1;
+    if (concurrentMult_(forward_->jacobian()) && concurrentMult_(forward_->constraints())){
+        nBatch = max(Index(1), threadCount());
+    }
+    std::vector < double > lambdas;
+    std::vector < Vec > dModels;
+    std::vector < CGLSWorkspace< Vec > > workspaces;
+
     int lambdaIter = 0;
-    while (lambdaIter < 30) {
-        lambdaIter++;
-        if(verbose_) std::cout << lambdaIter << "lambda = " << lambda_ << std::endl;
-//        solveCGLSCDWWtrans(*J_, forward_->constraints(), dataWeight_, deltaData, deltaModel, constraintsWeight_,
-//                          modelWeight_, tM_->deriv(model_), tD_->deriv(response_),
-//                          lambda_, deltaModel0, maxCGLSIter_, verbose_);
+    bool found = false;
+    while (lambdaIter < 30 && !found) {
+        Index n = min(nBatch, Index(30 - lambdaIter));
+        lambdas.resize(n);
+        lambdas[0] = lambda_;
+        for (Index k = 1; k < n; k ++) lambdas[k] = lambdas[k - 1] * 0.8;
+        dModels.assign(n, deltaModel);
+        workspaces.assign(n, cglsWorkspace_);
+        for (Index k = 0; k < n; k ++) workspaces[k].warmStart = true;
+
         solveCGLSCDWWhtrans(*forward_->jacobian(), *forward_->constraints(),
-                            dataWeight_, deltaDataIter_, deltaModel,
+                            dataWeight_, deltaDataIter_, dModels,
                             constraintsWeight_, modelWeight_,
                             tM_->deriv(model_), tD_->deriv(response_),
-                            lambda_, roughness, maxCGLSIter_, dosave_);
-
-        Vec appModel(tM_->invTrans(tModel + deltaModel));
-        Vec appResponse(tD_->invTrans(tResponse + *forward_->jacobian() * deltaModel));
-
-        if (lambdaIter == 1) { //* normalize on 1st iteration
-//      	 phiMNorm = getPhiM(appModel);
-//      	 phiDNorm = getPhiD(appResponse);
-        }
-
-        phiM.push_back(std::log(getPhiM(appModel)) / phiMNorm);
-        phiD.push_back(std::log(getPhiD(appResponse)) / phiDNorm);
-
-        if (lambdaIter > 1) {
-            ys = (phiD[ lambdaIter ] - phiD[ lambdaIter - 2 ]) / (phiM[ lambdaIter ] - phiM[ lambdaIter - 2 ]);
-            yss = ((phiD[ lambdaIter ] - phiD[ lambdaIter - 1 ]) / (phiM[ lambdaIter ] - phiM[ lambdaIter - 1]) -
-              (phiD[ lambdaIter - 1 ] - phiD[ lambdaIter - 2 ]) / (phiM[ lambdaIter - 1 ] - phiM[ lambdaIter - 2 ])) /
-              (phiM[ lambdaIter ] - phiM[ lambdaIter - 2 ]) * 2.0;
-            curv = yss / std::pow(1 + ys * ys, 1.5);
-
-            if(verbose_) std::cout << " lambda(" << lambdaIter << ") = " << lambda_ << " PhiD = "
-                                     << phiD.back() << " PhiM = " << phiM.back() << " curv = " << curv << std::endl;
-            if ((curv < oldcurv) && (lambdaIter > 4)) {
-                deltaModel = uroldDModel;
-                lambda_ /= (0.8 * 0.8);
-                if (verbose_) std::cout << lambdaIter << ": lambdaIter -- " << "Curvature decreasing, choosing lambda = " << lambda_ << std::endl;
-                break;
+                            lambdas, roughness, workspaces,
+                            maxCGLSIter_, CGLStol_, n);
+
+        for (Index k = 0; k < n; k ++) {
+            lambdaIter++;
+            if(verbose_) std::cout << lambdaIter << "lambda = " << lambda_ << std::endl;
+            deltaModel = dModels[k];
+            std::swap(cglsWorkspace_, workspaces[k]);
+
+            Vec appModel(tM_->invTrans(tModel + deltaModel));
+            Vec appResponse(tD_->invTrans(tResponse + *forward_->jacobian() * deltaModel));
+
+            phiM.push_back(std::log(getPhiM(appModel)) / phiMNorm);
+            phiD.push_back(std::log(getPhiD(appResponse)) / phiDNorm);
+
+            if (lambdaIter > 1) {
+                ys = (phiD[ lambdaIter ] - phiD[ lambdaIter - 2 ]) / (phiM[ lambdaIter ] - phiM[ lambdaIter - 2 ]);
+                yss = ((phiD[ lambdaIter ] - phiD[ lambdaIter - 1 ]) / (phiM[ lambdaIter ] - phiM[ lambdaIter - 1]) -
+                  (phiD[ lambdaIter - 1 ] - phiD[ lambdaIter - 2 ]) / (phiM[ lambdaIter - 1 ] - phiM[ lambdaIter - 2 ])) /
+                  (phiM[ lambdaIter ] - phiM[ lambdaIter - 2 ]) * 2.0;
+                curv = yss / std::pow(1 + ys * ys, 1.5);
+
+                if(verbose_) std::cout << " lambda(" << lambdaIter << ") = " << lambda_ << " PhiD = "
+                                         << phiD.back() << " PhiM = " << phiM.back() << " curv = " << curv << std::endl;
+                if ((curv < oldcurv) && (lambdaIter > 4)) {
+                    deltaModel = uroldDModel;
+                    lambda_ /= (0.8 * 0.8);
+                    if (verbose_) std::cout << lambdaIter << ": lambdaIter -- " << "Curvature decreasing, choosing lambda = " << lambda_ << std::endl;
+                    found = true;
+                    break;
+                }
+            oldcurv = curv;
+            } else { //** lambdaIter > 1
+                if(verbose_) std::cout << "lambda(" << lambdaIter << ") = " << lambda_
+                                         << " PhiD = " << phiD.back() << " PhiM = " << phiM.back()  << std::endl;
             }
-        oldcurv = curv;
-        } else { //** lambdaIter > 1
-            if(verbose_) std::cout << "lambda(" << lambdaIter << ") = " << lambda_
-                                     << " PhiD = " << phiD.back() << " PhiM = " << phiM.back()  << std::endl;
-        }
-        uroldDModel = oldDModel;
-        oldDModel = deltaModel;
-        lambda_ *= 0.8;
+            uroldDModel = oldDModel;
+            oldDModel = deltaModel;
+            lambda_ *= 0.8;
+        } //** for batch
     }  //** while loop;
     DOSAVE save(phiM, "phiM");
     DOSAVE save(phiD, "phiD");
@@ -17,9 +17,14 @@
  ******************************************************************************/
 
 #include "linSolver.h"
+#include "matrix.h"
 #include "sparsematrix.h"
 #include "ldlWrapper.h"
 #include "cholmodWrapper.h"
+#include "pcgWrapper.h"
+#include "calculateMultiThread.h"
+
+#include <cmath>
 
 namespace GIMLI{
 
@@ -71,6 +76,7 @@ void LinSolver::init_(){
     cols_ = 0;
     solver_ = 0;
     cacheMatrix_ = 0;
+    stype_ = -2;
 }
 
 LinSolver::~LinSolver(){
@@ -84,6 +90,10 @@ LinSolver::~LinSolver(){
     }
 }
 
+bool LinSolver::threadSafeSolve() const {
+    return solver_ && solver_->threadSafeSolve();
+}
+
 void LinSolver::setSolverType(SolverType solverType){
    solverType_ = solverType;
    if (solverType_ == AUTOMATIC){
@@ -95,6 +105,9 @@ void LinSolver::setSolverType(SolverType solverType){
         if (CHOLMODWrapper::valid()){
             solverType_ = CHOLMOD;
         }
+        if (solverType_ == UNKNOWN && PCGWrapper::valid()){
+            solverType_ = PCG;
+        }
     }
 }
 
@@ -106,6 +119,23 @@ void LinSolver::setMatrix(CSparseMatrix & S, int stype){
     initialize_(S, stype);
 }
 
+template < class ValueType >
+void LinSolver::refactorise_(SparseMatrix < ValueType > & S, int stype){
+    if (solver_ && stype == stype_ &&
+        S.vecColPtr() == colPtr_ && S.vecRowIdx() == rowIdx_){
+        if (solver_->refactorise(S)) return;
+    }
+    setMatrix(S, stype);
+}
+
+void LinSolver::refactorise(RSparseMatrix & S, int stype){
+    refactorise_(S, stype);
+}
+
+void LinSolver::refactorise(CSparseMatrix & S, int stype){
+    refactorise_(S, stype);
+}
+
 // template <> void LinSolver::solve(const RVector & rhs, RVector & solution);
 // template <> void LinSolver::solve(const CVector & rhs, CVector & solution);
 // template <> RVector LinSolver::solve(const RVector & rhs);
@@ -139,14 +169,38 @@ CVector LinSolver::solve(const CVector & rhs){
     return solution;
 }
 
+void LinSolver::solve(const RMatrix & B, RMatrix & X){
+    X.resize(B.rows(), rows_);
+    if (B.rows() && B.cols() != cols_){
+        std::cerr << WHERE_AM_I << " rhs size mismatch: " << cols_ << "  " << B.cols() << std::endl;
+    }
+    if (solver_) solver_->solve(B, X);
+}
+
+void LinSolver::solve(const CMatrix & B, CMatrix & X){
+    X.resize(B.rows(), rows_);
+    if (B.rows() && B.cols() != cols_){
+        std::cerr << WHERE_AM_I << " rhs size mismatch: " << cols_ << "  " << B.cols() << std::endl;
+    }
+    if (solver_) solver_->solve(B, X);
+}
+
 void LinSolver::initialize_(RSparseMatrix & S, int stype){
     rows_ = S.rows();
     cols_ = S.cols();
+    colPtr_ = S.vecColPtr();
+    rowIdx_ = S.vecRowIdx();
+    stype_ = stype;
     setSolverType(solverType_);
+    if (solver_) {
+        delete solver_;
+        solver_ = 0;
+    }
 
     switch(solverType_){
         case LDL:     solver_ = new LDLWrapper(S, verbose_); break;
         case CHOLMOD: solver_ = new CHOLMODWrapper(S, verbose_, stype); break;
+        case PCG:     solver_ = new PCGWrapper(S, verbose_); break;
         case UNKNOWN:
     default:
             std::cerr << WHERE_AM_I << " no valid solver found"  << std::endl;
@@ -156,11 +210,19 @@ void LinSolver::initialize_(RSparseMatrix & S, int stype){
 void LinSolver::initialize_(CSparseMatrix & S, int stype){
     rows_ = S.rows();
     cols_ = S.cols();
+    colPtr_ = S.vecColPtr();
+    rowIdx_ = S.vecRowIdx();
+    stype_ = stype;
     setSolverType(solverType_);
+    if (solver_) {
+        delete solver_;
+        solver_ = 0;
+    }
 
     switch(solverType_){
         case LDL:     solver_ = new LDLWrapper(S, verbose_); break;
         case CHOLMOD: solver_ = new CHOLMODWrapper(S, verbose_, stype); break;
+        case PCG:     solver_ = new PCGWrapper(S, verbose_); break;
         case UNKNOWN:
     default:
             std::cerr << WHERE_AM_I << " no valid solver found"  << std::endl;
@@ -172,10 +234,121 @@ std::string LinSolver::solverName() const {
   switch(solverType_){
   case LDL:     return "LDL"; break;
   case CHOLMOD: return "CHOLMOD"; break;
+  case PCG:     return "PCG"; break;
   case UNKNOWN:
   default: return " no valid solver installed";
   }
 }
 
+//! rows processed together by the blocked Cholesky factorization
+static const Index __CHOLESKY_BLOCK__ = 128;
+
+inline double dotRow_(const double * a, const double * b, Index n){
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    Index k = 0;
+    for (; k + 4 <= n; k += 4){
+        s0 += a[k] * b[k]; s1 += a[k + 1] * b[k + 1];
+        s2 += a[k + 2] * b[k + 2]; s3 += a[k + 3] * b[k + 3];
+    }
+    for (; k < n; k ++) s0 += a[k] * b[k];
+    return (s0 + s1) + (s2 + s3);
+}
+
+/*! Panel solve (update=false) or trailing update (update=true) of one
+ * Cholesky block [k0, k1) for the rows [bounds[c], bounds[c + 1]) of the
+ * chunks c in [start_, end_). Every row is written by one thread, the
+ * update reads the panel rows of all threads so it needs a second pass. */
+class CholeskyBlockMT : public BaseCalcMT{
+public:
+    CholeskyBlockMT(RMatrix & A, Index k0, Index k1,
+                    const std::vector < Index > & bounds, bool update)
+    : BaseCalcMT(), A_(&A), k0_(k0), k1_(k1), bounds_(&bounds),
+      update_(update){
+    }
+
+    virtual ~CholeskyBlockMT(){}
+
+    virtual void calc(Index tNr=0){
+        RMatrix & A = *A_;
+        Index nb = k1_ - k0_;
+        for (Index i = (*bounds_)[start_]; i < (*bounds_)[end_]; i ++){
+            double * Ai = &A[i][0];
+            if (!update_){
+                //** L[i][k0:k1] by forward substitution with the diagonal block
+                for (Index j = k0_; j < k1_; j ++){
+                    const double * Aj = &A[j][0];
+                    Ai[j] = (Ai[j] - dotRow_(Ai + k0_, Aj + k0_, j - k0_)) / Aj[j];
+                }
+            } else {
+                //** A[i][k1:i] -= L[i][k0:k1] * L[j][k0:k1]
+                for (Index j = k1_; j <= i; j ++){
+                    Ai[j] -= dotRow_(Ai + k0_, &A[j][0] + k0_, nb);
+                }
+            }
+        }
+    }
+
+protected:
+    RMatrix * A_;
+    Index k0_;
+    Index k1_;
+    const std::vector < Index > * bounds_;
+    bool update_;
+};
+
+int solveCholesky(RMatrix & A, RVector & x, const RVector & b){
+    Index n = A.rows();
+    if (A.cols() != n || b.size() != n){
+        throwLengthError(1, WHERE_AM_I + " " + toStr(A.rows()) + "x"
+                         + toStr(A.cols()) + " " + toStr(b.size()));
+    }
+
+    //** right looking blocked factorization, the rows below each
+    //** diagonal block are distributed over the threads
+    for (Index k0 = 0; k0 < n; k0 += __CHOLESKY_BLOCK__){
+        Index k1 = std::min(n, k0 + __CHOLESKY_BLOCK__);
+        for (Index i = k0; i < k1; i ++){
+            double * Ai = &A[i][0];
+            for (Index j = k0; j <= i; j ++){
+                double s = Ai[j] - dotRow_(Ai + k0, &A[j][0] + k0, j - k0);
+                if (j == i){
+                    if (s <= 0.0) return 0;
+                    Ai[i] = std::sqrt(s);
+                } else {
+                    Ai[j] = s / A[j][j];
+                }
+            }
+        }
+        if (k1 < n){
+            Index nRows = n - k1;
+            Index nThreads = std::max(Index(1), std::min(threadCount(),
+                                      nRows * (k1 - k0) * nRows / 2 / 1000000));
+            nThreads = std::min(nThreads, nRows);
+
+            //** the work per row grows with its index, so one chunk per
+            //** thread with about the same amount of work
+            std::vector < Index > bounds(nThreads + 1, k1);
+            for (Index t = 1; t < nThreads; t ++){
+                bounds[t] = k1 + Index(nRows * std::sqrt(double(t) / nThreads));
+            }
+            bounds[nThreads] = n;
+            distributeCalc(CholeskyBlockMT(A, k0, k1, bounds, false), nThreads, nThreads);
+            distributeCalc(CholeskyBlockMT(A, k0, k1, bounds, true), nThreads, nThreads);
+        }
+    }
+
+    //** L y = b, L^T x = y
+    x.resize(n);
+    for (Index i = 0; i < n; i ++){
+        x[i] = (b[i] - dotRow_(&A[i][0], &x[0], i)) / A[i][i];
+    }
+    for (Index i = n; i-- > 0;){
+        double s = x[i];
+        for (Index j = i + 1; j < n; j ++) s -= A[j][i] * x[j];
+        x[i] = s / A[i][i];
+    }
+    return 1;
+}
+
 } // namespace GIMLI
 
@@ -26,7 +26,9 @@ namespace GIMLI{
 
 class SolverWrapper;
 
-enum SolverType{AUTOMATIC,LDL,CHOLMOD,UNKNOWN};
+/*! PCG: iterative solver, see \ref PCGWrapper. AUTOMATIC prefers the direct
+ * solvers and takes PCG if none of them is installed. */
+enum SolverType{AUTOMATIC,LDL,CHOLMOD,PCG,UNKNOWN};
 
 class DLLEXPORT LinSolver{
 public:
@@ -49,6 +51,11 @@ public:
     RVector solve(const RVector & rhs);
     CVector solve(const CVector & rhs);
 
+    /*! Solve for all rows of B at once, X[i] is the solution for B[i].
+     * Direct solvers do this with one multi column triangular solve. */
+    void solve(const RMatrix & B, RMatrix & X);
+    void solve(const CMatrix & B, CMatrix & X);
+
     void setSolverType(SolverType solverType = AUTOMATIC);
 
     /*! Forwarded to the wrapper to overwrite settings within S. stype =-2 -> use S.stype()*/
@@ -57,8 +64,22 @@ public:
     /*! Verbose level = -1, use Linsolver.verbose(). */
     void setMatrix(CSparseMatrix & S, int stype=-2);
 
+    /*! Take the new values of S and factorize again, reusing the symbolic
+     * analysis (fill reducing ordering, supernodal structure) of the last
+     * \ref setMatrix. S need the same sparsity pattern and symmetry.
+     * Falls back to \ref setMatrix if the pattern has changed or the
+     * solver cannot reuse its analysis. */
+    void refactorise(RSparseMatrix & S, int stype=-2);
+
+    /*! Complex version of \ref refactorise. */
+    void refactorise(CSparseMatrix & S, int stype=-2);
+
     SolverType solverType() const { return solverType_; }
 
+    /*! Return true if solve can be called concurrently from several
+     * threads after the factorization. */
+    bool threadSafeSolve() const;
+
     std::string solverName() const;
 
 protected:
@@ -67,14 +88,28 @@ protected:
     void initialize_(RSparseMatrix & S, int stype);
     void initialize_(CSparseMatrix & S, int stype);
 
+    template < class ValueType >
+    void refactorise_(SparseMatrix < ValueType > & S, int stype);
+
     MatrixBase * cacheMatrix_;
     SolverType      solverType_;
     SolverWrapper * solver_;
     bool            verbose_;
     uint rows_;
     uint cols_;
+
+    // sparsity pattern of the factorized matrix
+    std::vector < int > colPtr_;
+    std::vector < int > rowIdx_;
+    int stype_;
 };
 
+/*! Solve A x = b for a dense symmetric positive definite matrix by a
+ * Cholesky factorization. Only the lower triangle of A is used and
+ * overwritten with the factor L (A = L L^T). Return 0 if A is not
+ * positive definite. */
+DLLEXPORT int solveCholesky(RMatrix & A, RVector & x, const RVector & b);
+
 template < class Mat, class Vec > int solveLU(const Mat & A, Vec & x, const Vec & b){
 
 	//** from TETGEN
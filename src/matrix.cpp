@@ -0,0 +1,507 @@
+/******************************************************************************
+ *   Copyright (C) 2007-2017 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "matrix.h"
+#include "calculateMultiThread.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if USE_CBLAS
+    #if CONDA_BUILD
+        #include <cblas.h>
+    #else
+        #include <openblas/cblas.h>
+    #endif
+#endif
+
+namespace GIMLI{
+
+//! Minimum amount of matrix values per thread for the threaded dense kernels.
+static const Index __DENSE_MT_MIN_VALS__ = 100000;
+
+//! Cache block sizes (values) of the dense fallback kernels.
+static const Index __DENSE_BLOCK_K__ = 128;
+static const Index __DENSE_BLOCK_J__ = 512;
+
+static Index denseThreadCount_(Index nVals, Index nCalcs){
+    Index nThreads = std::min(threadCount(),
+                              std::max(Index(1), nVals / __DENSE_MT_MIN_VALS__));
+    return std::max(Index(1), std::min(nThreads, nCalcs));
+}
+
+template < class ValueType >
+void checkRows_(const Matrix < ValueType > & A, const std::string & where){
+    if (A.isContiguous()) return;
+    for (Index i = 0; i < A.rows(); i ++){
+        if (A[i].size() != A.cols()){
+            throwLengthError(1, where + " rows differ in length: " +
+                             str(A[i].size()) + " != " + str(A.cols()));
+        }
+    }
+}
+
+//** A * b for the rows [start, end), A^T * b for the columns [start, end)
+template < class ValueType > class DenseMultMT : public BaseCalcMT{
+public:
+    DenseMultMT(const Matrix < ValueType > & A, const Vector < ValueType > & b,
+                Vector < ValueType > & ret, bool trans)
+    : BaseCalcMT(), A_(&A), b_(&b), ret_(&ret), trans_(trans){
+    }
+
+    virtual ~DenseMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        const Matrix < ValueType > & A = *A_;
+        const ValueType * b = &(*b_)[0];
+        ValueType * r = &(*ret_)[0];
+        Index rows = A.rows();
+        Index cols = A.cols();
+        Index end = std::min(end_, trans_ ? cols : rows);
+
+        if (!trans_){
+            Index i = start_;
+            //** four rows at once to reuse the loaded b
+            for (; i + 4 <= end; i += 4){
+                const ValueType * a0 = &A[i][0];
+                const ValueType * a1 = &A[i + 1][0];
+                const ValueType * a2 = &A[i + 2][0];
+                const ValueType * a3 = &A[i + 3][0];
+                ValueType s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+                for (Index j = 0; j < cols; j ++){
+                    s0 += a0[j] * b[j]; s1 += a1[j] * b[j];
+                    s2 += a2[j] * b[j]; s3 += a3[j] * b[j];
+                }
+                r[i] = s0; r[i + 1] = s1; r[i + 2] = s2; r[i + 3] = s3;
+            }
+            for (; i < end; i ++){
+                const ValueType * a0 = &A[i][0];
+                ValueType s0 = 0.0;
+                for (Index j = 0; j < cols; j ++) s0 += a0[j] * b[j];
+                r[i] = s0;
+            }
+        } else {
+            for (Index j = start_; j < end; j ++) r[j] = 0.0;
+            Index i = 0;
+            for (; i + 4 <= rows; i += 4){
+                const ValueType * a0 = &A[i][0];
+                const ValueType * a1 = &A[i + 1][0];
+                const ValueType * a2 = &A[i + 2][0];
+                const ValueType * a3 = &A[i + 3][0];
+                const ValueType b0 = b[i], b1 = b[i + 1], b2 = b[i + 2], b3 = b[i + 3];
+                for (Index j = start_; j < end; j ++){
+                    r[j] += a0[j] * b0 + a1[j] * b1 + a2[j] * b2 + a3[j] * b3;
+                }
+            }
+            for (; i < rows; i ++){
+                const ValueType * a0 = &A[i][0];
+                const ValueType b0 = b[i];
+                for (Index j = start_; j < end; j ++) r[j] += a0[j] * b0;
+            }
+        }
+    }
+
+protected:
+    const Matrix < ValueType > * A_;
+    const Vector < ValueType > * b_;
+    Vector < ValueType >       * ret_;
+    bool trans_;
+};
+
+template < class ValueType >
+void matMultFallback_(const Matrix < ValueType > & A, const Vector < ValueType > & b,
+                      Vector < ValueType > & ret, bool trans){
+    checkRows_(A, WHERE_AM_I);
+    Index n = trans ? A.cols() : A.rows();
+    if (A.rows() == 0 || A.cols() == 0){
+        ret.fill(0.0);
+        return;
+    }
+    distributeCalc(DenseMultMT< ValueType >(A, b, ret, trans), n,
+                   denseThreadCount_(A.rows() * A.cols(), n));
+}
+
+//** C[i] = sum_k opA(i, k) * B[k] for the rows [start, end) of C
+template < class ValueType > class DenseMatMultMT : public BaseCalcMT{
+public:
+    DenseMatMultMT(const Matrix < ValueType > & A, const Matrix < ValueType > & B,
+                   Matrix < ValueType > & C, bool transA)
+    : BaseCalcMT(), A_(&A), B_(&B), C_(&C), transA_(transA){
+    }
+
+    virtual ~DenseMatMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        const Matrix < ValueType > & A = *A_;
+        const Matrix < ValueType > & B = *B_;
+        Matrix < ValueType > & C = *C_;
+        Index K = B.rows();
+        Index N = B.cols();
+        Index end = std::min(end_, C.rows());
+
+        for (Index jb = 0; jb < N; jb += __DENSE_BLOCK_J__){
+            Index je = std::min(N, jb + __DENSE_BLOCK_J__);
+            for (Index kb = 0; kb < K; kb += __DENSE_BLOCK_K__){
+                Index ke = std::min(K, kb + __DENSE_BLOCK_K__);
+                for (Index i = start_; i < end; i ++){
+                    ValueType * c = &C[i][0];
+                    Index k = kb;
+                    //** four rows of B at once to save loads and stores of c
+                    for (; k + 4 <= ke; k += 4){
+                        const ValueType a0 = opA_(A, i, k), a1 = opA_(A, i, k + 1);
+                        const ValueType a2 = opA_(A, i, k + 2), a3 = opA_(A, i, k + 3);
+                        const ValueType * b0 = &B[k][0];
+                        const ValueType * b1 = &B[k + 1][0];
+                        const ValueType * b2 = &B[k + 2][0];
+                        const ValueType * b3 = &B[k + 3][0];
+                        for (Index j = jb; j < je; j ++){
+                            c[j] += a0 * b0[j] + a1 * b1[j] + a2 * b2[j] + a3 * b3[j];
+                        }
+                    }
+                    for (; k < ke; k ++){
+                        const ValueType a = opA_(A, i, k);
+                        if (a == ValueType(0.0)) continue;
+                        const ValueType * bk = &B[k][0];
+                        for (Index j = jb; j < je; j ++) c[j] += a * bk[j];
+                    }
+                }
+            }
+        }
+    }
+
+protected:
+    inline ValueType opA_(const Matrix < ValueType > & A, Index i, Index k) const {
+        return transA_ ? A[k][i] : A[i][k];
+    }
+
+    const Matrix < ValueType > * A_;
+    const Matrix < ValueType > * B_;
+    Matrix < ValueType >       * C_;
+    bool transA_;
+};
+
+//** C[i][j] = A[i] * B[j] for the rows [start, end) of C
+template < class ValueType > class DenseMatMultTransMT : public BaseCalcMT{
+public:
+    DenseMatMultTransMT(const Matrix < ValueType > & A, const Matrix < ValueType > & B,
+                        Matrix < ValueType > & C)
+    : BaseCalcMT(), A_(&A), B_(&B), C_(&C){
+    }
+
+    virtual ~DenseMatMultTransMT(){}
+
+    virtual void calc(Index tNr=0){
+        const Matrix < ValueType > & A = *A_;
+        const Matrix < ValueType > & B = *B_;
+        Matrix < ValueType > & C = *C_;
+        Index K = A.cols();
+        Index N = B.rows();
+        Index end = std::min(end_, C.rows());
+        Index jBlock = std::max(Index(1), __DENSE_BLOCK_J__ * __DENSE_BLOCK_K__ / std::max(Index(1), K));
+
+        for (Index jb = 0; jb < N; jb += jBlock){
+            Index je = std::min(N, jb + jBlock);
+            for (Index i = start_; i < end; i ++){
+                const ValueType * ai = &A[i][0];
+                ValueType * c = &C[i][0];
+                for (Index j = jb; j < je; j ++){
+                    const ValueType * bj = &B[j][0];
+                    ValueType s = 0.0;
+                    for (Index k = 0; k < K; k ++) s += ai[k] * bj[k];
+                    c[j] = s;
+                }
+            }
+        }
+    }
+
+protected:
+    const Matrix < ValueType > * A_;
+    const Matrix < ValueType > * B_;
+    Matrix < ValueType >       * C_;
+};
+
+template < class ValueType >
+void transpose_(const Matrix < ValueType > & A, Matrix < ValueType > & T){
+    T.resize(A.cols(), A.rows());
+    for (Index i = 0; i < A.rows(); i ++){
+        const ValueType * ai = &A[i][0];
+        for (Index j = 0; j < A.cols(); j ++) T[j][i] = ai[j];
+    }
+}
+
+template < class ValueType >
+void matMatMultFallback_(const Matrix < ValueType > & A, const Matrix < ValueType > & B,
+                         Matrix < ValueType > & C, bool transA, bool transB){
+    checkRows_(A, WHERE_AM_I);
+    checkRows_(B, WHERE_AM_I);
+    Index M = transA ? A.cols() : A.rows();
+    Index K = transA ? A.rows() : A.cols();
+
+    C.clean();
+    if (M == 0 || K == 0 || C.cols() == 0) return;
+
+    Index nThreads = denseThreadCount_(M * K * C.cols() / __DENSE_BLOCK_K__, M);
+
+    if (transB && !transA){
+        distributeCalc(DenseMatMultTransMT< ValueType >(A, B, C), M, nThreads);
+    } else if (transB){
+        Matrix < ValueType > BT;
+        transpose_(B, BT);
+        distributeCalc(DenseMatMultMT< ValueType >(A, BT, C, transA), M, nThreads);
+    } else {
+        distributeCalc(DenseMatMultMT< ValueType >(A, B, C, transA), M, nThreads);
+    }
+}
+
+//** Upper triangle rows of C = A^T diag(w) A for a chunk of rows with equal work
+class DenseTransDiagMultMT : public BaseCalcMT{
+public:
+    DenseTransDiagMultMT(const RMatrix & A, const RVector & w, RMatrix & C,
+                         const std::vector < Index > & bounds)
+    : BaseCalcMT(), A_(&A), w_(&w), C_(&C), bounds_(&bounds){
+    }
+
+    virtual ~DenseTransDiagMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        const RMatrix & A = *A_;
+        const RVector & w = *w_;
+        RMatrix & C = *C_;
+        Index m = A.rows();
+        Index n = A.cols();
+        Index end = std::min(end_, Index(bounds_->size() - 1));
+
+        for (Index chunk = start_; chunk < end; chunk ++){
+            Index p0 = (*bounds_)[chunk];
+            Index p1 = (*bounds_)[chunk + 1];
+            for (Index qb = p0; qb < n; qb += __DENSE_BLOCK_J__){
+                Index qe = std::min(n, qb + __DENSE_BLOCK_J__);
+                for (Index ib = 0; ib < m; ib += __DENSE_BLOCK_K__){
+                    Index ie = std::min(m, ib + __DENSE_BLOCK_K__);
+                    Index p = p0;
+                    //** four rows of C at once, each row of A is loaded once.
+                    //** The few entries below the diagonal are overwritten
+                    //** by the mirror afterwards.
+                    for (; p + 4 <= p1 && p < qe; p += 4){
+                        double * c0 = &C[p][0];
+                        double * c1 = &C[p + 1][0];
+                        double * c2 = &C[p + 2][0];
+                        double * c3 = &C[p + 3][0];
+                        Index qs = std::max(p, qb);
+                        for (Index i = ib; i < ie; i ++){
+                            const double * ai = &A[i][0];
+                            const double s0 = w[i] * ai[p], s1 = w[i] * ai[p + 1];
+                            const double s2 = w[i] * ai[p + 2], s3 = w[i] * ai[p + 3];
+                            for (Index q = qs; q < qe; q ++){
+                                const double a = ai[q];
+                                c0[q] += s0 * a; c1[q] += s1 * a;
+                                c2[q] += s2 * a; c3[q] += s3 * a;
+                            }
+                        }
+                    }
+                    for (; p < p1 && p < qe; p ++){
+                        double * c = &C[p][0];
+                        Index qs = std::max(p, qb);
+                        for (Index i = ib; i < ie; i ++){
+                            const double * ai = &A[i][0];
+                            const double s = w[i] * ai[p];
+                            if (s == 0.0) continue;
+                            for (Index q = qs; q < qe; q ++) c[q] += s * ai[q];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+protected:
+    const RMatrix * A_;
+    const RVector * w_;
+    RMatrix       * C_;
+    const std::vector < Index > * bounds_;
+};
+
+void matTransDiagMultFallback_(const RMatrix & A, const RVector & w, RMatrix & C){
+    checkRows_(A, WHERE_AM_I);
+    Index n = A.cols();
+    if (n == 0 || A.rows() == 0) return;
+
+    Index nThreads = denseThreadCount_(A.rows() * n * n / 2 / __DENSE_BLOCK_K__, n);
+
+    //** row p of the upper triangle has n - p entries, balance the threads
+    std::vector < Index > bounds(1, 0);
+    double total = 0.5 * double(n) * double(n + 1);
+    double acc = 0.0;
+    for (Index p = 0; p < n; p ++){
+        acc += double(n - p);
+        if (acc >= total * double(bounds.size()) / double(nThreads) &&
+            bounds.size() < nThreads){
+            bounds.push_back(p + 1);
+        }
+    }
+    bounds.push_back(n);
+    Index nChunks = bounds.size() - 1;
+
+    distributeCalc(DenseTransDiagMultMT(A, w, C, bounds), nChunks,
+                   std::min(nThreads, nChunks));
+}
+
+template < class ValueType >
+void mirrorUpper_(Matrix < ValueType > & C){
+    for (Index p = 0; p < C.rows(); p ++){
+        for (Index q = p + 1; q < C.cols(); q ++) C[q][p] = C[p][q];
+    }
+}
+
+#if USE_CBLAS
+inline CBLAS_TRANSPOSE cblasTrans_(bool trans){
+    return trans ? CblasTrans : CblasNoTrans;
+}
+inline void gemm_(bool transA, bool transB, Index M, Index N, Index K,
+                  double alpha, const double * A, Index lda,
+                  const double * B, Index ldb,
+                  double beta, double * C, Index ldc){
+    cblas_dgemm(CblasRowMajor, cblasTrans_(transA), cblasTrans_(transB),
+                M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+inline void gemm_(bool transA, bool transB, Index M, Index N, Index K,
+                  Complex alpha, const Complex * A, Index lda,
+                  const Complex * B, Index ldb,
+                  Complex beta, Complex * C, Index ldc){
+    cblas_zgemm(CblasRowMajor, cblasTrans_(transA), cblasTrans_(transB),
+                M, N, K, &alpha, A, lda, B, ldb, &beta, C, ldc);
+}
+#endif
+
+void matMult(const RMatrix & A, const RVector & b, RVector & ret, bool transpose){
+    Index rows = A.rows();
+    Index cols = A.cols();
+    if (b.size() != (transpose ? rows : cols)){
+        throwLengthError(1, WHERE_AM_I + " " + str(transpose ? rows : cols) +
+                         " != " + str(b.size()));
+    }
+    ret.resize(transpose ? cols : rows);
+#if USE_CBLAS
+    if (rows > 0 && cols > 0 && A.isContiguous()){
+        cblas_dgemv(CblasRowMajor, cblasTrans_(transpose), rows, cols,
+                    1.0, A.data(), cols, &b[0], 1, 0.0, &ret[0], 1);
+        return;
+    }
+#endif
+    matMultFallback_(A, b, ret, transpose);
+}
+
+void matMult(const CMatrix & A, const CVector & b, CVector & ret, bool transpose){
+    Index rows = A.rows();
+    Index cols = A.cols();
+    if (b.size() != (transpose ? rows : cols)){
+        throwLengthError(1, WHERE_AM_I + " " + str(transpose ? rows : cols) +
+                         " != " + str(b.size()));
+    }
+    ret.resize(transpose ? cols : rows);
+#if USE_CBLAS
+    if (rows > 0 && cols > 0 && A.isContiguous()){
+        Complex alpha(1.0, 0.0), beta(0.0, 0.0);
+        cblas_zgemv(CblasRowMajor, cblasTrans_(transpose), rows, cols,
+                    &alpha, A.data(), cols, &b[0], 1, &beta, &ret[0], 1);
+        return;
+    }
+#endif
+    matMultFallback_(A, b, ret, transpose);
+}
+
+template < class ValueType >
+void matMatMult_(const Matrix < ValueType > & A, const Matrix < ValueType > & B,
+                 Matrix < ValueType > & C, bool transA, bool transB){
+    Index M = transA ? A.cols() : A.rows();
+    Index K = transA ? A.rows() : A.cols();
+    Index KB = transB ? B.cols() : B.rows();
+    Index N = transB ? B.rows() : B.cols();
+    if (K != KB){
+        throwLengthError(1, WHERE_AM_I + " " + str(K) + " != " + str(KB));
+    }
+    if (&C == &A || &C == &B){
+        Matrix < ValueType > tmp;
+        matMatMult_(A, B, tmp, transA, transB);
+        C = tmp;
+        return;
+    }
+    C.resize(M, N);
+#if USE_CBLAS
+    if (M > 0 && N > 0 && K > 0 && A.isContiguous() && B.isContiguous()){
+        ValueType alpha(1.0), beta(0.0);
+        gemm_(transA, transB, M, N, K, alpha, A.data(), A.cols(),
+              B.data(), B.cols(), beta, C.data(), N);
+        return;
+    }
+#endif
+    matMatMultFallback_(A, B, C, transA, transB);
+}
+
+
+void matMult(const RMatrix & A, const RMatrix & B, RMatrix & C,
+             bool transA, bool transB){
+    matMatMult_(A, B, C, transA, transB);
+}
+
+void matMult(const CMatrix & A, const CMatrix & B, CMatrix & C,
+             bool transA, bool transB){
+    matMatMult_(A, B, C, transA, transB);
+}
+
+void matTransDiagMult(const RMatrix & A, const RVector & w, RMatrix & C){
+    Index m = A.rows();
+    Index n = A.cols();
+    if (w.size() != m){
+        throwLengthError(1, WHERE_AM_I + " " + str(m) + " != " + str(w.size()));
+    }
+    if (&C == &A){
+        RMatrix tmp;
+        matTransDiagMult(A, w, tmp);
+        C = tmp;
+        return;
+    }
+    C.resize(n, n);
+    C.clean();
+    if (m == 0 || n == 0) return;
+
+#if USE_CBLAS
+    //** row blocks of sqrt(w) A, C += B^T B with dsyrk
+    if (min(w) >= 0.0){
+        Index blockRows = std::max(Index(1), std::min(m, Index(256)));
+        RMatrix W(blockRows, n);
+        for (Index i0 = 0; i0 < m; i0 += blockRows){
+            Index nb = std::min(blockRows, m - i0);
+            for (Index i = 0; i < nb; i ++){
+                const double sw = std::sqrt(w[i0 + i]);
+                const double * ai = &A[i0 + i][0];
+                double * wi = &W[i][0];
+                for (Index j = 0; j < n; j ++) wi[j] = sw * ai[j];
+            }
+            cblas_dsyrk(CblasRowMajor, CblasUpper, CblasTrans, n, nb,
+                        1.0, W.data(), n, 1.0, C.data(), n);
+        }
+        mirrorUpper_(C);
+        return;
+    }
+#endif
+    matTransDiagMultFallback_(A, w, C);
+    mirrorUpper_(C);
+}
+
+} // namespace GIMLI
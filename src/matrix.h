@@ -211,6 +211,19 @@ public:
         THROW_TO_IMPL
         return CVector(cols());
     }
+
+    /*! Calculate ret = this * a and reuse the memory of ret.
+     * The default copies the result of \ref mult(a),
+     * overwrite it for allocation free products. */
+    virtual void mult(const RVector & a, RVector & ret) const {
+        ret = this->mult(a);
+    }
+
+    /*! Calculate ret = this.T * a and reuse the memory of ret.
+     * The default copies the result of \ref transMult(a). */
+    virtual void transMult(const RVector & a, RVector & ret) const {
+        ret = this->transMult(a);
+    }
 /*
     virtual void setCol(Index col, const RVector & v) const {
         THROW_TO_IMPL
@@ -313,36 +326,69 @@ protected:
     double val_;
 };
 
+/*! Dense matrix vector product ret = A * b, or ret = A^T * b if transpose
+ * is set. Uses cblas if build with USE_CBLAS, else a blocked and threaded
+ * kernel. ret is resized if necessary. */
+DLLEXPORT void matMult(const Matrix < double > & A, const Vector < double > & b,
+                       Vector < double > & ret, bool transpose=false);
+DLLEXPORT void matMult(const Matrix < Complex > & A, const Vector < Complex > & b,
+                       Vector < Complex > & ret, bool transpose=false);
+
+/*! Dense matrix product C = op(A) * op(B) with op(X) = X^T if the
+ * according trans flag is set. */
+DLLEXPORT void matMult(const Matrix < double > & A, const Matrix < double > & B,
+                       Matrix < double > & C, bool transA=false, bool transB=false);
+DLLEXPORT void matMult(const Matrix < Complex > & A, const Matrix < Complex > & B,
+                       Matrix < Complex > & C, bool transA=false, bool transB=false);
+
+/*! Weighted normal matrix C = A^T * diag(w) * A, e.g., J^T D J for the
+ * Gauss-Newton normal equations. C is symmetric. */
+DLLEXPORT void matTransDiagMult(const Matrix < double > & A, const Vector < double > & w,
+                                Matrix < double > & C);
+
+/*! Generic fallback for value types without dispatch. */
+template < class ValueType >
+void matMult(const Matrix < ValueType > & A, const Vector < ValueType > & b,
+             Vector < ValueType > & ret, bool transpose=false);
+
 //! Simple row-based dense matrix based on \ref Vector
-/*! Simple row-based dense matrix based on \ref Vector */
+/*! Simple row-based dense matrix based on \ref Vector.
+ * All values are stored in one contiguous row-major memory block.
+ * The rows are \ref Vector views into this block, so the row access by
+ * operator [] works as usual. A row that is resized to a size different
+ * from cols() gets its own memory and the matrix is no longer contiguous,
+ * see \ref isContiguous and \ref compact. */
 template < class ValueType > class DLLEXPORT Matrix : public MatrixBase {
 public:
     /*! Constructs an empty matrix with the dimension rows x cols. Content of the matrix is zero. */
     Matrix()
-        : MatrixBase() {
+        : MatrixBase(), data_(0), capacity_(0), cols_(0) {
         resize(0, 0);
     }
      Matrix(Index rows)
-        : MatrixBase() {
+        : MatrixBase(), data_(0), capacity_(0), cols_(0) {
         resize(rows, 0);
     }
     // no default arg here .. pygimli@win64 linker bug
     Matrix(Index rows, Index cols)
-        : MatrixBase() {
+        : MatrixBase(), data_(0), capacity_(0), cols_(0) {
         resize(rows, cols);
     }
     /*! Copy constructor */
 
     Matrix(const std::vector < Vector< ValueType > > & mat)
-        : MatrixBase(){ copy_(mat); }
+        : MatrixBase(), data_(0), capacity_(0), cols_(0) {
+        allocate_(mat.size(), mat.size() > 0 ? mat[0].size() : 0, false);
+        for (Index i = 0; i < mat.size(); i ++) *mat_[i] = mat[i];
+    }
 
     /*! Constructor, read matrix from file see \ref load(Matrix < ValueType > & A, const std::string & filename). */
     Matrix(const std::string & filename)
-        : MatrixBase() { load(*this, filename); }
+        : MatrixBase(), data_(0), capacity_(0), cols_(0) { load(*this, filename); }
 
     /*! Copyconstructor */
     Matrix(const Matrix < ValueType > & mat)
-        : MatrixBase() { copy_(mat); }
+        : MatrixBase(), data_(0), capacity_(0), cols_(0) { copy_(mat); }
 
     /*! Assignment operator */
     Matrix < ValueType > & operator = (const Matrix< ValueType > & mat){
@@ -352,7 +398,7 @@ public:
     }
 
     /*! Destruct matrix and free memory. */
-    virtual ~Matrix(){}
+    virtual ~Matrix(){ free_(); }
 
     /*! Force the copy of the matrix entries. */
     inline void copy(const Matrix < ValueType > & mat){ copy_(mat); }
@@ -362,9 +408,9 @@ public:
 
     #define DEFINE_UNARY_MOD_OPERATOR__(OP, NAME) \
     inline Matrix < ValueType > & operator OP##=(const Matrix < ValueType>&A){\
-    for (Index i = 0; i < mat_.size(); i ++) mat_[i] OP##= A[i]; return *this;}\
+    for (Index i = 0; i < mat_.size(); i ++) *mat_[i] OP##= A[i]; return *this;}\
     inline Matrix < ValueType > & operator OP##= (const ValueType & val) { \
-      for (Index i = 0; i < mat_.size(); i ++) mat_[i] OP##= val; return*this;}\
+      for (Index i = 0; i < mat_.size(); i ++) *mat_[i] OP##= val; return*this;}\
 
     DEFINE_UNARY_MOD_OPERATOR__(+, PLUS)
     DEFINE_UNARY_MOD_OPERATOR__(-, MINUS)
@@ -373,33 +419,20 @@ public:
 
     #undef DEFINE_UNARY_MOD_OPERATOR__
 
-//     Index col = cols();
-//         for (Index i = 0; i < mat_.size(); i ++) {
-//             ValueType * Aj = &mat_[i][0];
-//             ValueType * Aje = &mat_[i][col];
-//             for (; Aj != Aje;) *Aj++ OP##= val;
-//         }   return *this; }
-
     /*! Index operator for write operations without boundary check. */
     Vector< ValueType > & operator [] (Index i) {
-// //         if (i < 0 || i > mat_.size()-1) {
-//             throwLengthError(1, WHERE_AM_I + " row bounds out of range " +
-//                                 toStr(i) + " " + toStr(this->rows())) ;
-//         }
-//
-        return mat_[i];
+        return *mat_[i];
     }
 
     /*! Read only C style index operator, without boundary check. */
     const Vector< ValueType > & operator [] (Index i) const {
-//         __MS(this << " " << &mat_[i] << " " << mat_[i].size() )
-        return mat_[i];
+        return *mat_[i];
     }
 
     /*! Implicite type converter. */
     template < class T > operator Matrix< T >(){
-        Matrix< T > f(this->rows());
-        for (uint i = 0; i < this->rows(); i ++){ f[i] = Vector < T >(mat_[i]); }
+        Matrix< T > f(this->rows(), this->cols());
+        for (uint i = 0; i < this->rows(); i ++){ f[i] = Vector < T >(*mat_[i]); }
         return f;
     }
 
@@ -407,23 +440,60 @@ public:
     virtual void resize(Index rows, Index cols){ allocate_(rows, cols); }
 
     /*! Clear the matrix and free memory. */
-    inline void clear() { mat_.clear(); }
+    inline void clear() { free_(); }
 
-    /*! Fill Vector with 0.0. Don't change size.*/
+    /*! Fill Matrix with 0.0. Don't change size.*/
     inline void clean() {
-        for (Index i = 0; i < mat_.size(); i ++) mat_[i].clear();
+        for (Index i = 0; i < mat_.size(); i ++) mat_[i]->clean();
     }
 
     /*! Return number of rows. */
     inline Index rows() const { return mat_.size(); }
 
     /*! Return number of colums. */
-    inline Index cols() const { if (mat_.size() > 0) return mat_[0].size(); return 0; }
+    inline Index cols() const { if (mat_.size() > 0) return mat_[0]->size(); return 0; }
+
+    /*! Return true if all rows are placed consecutively in one memory block
+     * with the stride cols(). */
+    inline bool isContiguous() const {
+        for (Index i = 0; i < mat_.size(); i ++){
+            if (mat_[i]->data_ != data_ + i * cols_ ||
+                mat_[i]->size_ != cols_) return false;
+        }
+        return true;
+    }
+
+    /*! Move all rows back into one contiguous memory block.
+     * Throws if the rows differ in length. */
+    void compact(){
+        if (isContiguous()) return;
+        Index cols = this->cols();
+        for (Index i = 0; i < mat_.size(); i ++){
+            if (mat_[i]->size() != cols){
+                throwLengthError(1, WHERE_AM_I + " rows differ in length: " +
+                                 toStr(mat_[i]->size()) + " != " + toStr(cols));
+            }
+        }
+        allocate_(mat_.size(), cols, true, true);
+    }
+
+    /*! Return the row-major memory block of the size rows() * cols().
+     * Rows with their own memory are copied back, see \ref compact. */
+    ValueType * data() { compact(); return data_; }
+
+    /*! Return the row-major memory block of the size rows() * cols().
+     * Throws if the matrix is not contiguous. */
+    const ValueType * data() const {
+        if (!isContiguous()){
+            throwError(1, WHERE_AM_I + " matrix is not contiguous.");
+        }
+        return data_;
+    }
 
     /*! Set a value. Throws out of range exception if index check fails. */
     inline void setVal(const Vector < ValueType > & val, Index i) {
         if (i >= 0 && i < mat_.size()) {
-            mat_[i] = val;
+            *mat_[i] = val;
         } else {
             throwRangeError(1, WHERE_AM_I, i, 0, this->rows());
         }
@@ -435,7 +505,7 @@ public:
             throwLengthError(1, WHERE_AM_I + " row bounds out of range " +
                                 toStr(i) + " " + toStr(this->rows())) ;
         }
-        return mat_[i];
+        return *mat_[i];
     }
 
     /*! Return reference to row. Used for pygimli. */
@@ -444,7 +514,7 @@ public:
             throwLengthError(1, WHERE_AM_I + " row bounds out of range " +
                                 toStr(i) + " " + toStr(this->rows())) ;
         }
-        return mat_[i];
+        return *mat_[i];
     }
 
     /*! Readonly row entry of matrix, with boundary check.*/
@@ -460,19 +530,36 @@ public:
                                 toStr(i) + " " + toStr(this->cols())) ;
         }
         Vector < ValueType > col(this->rows());
-        for (Index j = 0, jmax = rows(); j < jmax; j ++) col[j] = mat_[j][i];
+        for (Index j = 0, jmax = rows(); j < jmax; j ++) col[j] = (*mat_[j])[i];
         return col;
     }
 
     /*! Add another row vector add the end. */
     inline void push_back(const Vector < ValueType > & vec) {
         //**!!! length check necessary
-        mat_.push_back(vec);
+        if (data_ && vec.data_ >= data_ && vec.data_ < data_ + capacity_){
+            //** vec is one of our rows and may move with the memory block
+            Vector< ValueType > tmp(vec);
+            return push_back(tmp);
+        }
+        Index rows = mat_.size();
+        if (rows == 0) cols_ = vec.size();
+
+        if (vec.size() == cols_ && isContiguous()){
+            if ((rows + 1) * cols_ > capacity_){
+                reserve_(max(Index(1), 2 * rows) * cols_);
+            }
+            std::copy(vec.data_, vec.data_ + cols_, data_ + rows * cols_);
+            mat_.push_back(new Vector< ValueType >());
+            mat_.back()->setView_(data_ + rows * cols_, cols_);
+        } else {
+            mat_.push_back(new Vector< ValueType >(vec));
+        }
         rowFlag_.resize(rowFlag_.size() + 1);
     }
 
     /*! Return last row vector. */
-    inline Vector< ValueType > & back() { return mat_.back(); }
+    inline Vector< ValueType > & back() { return *mat_.back(); }
 
 //     /*! Set one specific column */
 //     virtual void setCol(Index col, const RVector & v){
@@ -494,7 +581,7 @@ public:
             throwLengthError(1, WHERE_AM_I + " rows bounds out of range " +
                                 toStr(v.size()) + " " + toStr(this->rows())) ;
         }
-        for (Index i = 0; i < v.size(); i ++) mat_[i][col] = v[i];
+        for (Index i = 0; i < v.size(); i ++) (*mat_[i])[col] = v[i];
     }
 
     /*! Add one specific column */
@@ -507,7 +594,7 @@ public:
             throwLengthError(1, WHERE_AM_I + " rows bounds out of range " +
                                 toStr(v.size()) + " " + toStr(this->rows())) ;
         }
-        for (Index i = 0; i < v.size(); i ++) mat_[i][col] += v[i];
+        for (Index i = 0; i < v.size(); i ++) (*mat_[i])[col] += v[i];
     }
 
     /*! Return reference to row flag vector. Maybee you can check if the rows are valid. Size is set automatic to the amount of rows. */
@@ -515,22 +602,16 @@ public:
 
     /*! Multiplication (A*b) with a vector of the same value type. */
     Vector < ValueType > mult(const Vector < ValueType > & b) const {
-        Index cols = this->cols();
-        Index rows = this->rows();
-
-        Vector < ValueType > ret(rows, 0.0);
-
-        //ValueType tmpval = 0;
-        if (b.size() == cols){
-            for (Index i = 0; i < rows; ++i){
-                ret[i] = sum((*this)[i] * b);
-            }
-        } else {
-            throwLengthError(1, WHERE_AM_I + " " + toStr(cols) + " != " + toStr(b.size()));
-        }
+        Vector < ValueType > ret(this->rows(), 0.0);
+        matMult(*this, b, ret, false);
         return ret;
     }
 
+    /*! Multiplication ret = A*b into an existing vector. */
+    void mult(const Vector < ValueType > & b, Vector < ValueType > & ret) const {
+        matMult(*this, b, ret, false);
+    }
+
     /*! Multiplication (A*b) with a part of a vector between two defined indices. */
     Vector < ValueType > mult(const Vector < ValueType > & b, Index startI, Index endI) const {
         Index cols = this->cols();
@@ -541,33 +622,28 @@ public:
             throwLengthError(1, WHERE_AM_I + " " + toStr(cols) + " < " + toStr(endI) + "-" + toStr(startI));
         }
         Vector < ValueType > ret(rows, 0.0);
+        const ValueType * bj = &b[startI];
         for (Index i = 0; i < rows; ++i){
-            for (Index j = startI; j < endI; j++) {
-                ret[i] += (*this)[i][j] * b[j];
-            }
+            const ValueType * Ai = mat_[i]->data_;
+            ValueType s = 0.0;
+            for (Index j = 0; j < cols; j ++) s += Ai[j] * bj[j];
+            ret[i] = s;
         }
         return ret;
     }
 
     /*! Transpose multiplication (A^T*b) with a vector of the same value type. */
     Vector< ValueType > transMult(const Vector < ValueType > & b) const {
-        Index cols = this->cols();
-        Index rows = this->rows();
-        Vector < ValueType > ret(cols, 0.0);
-        //ValueType tmpval = 0;
-
-        if (b.size() == rows){
-            for(Index i = 0; i < rows; i++){
-                for(Index j = 0; j < cols; j++){
-                    ret[j] +=  (*this)[i][j] * b[i];
-                }
-            }
-        } else {
-            throwLengthError(1, WHERE_AM_I + " " + toStr(rows) + " != " + toStr(b.size()));
-        }
+        Vector < ValueType > ret(this->cols(), 0.0);
+        matMult(*this, b, ret, true);
         return ret;
     }
 
+    /*! Transpose multiplication ret = A^T*b into an existing vector. */
+    void transMult(const Vector < ValueType > & b, Vector < ValueType > & ret) const {
+        matMult(*this, b, ret, true);
+    }
+
     /*! Save matrix to file. */
     virtual void save(const std::string & filename) const {
         saveMatrix(*this, filename);
@@ -575,34 +651,120 @@ public:
 
     /*! Round each matrix element to a given tolerance. */
     void round(const ValueType & tolerance){
-        for (Index i = 0; i < mat_.size(); i ++) mat_[i].round(tolerance);
+        for (Index i = 0; i < mat_.size(); i ++) mat_[i]->round(tolerance);
         // ??? std::for_each(mat_.begin, mat_.end, boost::bind(&Vector< ValueType >::round, tolerance));
     }
 
 protected:
 
-    void allocate_(Index rows, Index cols){
-//         __MS(rows << " " << cols)
-        if (mat_.size() != rows) mat_.resize(rows);
-        for (Index i = 0; i < mat_.size(); i ++) {
-//             __MS(this << " " << &mat_[i] << " "<< cols)
-            mat_[i].resize(cols);
-//             __MS(&mat_[i] << " " <<mat_[i].size())
+    /*! Set the size to rows x cols with one new memory block. Old values
+     * are kept if keep is set. Nothing is done if the size does not change
+     * and the matrix is contiguous, unless force is set. */
+    void allocate_(Index rows, Index cols, bool keep=true, bool force=false){
+        if (!force && rows == mat_.size() && cols == cols_ && isContiguous()){
+            rowFlag_.resize(rows);
+            return;
+        }
+        Index n = rows * cols;
+        ValueType * buffer = alignedNew< ValueType >(n);
+        std::fill(buffer, buffer + n, ValueType(0.0));
+
+        if (keep){
+            for (Index i = 0; i < min(rows, mat_.size()); i ++){
+                Index m = min(cols, mat_[i]->size());
+                if (m > 0) std::copy(mat_[i]->data_, mat_[i]->data_ + m,
+                                     buffer + i * cols);
+            }
+        }
+        for (Index i = rows; i < mat_.size(); i ++) delete mat_[i];
+        mat_.resize(rows, NULL);
+        for (Index i = 0; i < rows; i ++) {
+            if (!mat_[i]) mat_[i] = new Vector< ValueType >();
+            mat_[i]->setView_(buffer + i * cols, cols);
         }
+        alignedDelete(data_, capacity_);
+        data_ = buffer;
+        capacity_ = n;
+        cols_ = cols;
         rowFlag_.resize(rows);
     }
 
+    /*! Grow the memory block to n values, keep the content and rebind the
+     * row views. Only used for a contiguous matrix. */
+    void reserve_(Index n){
+        ValueType * buffer = alignedNew< ValueType >(n);
+        Index used = mat_.size() * cols_;
+        if (data_ && used > 0) std::copy(data_, data_ + used, buffer);
+        for (Index i = 0; i < mat_.size(); i ++) {
+            mat_[i]->setView_(buffer + i * cols_, cols_);
+        }
+        alignedDelete(data_, capacity_);
+        data_ = buffer;
+        capacity_ = n;
+    }
+
     void copy_(const Matrix < ValueType > & mat){
-        allocate_(mat.rows(), mat.cols());
-        for (Index i = 0; i < mat_.size(); i ++) mat_[i] = mat[i];
+        allocate_(mat.rows(), mat.cols(), false);
+        if (mat.isContiguous()){
+            if (mat.rows() * mat.cols() > 0){
+                std::copy(mat.data_, mat.data_ + mat.rows() * mat.cols(), data_);
+            }
+        } else {
+            for (Index i = 0; i < mat_.size(); i ++) *mat_[i] = mat[i];
+        }
     }
 
-	std::vector < Vector< ValueType > > mat_;
+    void free_(){
+        for (Index i = 0; i < mat_.size(); i ++) delete mat_[i];
+        mat_.clear();
+        alignedDelete(data_, capacity_);
+        data_ = 0;
+        capacity_ = 0;
+        cols_ = 0;
+    }
+
+    /*! Row views into data_, or rows with their own memory. */
+    std::vector < Vector< ValueType > * > mat_;
+
+    /*! Row-major memory block for all rows, stride cols_. */
+    ValueType * data_;
+    Index capacity_;
+    Index cols_;
 
     /*! BVector flag(rows) for free use, e.g., check if rows are set valid. */
     BVector rowFlag_;
 };
 
+template < class ValueType >
+void matMult(const Matrix < ValueType > & A, const Vector < ValueType > & b,
+             Vector < ValueType > & ret, bool transpose){
+    Index cols = A.cols();
+    Index rows = A.rows();
+
+    if (!transpose){
+        if (b.size() != cols){
+            throwLengthError(1, WHERE_AM_I + " " + toStr(cols) + " != " + toStr(b.size()));
+        }
+        ret.resize(rows);
+        for (Index i = 0; i < rows; ++i){
+            const Vector < ValueType > & Ai = A[i];
+            ValueType s = 0.0;
+            for (Index j = 0; j < cols; j ++) s += Ai[j] * b[j];
+            ret[i] = s;
+        }
+    } else {
+        if (b.size() != rows){
+            throwLengthError(1, WHERE_AM_I + " " + toStr(rows) + " != " + toStr(b.size()));
+        }
+        ret.resize(cols);
+        ret.fill(0.0);
+        for (Index i = 0; i < rows; i++){
+            const Vector < ValueType > & Ai = A[i];
+            for (Index j = 0; j < cols; j++) ret[j] += Ai[j] * b[i];
+        }
+    }
+}
+
 #define DEFINE_BINARY_OPERATOR__(OP, NAME) \
 template < class ValueType > \
 Matrix < ValueType > operator OP (const Matrix < ValueType > & A, const Matrix < ValueType > & B) { \
@@ -636,35 +798,13 @@ public:
     Index end_;
 };
 
+/*! Threaded A * b. Kept for compatibility, \ref Matrix::mult is threaded
+ * by itself, see \ref matMult. */
 template < class ValueType >
 Vector < ValueType > multMT(const Matrix < ValueType > & A, const Vector < ValueType > & b){
-#ifdef USE_THREADS
-    Index cols = A.cols();
-    Index rows = A.rows();
-
-    Vector < ValueType > ret(rows);
-    boost::thread_group threads;
-    Index nThreads = 2;
-    Index singleCalcCount = Index(ceil((double)rows / (double)nThreads));
- //   CycleCounter cc;
-
-    for (Index i = 0; i < nThreads; i ++){
-// 	Vector < ValueType > *start = &A[singleCalcCount * i];
-//         Vector < ValueType > *end   = &A[singleCalcCount * (i + 1)];
-        Index start = singleCalcCount * i;
-        Index end   = singleCalcCount * (i + 1);
-	if (i == nThreads -1) end = A.rows();
-//	cc.tic();
-        threads.create_thread(Mult< ValueType >(ret, b, A, start, end));
-  //      std::cout << cc.toc() << std::endl;
-    }
-    threads.join_all();
-#else
-    return mult(A, b);
-#endif
+    return A.mult(b);
 }
 
-
 template < class ValueType >
 bool operator == (const Matrix< ValueType > & A, const Matrix< ValueType > & B){
     if (A.rows() != B.rows() || A.cols() != B.cols()) return false;
@@ -30,6 +30,10 @@
     #define USE_PROC_READPROC 0
 #endif
 
+#ifndef WIN32_LEAN_AND_MEAN
+    #include <sys/resource.h>
+#endif
+
 #if USE_BOOST_THREAD
     #include <boost/thread.hpp>
     /*! Lock proc reading to be thread safe */
@@ -99,6 +103,26 @@ double MemWatch::inUse() {
     return 0;
 }
 
+double MemWatch::peak() {
+#ifdef WIN32_LEAN_AND_MEAN
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))){
+        return mByte(pmc.PeakWorkingSetSize);
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0){
+    #if defined(__APPLE__)
+        return mByte(usage.ru_maxrss);        // bytes
+    #else
+        return kByte(usage.ru_maxrss);        // kByte
+    #endif
+    }
+    return 0;
+#endif
+}
+
 void MemWatch::info(const std::string & str){
     if (debug()){
 #if defined(WIN32_LEAN_AND_MEAN) || USE_PROC_READPROC
@@ -43,6 +43,9 @@ public:
     /*! Return the current memory usage of the process. Values are in MByte. */
     double inUse();
 
+    /*! Return the peak resident memory (max RSS) of the process so far. Values are in MByte. */
+    double peak();
+
     /*! Return the current memory usage relative to the last call of this method. Values are in MByte. */
     double current();
 
@@ -72,6 +75,11 @@ inline double memoryInUse(){
     return GIMLI::MemWatch::instance().inUse();
 }
 
+/*! Peak resident memory of the current process in MByte. */
+inline double memoryPeak(){
+    return GIMLI::MemWatch::instance().peak();
+}
+
 
 } // namespace GIMLI
 
@@ -22,6 +22,7 @@
 #include "mesh.h"
 #include "regionManager.h"
 #include "stopwatch.h"
+#include "trans.h"
 #include "vector.h"
 #include "vectortemplates.h"
 #include "sparsematrix.h"
@@ -72,6 +73,12 @@ void ModellingBase::init_() {
 
     nThreads_           = numberOfCPU();
     nThreadsJacobian_   = 1;
+    jacobianStep_       = 0.05;
+    jacobianCentral_    = false;
+    jacobianTrans_      = NULL;
+
+    responseCacheSize_  = 0;
+    responseCacheVersion_ = 0;
 
     ownJacobian_        = false;
     ownConstraints_     = false;
@@ -97,9 +104,56 @@ void ModellingBase::setData(DataContainer & data){
 //     } else {
 //         dataContainer_ = new DataContainer(data);
 //     }
+    clearResponseCache();
     updateDataDependency_();
 }
 
+/*! FNV-1a like hash over the 64 bit words of the model and a version. */
+static uint64 hashModel_(const RVector & model, uint64 version){
+    uint64 hash = 14695981039346656037ULL ^ version;
+    const uint64 * w = reinterpret_cast< const uint64 * >(&model[0]);
+    for (Index i = 0; i < model.size(); i ++){
+        hash ^= w[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ^ model.size();
+}
+
+RVector ModellingBase::cachedResponse(const RVector & model){
+    if (responseCacheSize_ == 0 || model.size() == 0 || !responseCacheable()){
+        return response(model);
+    }
+
+    uint64 hash = hashModel_(model, responseCacheVersion_);
+
+    for (std::list< ResponseCacheEntry_ >::iterator it = responseCache_.begin();
+         it != responseCache_.end(); it ++){
+        if (it->hash == hash && it->model == model){
+            if (verbose_) std::cout << "Using cached response." << std::endl;
+            responseCache_.splice(responseCache_.begin(), responseCache_, it);
+            return it->response;
+        }
+    }
+
+    ResponseCacheEntry_ entry;
+    entry.hash = hash;
+    entry.model = model;
+    entry.response = response(model);
+    responseCache_.push_front(entry);
+    while (responseCache_.size() > responseCacheSize_) responseCache_.pop_back();
+    return responseCache_.front().response;
+}
+
+void ModellingBase::setResponseCacheSize(Index size){
+    responseCacheSize_ = size;
+    while (responseCache_.size() > responseCacheSize_) responseCache_.pop_back();
+}
+
+void ModellingBase::clearResponseCache(){
+    responseCache_.clear();
+    responseCacheVersion_ ++;
+}
+
 DataContainer & ModellingBase::data() const{
     if (dataContainer_ == 0){
         throwError(1, WHERE_AM_I + " no data defined");
@@ -189,6 +243,7 @@ void ModellingBase::setMesh(const Mesh & mesh, bool ignoreRegionManager) {
 
 void ModellingBase::setMesh_(const Mesh & mesh, bool update){
     this->clearConstraints();
+    this->clearResponseCache();
 
     if (!mesh_) mesh_ = new Mesh();
 
@@ -198,6 +253,7 @@ void ModellingBase::setMesh_(const Mesh & mesh, bool update){
 }
 
 void ModellingBase::deleteMesh(){
+    clearResponseCache();
     if (mesh_) delete mesh_;
     mesh_ = 0;
 }
@@ -221,57 +277,125 @@ void ModellingBase::setMultiThreadJacobian(Index nThreads){
     nThreadsJacobian_ = max(1, nThreads);
 }
 
+void ModellingBase::setJacobianFiniteDifference(double step, bool central){
+    if (step <= 0.0){
+        throwError(1, WHERE_AM_I + " step need to be positive: " + toStr(step));
+    }
+    jacobianStep_ = step;
+    jacobianCentral_ = central;
+}
+
+/*! Brute force Jacobian for the model parameters (columns) [start_, end_).
+ * Every column is written by exactly one thread. With a model
+ * transformation tM the parameters are perturbed in transformed model
+ * space, modelT is the transformed model then. */
 class JacobianBaseMT : public GIMLI::BaseCalcMT{
 public:
-    JacobianBaseMT(MatrixBase * J,
-                   const ModellingBase & fop,
+    JacobianBaseMT(RMatrix & J,
+                   ModellingBase & fop,
                    const RVector & resp,
                    const RVector & model,
-                   Index count,
+                   const Trans< RVector > * tM,
+                   const RVector & modelT,
+                   double step, bool central, bool mt,
                    bool verbose)
-    : BaseCalcMT(count, verbose), J_(J), fop_(&fop), resp_(&resp),
-    model_(&model) {
-
+    : BaseCalcMT(0, verbose), J_(&J), fop_(&fop), resp_(&resp),
+      model_(&model), tM_(tM), modelT_(&modelT),
+      step_(step), central_(central), mt_(mt) {
     }
 
     virtual ~JacobianBaseMT(){}
 
     virtual void calc(Index tNr=0){
         RVector modelChange(*model_);
-        modelChange[tNr] *= 1.05;
-        __MS(tNr)
-        fop_->response_mt(modelChange, tNr);
-//         RVector respChange();
+        RVector modelTChange(*modelT_);
+        Index nData = resp_->size();
+
+        for (Index i = start_; i < end_; i ++){
+            double mi = (*model_)[i];
+            double mUp = 0.0, mLo = mi;
+            if (tM_){
+                mUp = perturbed_(modelTChange, i, step_);
+                if (central_) mLo = perturbed_(modelTChange, i, -step_);
+            } else {
+                mUp = mi * (1.0 + step_);
+                if (central_) mLo = mi / (1.0 + step_);
+            }
 
-        //J_->setCol(tNr, (respChange - *resp_)/(modelChange[tNr] - (*model_)[tNr]));
+            if (::fabs(mUp - mLo) > TOLERANCE){
+                modelChange[i] = mUp;
+                RVector respUp(response_(modelChange, tNr));
+
+                if (central_){
+                    modelChange[i] = mLo;
+                    RVector respLo(response_(modelChange, tNr));
+                    for (Index j = 0; j < nData; j ++){
+                        (*J_)[j][i] = (respUp[j] - respLo[j]) / (mUp - mLo);
+                    }
+                } else {
+                    for (Index j = 0; j < nData; j ++){
+                        (*J_)[j][i] = (respUp[j] - (*resp_)[j]) / (mUp - mLo);
+                    }
+                }
+                modelChange[i] = mi;
+            } else {
+                for (Index j = 0; j < nData; j ++) (*J_)[j][i] = 0.0;
+            }
+        }
     }
 
 protected:
-    MatrixBase              * J_;
-    const ModellingBase     * fop_;
+    RVector response_(const RVector & model, Index tNr){
+        if (mt_) return fop_->response_mt(model, tNr);
+        return fop_->response(model);
+    }
+
+    /*! Return parameter i for the transformed model modelT perturbed by dt. */
+    double perturbed_(RVector & modelT, Index i, double dt) const {
+        double ti = modelT[i];
+        modelT[i] = ti + dt;
+        double m = tM_->invTrans(modelT)[i];
+        modelT[i] = ti;
+        return m;
+    }
+
+    RMatrix                 * J_;
+    ModellingBase           * fop_;
     const RVector           * resp_;
     const RVector           * model_;
+    const Trans< RVector >  * tM_;
+    const RVector           * modelT_;
+    double                  step_;
+    bool                    central_;
+    bool                    mt_;
 };
 
-
 void ModellingBase::createJacobian_mt(const RVector & model,
                                       const RVector & resp){
-    THROW_TO_IMPL
     if (verbose_) std::cout << "Create Jacobian matrix (brute force, mt) ...";
 
     Stopwatch swatch(true);
-    double fak = 1.05;
 
     if (!jacobian_){
         this->initJacobian();
     }
     RMatrix *J = dynamic_cast< RMatrix * >(jacobian_);
-    if (J->rows() != resp.size()){ J->resize(resp.size(), model.size()); }
+    if (!J){
+        throwError(1, WHERE_AM_I + " brute force Jacobian needs a RMatrix.");
+    }
+    if (J->rows() != resp.size() || J->cols() != model.size()){
+        J->resize(resp.size(), model.size());
+    }
 
+    Index nThreads = max(Index(1), min(nThreadsJacobian_, model.size()));
+    RVector modelT(jacobianTrans_ ? jacobianTrans_->trans(model) : RVector(0));
 
     ALLOW_PYTHON_THREADS
-    distributeCalc(JacobianBaseMT(jacobian_, *this, resp, model, 0, verbose_),
-                   jacobian_->rows(), nThreadsJacobian_, verbose_);
+    distributeCalc(JacobianBaseMT(*J, *this, resp, model,
+                                  jacobianTrans_, modelT,
+                                  jacobianStep_, jacobianCentral_, true,
+                                  verbose_),
+                   model.size(), nThreads, verbose_);
     swatch.stop();
     if (verbose_) std::cout << " ... " << swatch.duration() << " s." << std::endl;
 }
@@ -281,36 +405,25 @@ void ModellingBase::createJacobian(const RVector & model,
     if (verbose_) std::cout << "Create Jacobian matrix (brute force) ...";
 
     Stopwatch swatch(true);
-    double fak = 1.05;
 
     if (!jacobian_){
         this->initJacobian();
     }
     RMatrix *J = dynamic_cast< RMatrix * >(jacobian_);
-    if (J->rows() != resp.size()){ J->resize(resp.size(), model.size()); }
-
-    for (size_t i = 0; i < model.size(); i++) {
-        RVector modelChange(model);
-        modelChange[i] *= fak;
-
-        RVector respChange(response(modelChange));
-
-        if (::fabs(modelChange[i] - model[i]) > TOLERANCE){
-            J->setCol(i, (respChange - resp) / (modelChange[i] - model[i]));
-        } else {
-            J->setCol(i, RVector(resp.size(), 0.0));
-        }
+    if (!J){
+        throwError(1, WHERE_AM_I + " brute force Jacobian needs a RMatrix.");
+    }
+    if (J->rows() != resp.size() || J->cols() != model.size()){
+        J->resize(resp.size(), model.size());
+    }
 
-//         __MS(i << " " << min(J->col(i)) << " " << max(J->col(i)))
+    RVector modelT(jacobianTrans_ ? jacobianTrans_->trans(model) : RVector(0));
 
-//         for (size_t j = 0; j < resp.size(); j++){
-//             if (::fabs(modelChange[i] - model[i]) > TOLERANCE){
-//                 (*J)[j][i] = (respChange[j] - resp[j]) / (modelChange[i] - model[i]);
-//             } else {
-//                 (*J)[j][i] = 0.0;
-//             }
-//         }
-    }
+    distributeCalc(JacobianBaseMT(*J, *this, resp, model,
+                                  jacobianTrans_, modelT,
+                                  jacobianStep_, jacobianCentral_, false,
+                                  verbose_),
+                   model.size(), 1, verbose_);
 
     swatch.stop();
     if (verbose_) std::cout << " ... " << swatch.duration() << " s." << std::endl;
@@ -341,6 +454,44 @@ void ModellingBase::createJacobian(const RVector & model){
     }
 }
 
+/*! Responses for the models (rows) [start_, end_) using response_mt. */
+class ResponsesMT : public GIMLI::BaseCalcMT{
+public:
+    ResponsesMT(RMatrix & resp, const ModellingBase & fop,
+                const RMatrix & models, bool verbose)
+    : BaseCalcMT(0, verbose), resp_(&resp), fop_(&fop), models_(&models) {
+    }
+
+    virtual ~ResponsesMT(){}
+
+    virtual void calc(Index tNr=0){
+        Index end = std::min(end_, resp_->rows());
+        for (Index i = start_; i < end; i ++){
+            (*resp_)[i] = fop_->response_mt((*models_)[i], tNr);
+        }
+    }
+
+protected:
+    RMatrix                 * resp_;
+    const ModellingBase     * fop_;
+    const RMatrix           * models_;
+};
+
+RMatrix ModellingBase::responses(const RMatrix & models){
+    RMatrix resp(models.rows(), 0);
+    if (models.rows() == 0) return resp;
+
+    Index nThreads = max(Index(1), min(nThreadsJacobian_, models.rows()));
+    if (nThreads > 1){
+        ALLOW_PYTHON_THREADS
+        distributeCalc(ResponsesMT(resp, *this, models, verbose_),
+                       models.rows(), nThreads, verbose_);
+    } else {
+        for (Index i = 0; i < models.rows(); i ++) resp[i] = response(models[i]);
+    }
+    return resp;
+}
+
 void ModellingBase::initConstraints(){
     if (constraints_ == 0){
         constraints_ = new RSparseMapMatrix(0, 0, 0);
@@ -23,6 +23,8 @@
 #include "matrix.h"
 //#include "blockmatrix.h"
 
+#include <list>
+
 namespace GIMLI{
 
 //class H2SparseMapMatrix;
@@ -62,6 +64,36 @@ public:
         return RVector(0);
     }
 
+    /*! Calculate the responses for a set of models, one model per row.
+     * Default calls \ref response for every model or, if
+     * \ref setMultiThreadJacobian is greater than 1, distributes the models
+     * over these threads using \ref response_mt. Operators can overload it
+     * to share the setup work between the models. */
+    virtual RMatrix responses(const RMatrix & models);
+
+    /*! Return \ref response for model. If the response cache is enabled
+     * (\ref setResponseCacheSize), the operator allows caching
+     * (\ref responseCacheable) and the model has been calculated for
+     * the current data and mesh, the cached response is returned. */
+    RVector cachedResponse(const RVector & model);
+
+    /*! Enable a least recently used cache for \ref cachedResponse holding
+     * the responses of the last size models. 0 (default) disables it. */
+    void setResponseCacheSize(Index size);
+
+    /*! Return the maximum number of cached responses. */
+    inline Index responseCacheSize() const { return responseCacheSize_; }
+
+    /*! Drop all cached responses. setData and setMesh do this
+     * automatically, call it if data or mesh are changed in place. */
+    void clearResponseCache();
+
+    /*! Return false if \ref response keeps a state that a following
+     * \ref createJacobian relies on, e.g., the potentials of a FEM operator.
+     * A cache hit would skip this state, so \ref cachedResponse always
+     * calls \ref response then. Default is true. */
+    virtual bool responseCacheable() const { return true; }
+
     inline RVector operator() (const RVector & model){ return response(model); }
 
     /*! Change the associated data container */
@@ -212,6 +244,33 @@ public:
     /*! Return number of threads used for Jacobian generation. */
     inline Index multiThreadJacobian() const { return nThreadsJacobian_; }
 
+    /*! Set the finite difference scheme for the brute force Jacobian.
+     * Every model parameter is perturbed by step in transformed model
+     * space, see \ref setJacobianTrans. Without transformation the
+     * perturbation is relative m * (1 + step), i.e., log(1 + step) in
+     * logarithmic model space. Central differences additionally perturb
+     * by -step (m / (1 + step)) and need twice the number of response
+     * calls. Default is step=0.05, forward. */
+    void setJacobianFiniteDifference(double step, bool central=false);
+
+    /*! Return the relative perturbation of the brute force Jacobian. */
+    inline double jacobianStep() const { return jacobianStep_; }
+
+    /*! Return true if the brute force Jacobian uses central differences. */
+    inline bool jacobianCentral() const { return jacobianCentral_; }
+
+    /*! Set the model transformation for the brute force Jacobian, so the
+     * parameters are perturbed to tM.invTrans(tM.trans(m) + step) and stay
+     * inside the bounds of the transformation. The Jacobian is still the
+     * derivative for the untransformed model. NULL restores the relative
+     * perturbation, which keeps zero parameters fixed. \ref Inversion sets
+     * its model transformation, if not the default, for its calls of
+     * \ref createJacobian. */
+    inline void setJacobianTrans(Trans< RVector > * tM) { jacobianTrans_ = tM; }
+
+    /*! Return the model transformation of the brute force Jacobian. */
+    inline Trans< RVector > * jacobianTrans() const { return jacobianTrans_; }
+
 protected:
 
     virtual void init_();
@@ -245,6 +304,20 @@ protected:
 
     Index                   nThreads_;
     Index                   nThreadsJacobian_;
+    double                  jacobianStep_;
+    bool                    jacobianCentral_;
+    Trans< RVector >        * jacobianTrans_;
+
+    struct ResponseCacheEntry_{
+        uint64 hash;
+        RVector model;
+        RVector response;
+    };
+    /*! Most recently used first */
+    std::list< ResponseCacheEntry_ > responseCache_;
+    Index                   responseCacheSize_;
+    /*! Increased with every change of data or mesh, part of the hash */
+    uint64                  responseCacheVersion_;
 
 private:
     RegionManager            * regionManager_;
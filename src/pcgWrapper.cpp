@@ -0,0 +1,266 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2017 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "pcgWrapper.h"
+#include "sparsematrix.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace GIMLI{
+
+inline bool icPivotValid_(double d){ return d > 0.0 && !std::isinf(d); }
+inline bool icPivotValid_(const Complex & d){
+    return std::abs(d) > 0.0 && !std::isinf(std::abs(d));
+}
+
+//! Bilinear dot product, no conjugation for complex symmetric matrices.
+template < class ValueType >
+ValueType dotNC_(const Vector < ValueType > & a, const Vector < ValueType > & b){
+    ValueType s = 0.0;
+    for (Index i = 0; i < a.size(); i ++) s += a[i] * b[i];
+    return s;
+}
+
+PCGWrapper::PCGWrapper(RSparseMatrix & S, bool verbose)
+    : SolverWrapper(S, verbose){
+    init_();
+    SR_ = &S;
+    factorise_(S, LR_);
+}
+
+PCGWrapper::PCGWrapper(CSparseMatrix & S, bool verbose)
+    : SolverWrapper(S, verbose){
+    init_();
+    SC_ = &S;
+    factorise_(S, LC_);
+}
+
+PCGWrapper::~PCGWrapper(){
+}
+
+void PCGWrapper::init_(){
+    dummy_ = false;
+    SR_ = NULL;
+    SC_ = NULL;
+    tolerance_ = 1e-9;
+    maxiter_ = 10000;
+    jacobi_ = false;
+    iterations_ = 0;
+}
+
+int PCGWrapper::refactorise(RSparseMatrix & S){
+    if (isComplex_) return 0;
+    SR_ = &S;
+    factorise_(S, LR_);
+    return 1;
+}
+
+int PCGWrapper::refactorise(CSparseMatrix & S){
+    if (!isComplex_) return 0;
+    SC_ = &S;
+    factorise_(S, LC_);
+    return 1;
+}
+
+template < class ValueType >
+void PCGWrapper::factorise_(const SparseMatrix < ValueType > & S,
+                            Vector < ValueType > & L){
+    if (S.stype() > 0){
+        throwError(1, WHERE_AM_I + " upper triangle storage is not supported.");
+    }
+    const std::vector < int > & cP = S.vecColPtr();
+    const std::vector < int > & rI = S.vecRowIdx();
+    const Vector < ValueType > & A = S.vecVals();
+    Index n = S.size();
+    dim_ = n;
+
+    //** lower triangle of S, the diagonal is the last entry of each row
+    LPtr_.assign(n + 1, 0);
+    LIdx_.clear();
+    LPos_.clear();
+    for (Index i = 0; i < n; i ++){
+        for (int k = cP[i]; k < cP[i + 1]; k ++){
+            if (rI[k] <= (int)i){
+                LIdx_.push_back(rI[k]);
+                LPos_.push_back(k);
+            }
+        }
+        LPtr_[i + 1] = LIdx_.size();
+        if (LPtr_[i + 1] == LPtr_[i] || LIdx_.back() != (int)i){
+            throwError(1, WHERE_AM_I + " no diagonal entry in row " + str(i));
+        }
+    }
+    L.resize(LIdx_.size());
+
+    jacobi_ = false;
+    double shift = 0.0;
+    for (Index attempt = 0; attempt < 4; attempt ++){
+        bool ok = true;
+
+        for (Index i = 0; i < n && ok; i ++){
+            for (int k = LPtr_[i]; k < LPtr_[i + 1]; k ++){
+                Index j = LIdx_[k];
+
+                //** sparse dot of the rows i and j for all columns < j
+                ValueType s = 0.0;
+                int p = LPtr_[i], q = LPtr_[j];
+                int qEnd = LPtr_[j + 1] - 1;
+                while (p < k && q < qEnd){
+                    if (LIdx_[p] == LIdx_[q]){
+                        s += L[p] * L[q]; p ++; q ++;
+                    } else if (LIdx_[p] < LIdx_[q]) {
+                        p ++;
+                    } else {
+                        q ++;
+                    }
+                }
+
+                if (j == i){
+                    ValueType d = A[LPos_[k]] * (1.0 + shift) - s;
+                    if (!icPivotValid_(d)){
+                        ok = false;
+                        break;
+                    }
+                    L[k] = std::sqrt(d);
+                } else {
+                    L[k] = (A[LPos_[k]] - s) / L[qEnd];
+                }
+            }
+        }
+        if (ok) {
+            if (verbose_ && shift > 0.0) {
+                std::cout << "IC(0) with diagonal shift: " << shift << std::endl;
+            }
+            return;
+        }
+        shift = (shift == 0.0) ? 1e-3 : shift * 10.0;
+    }
+
+    if (verbose_) std::cout << "IC(0) failed, using Jacobi preconditioner." << std::endl;
+    jacobi_ = true;
+    for (Index i = 0; i < n; i ++){
+        int k = LPtr_[i + 1] - 1;
+        L[k] = A[LPos_[k]];
+    }
+}
+
+template < class ValueType >
+void PCGWrapper::precondition_(const Vector < ValueType > & L,
+                               const Vector < ValueType > & r,
+                               Vector < ValueType > & z) const {
+    Index n = dim_;
+    if (jacobi_){
+        for (Index i = 0; i < n; i ++) z[i] = r[i] / L[LPtr_[i + 1] - 1];
+        return;
+    }
+    //** L y = r
+    for (Index i = 0; i < n; i ++){
+        ValueType s = r[i];
+        int d = LPtr_[i + 1] - 1;
+        for (int k = LPtr_[i]; k < d; k ++) s -= L[k] * z[LIdx_[k]];
+        z[i] = s / L[d];
+    }
+    //** L.T z = y
+    for (Index i = n; i-- > 0;){
+        int d = LPtr_[i + 1] - 1;
+        z[i] /= L[d];
+        for (int k = LPtr_[i]; k < d; k ++) z[LIdx_[k]] -= L[k] * z[i];
+    }
+}
+
+template < class ValueType >
+int PCGWrapper::solve_(const SparseMatrix < ValueType > & S,
+                       const Vector < ValueType > & L,
+                       const Vector < ValueType > & rhs,
+                       Vector < ValueType > & x){
+    Index n = dim_;
+    if (rhs.size() != n){
+        throwLengthError(1, WHERE_AM_I + " rhs size mismatch: " + str(rhs.size())
+                            + " != " + str(n));
+    }
+    //** the old content of x is the initial guess
+    if (x.size() != n) x.resize(n);
+    Index iter = 0;
+
+    double bNorm = norml2(rhs);
+    if (bNorm == 0.0){
+        x.fill(ValueType(0.0));
+        iterations_ = iter;
+        return 1;
+    }
+
+    Vector < ValueType > r(n), z(n), p(n), q(n);
+    sparseMatrixMult(S, x, q, false);
+    for (Index i = 0; i < n; i ++) r[i] = rhs[i] - q[i];
+
+    double rNorm = norml2(r);
+    if (rNorm / bNorm < tolerance_){
+        iterations_ = iter;
+        return 1;
+    }
+
+    precondition_(L, r, z);
+    p = z;
+    ValueType rho = dotNC_(r, z);
+
+    for (Index it = 0; it < Index(maxiter_); it ++){
+        sparseMatrixMult(S, p, q, false);
+        ValueType pq = dotNC_(p, q);
+        if (pq == ValueType(0.0)) break;
+
+        ValueType alpha = rho / pq;
+        for (Index i = 0; i < n; i ++){
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        iter = it + 1;
+
+        rNorm = norml2(r);
+        if (rNorm / bNorm < tolerance_){
+            iterations_ = iter;
+            if (verbose_) std::cout << "PCG converged after " << iter
+                                    << " iterations." << std::endl;
+            return 1;
+        }
+
+        precondition_(L, r, z);
+        ValueType rhoNew = dotNC_(r, z);
+        ValueType beta = rhoNew / rho;
+        rho = rhoNew;
+        for (Index i = 0; i < n; i ++) p[i] = z[i] + beta * p[i];
+    }
+
+    iterations_ = iter;
+    std::cerr << WHERE_AM_I << " Warning! PCG not converged after "
+              << iter << " iterations, relative residual: "
+              << rNorm / bNorm << std::endl;
+    return 0;
+}
+
+int PCGWrapper::solve(const RVector & rhs, RVector & solution){
+    if (!SR_) THROW_TO_IMPL
+    return solve_(*SR_, LR_, rhs, solution);
+}
+
+int PCGWrapper::solve(const CVector & rhs, CVector & solution){
+    if (!SC_) THROW_TO_IMPL
+    return solve_(*SC_, LC_, rhs, solution);
+}
+
+} //namespace GIMLI
@@ -0,0 +1,109 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2017 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#ifndef _GIMLI_PCGWRAPPER__H
+#define _GIMLI_PCGWRAPPER__H
+
+#include "gimli.h"
+#include "solverWrapper.h"
+#include "vector.h"
+
+#include <atomic>
+#include <vector>
+
+namespace GIMLI{
+
+/*! Preconditioned conjugate gradient solver for symmetric matrices in full
+ * CRS storage. Preconditioner is an incomplete Cholesky factorization
+ * without fill-in, IC(0), on the lower triangle of S. If IC(0) breaks down,
+ * the diagonal is shifted and the factorization is repeated. Jacobi is used
+ * as last resort. Complex symmetric matrices are solved with the conjugate
+ * orthogonal variant (COCG).
+ * The memory need is a few vectors plus one triangle of S, so it can be used
+ * for problems where a direct factorization does not fit into memory.
+ * The content of solution is used as initial guess. */
+class DLLEXPORT PCGWrapper : public SolverWrapper {
+public:
+    PCGWrapper(RSparseMatrix & S, bool verbose=false);
+
+    PCGWrapper(CSparseMatrix & S, bool verbose=false);
+
+    virtual ~PCGWrapper();
+
+    static bool valid() { return true; }
+
+    virtual int solve(const RVector & rhs, RVector & solution);
+
+    virtual int solve(const CVector & rhs, CVector & solution);
+
+    /*! Recalculate the preconditioner for the new values of S. */
+    virtual int refactorise(RSparseMatrix & S);
+
+    virtual int refactorise(CSparseMatrix & S);
+
+    /*! The preconditioner is only read while solving. */
+    virtual bool threadSafeSolve() const { return true; }
+
+    /*! Set the relative residual norm to stop the iteration. Default 1e-9. */
+    void setTolerance(double tol) { tolerance_ = tol; }
+    double tolerance() const { return tolerance_; }
+
+    /*! Set the maximum number of iterations. Default 10000. */
+    void setMaxIter(Index maxIter) { maxiter_ = maxIter; }
+
+    /*! Return the number of iterations of the last finished solve.
+     * For concurrent solves it is the count of one of them. */
+    Index iterations() const { return iterations_; }
+
+protected:
+    void init_();
+
+    template < class ValueType >
+    void factorise_(const SparseMatrix < ValueType > & S,
+                    Vector < ValueType > & L);
+
+    template < class ValueType >
+    void precondition_(const Vector < ValueType > & L,
+                       const Vector < ValueType > & r,
+                       Vector < ValueType > & z) const;
+
+    template < class ValueType >
+    int solve_(const SparseMatrix < ValueType > & S,
+               const Vector < ValueType > & L,
+               const Vector < ValueType > & rhs,
+               Vector < ValueType > & x);
+
+    RSparseMatrix * SR_;
+    CSparseMatrix * SC_;
+
+    //! Lower triangle pattern of S with positions in S.vecVals()
+    std::vector < int > LPtr_;
+    std::vector < int > LIdx_;
+    std::vector < int > LPos_;
+
+    RVector LR_;
+    CVector LC_;
+
+    bool jacobi_;
+    //! Only stored after a solve, which counts in a local variable
+    std::atomic< Index > iterations_;
+};
+
+} //namespace GIMLI;
+
+#endif // _GIMLI_PCGWRAPPER__H
@@ -23,24 +23,79 @@
 #include "gimli.h"
 #include "matrix.h"
 #include "vectortemplates.h"
+#include "calculateMultiThread.h"
+#include "linSolver.h"
+#include "sparsematrix.h"
 
 namespace GIMLI{
 
+/*! Scratch vectors for \ref solveCGLSCDWWhtrans. Keep one instance
+ * alive over several solves (e.g. all Gauss-Newton iterations of an
+ * inversion) and the solver does not allocate memory after the first
+ * call as long as the problem size does not change. */
+template < class Vec > class CGLSWorkspace {
+public:
+    CGLSWorkspace() : warmStart(false), iterations(0), residual(0.0){}
+
+    /*! Resize all vectors. Nothing is allocated for unchanged sizes. */
+    void resize(Index nData, Index nModel, Index nConst){
+        dtd.resize(nData); z.resize(nData); q.resize(nData); tmpD.resize(nData);
+        cdx.resize(nModel); p.resize(nModel); r.resize(nModel); tmpM.resize(nModel);
+        wc2.resize(nConst); cx.resize(nConst); cp.resize(nConst); tmpC.resize(nConst);
+    }
+
+    /*! dWeight * td, z, S * p and a temporary; size nData */
+    Vec dtd, z, q, tmpD;
+    /*! Constant rhs part, search direction, residual and a temporary; size nModel */
+    Vec cdx, p, r, tmpM;
+    /*! wc * wc, C * (wm * x), C * (wm * p) and a temporary; size nConst */
+    Vec wc2, cx, cp, tmpC;
+
+    /*! Set this if the next solve starts with the solution x of the last
+     * solve with this workspace and only lambda has been changed. The
+     * products S * x and C * x are then taken from the last solve.
+     * It is reset by the solver. */
+    bool warmStart;
+
+    /*! Iteration count and final squared residual norm of the last solve */
+    Index iterations;
+    double residual;
+};
+
+/*! Calculate r = S.T * (z * dtd) / tm - C.T * (wc2 * cx) * wm * lambda - cdx
+ * with the scratch vectors of ws. Return dot(r, r). */
+template < class Vec >
+double cglsResidual_(const MatrixBase & S, const MatrixBase & C,
+                     const Vec & z, const Vec & tm, const Vec & wm,
+                     double lambda, CGLSWorkspace< Vec > & ws){
+    Index nData = z.size(), nModel = tm.size(), nConst = ws.cx.size();
+
+    for (Index i = 0; i < nData; i ++) ws.tmpD[i] = z[i] * ws.dtd[i];
+    for (Index i = 0; i < nConst; i ++) ws.tmpC[i] = ws.wc2[i] * ws.cx[i];
+    S.transMult(ws.tmpD, ws.r);
+    C.transMult(ws.tmpC, ws.tmpM);
+
+    double normR2 = 0.0;
+    for (Index i = 0; i < nModel; i ++){
+        ws.r[i] = ws.r[i] / tm[i] - ws.tmpM[i] * wm[i] * lambda - ws.cdx[i];
+        normR2 += ws.r[i] * ws.r[i];
+    }
+    return normR2;
+}
+
 template < class Vec >
 int solveCGLSCDWWhtrans(const MatrixBase & S, const MatrixBase & C,
                         const Vec & dWeight, const Vec & b, Vec & x,
                         const Vec & wc, const Vec & wm,
                         const Vec & tm, const Vec & td,
                         double lambda, const Vec & roughness,
+                        CGLSWorkspace< Vec > & ws,
                         int maxIter=200, double tol=-1.0,
                         bool verbose=false){ //ALLOW_PYTHON_THREADS
 
-    uint nData = b.size();
-    uint nModel = x.size();
-    uint nConst = C.rows();
-
-//     __MS(S.rtti())
-//     __MS(C.rtti())
+    Index nData = b.size();
+    Index nModel = x.size();
+    Index nConst = C.rows();
 
     if (S.rows() != nData)  std::cerr << "J.rows != nData " << S.rows() << " / " << nData << std::endl;
     if (S.cols() != nModel) std::cerr << "J.cols != nModel " << S.cols() << " / " << nModel << std::endl;
@@ -52,50 +107,73 @@ int solveCGLSCDWWhtrans(const MatrixBase & S, const MatrixBase & C,
     if (td.size() != nData) std::cerr << "td.size() != nData " << td.size() << " / " << nData << std::endl;
     if (roughness.size() != nConst) std::cerr << "roughness.size != nConst " << roughness.size() << " / " << nConst << std::endl;
 
-//Ch  Vec cdx(transMult(C, Vec(wc * wc * (C * Vec(wm * deltaX)))) * wm * lambda); // nModel
-    Vec cdx(transMult(C, Vec(wc * roughness)) * wm * lambda); // nModel
-    Vec z((b - S * Vec(x / tm) * td) * dWeight); // nData
-    Vec p(transMult(S, Vec(z * dWeight * td)) / tm - cdx - transMult(C, Vec(wc * wc * (C * Vec(wm * x)))) * wm * lambda);// nModel
-    Vec r(transMult(S, Vec(b * dWeight * dWeight * td)) / tm - cdx); // nModel
+    bool warm = ws.warmStart && ws.z.size() == nData && ws.cx.size() == nConst;
+    ws.warmStart = false;
+
+    ws.resize(nData, nModel, nConst);
+    for (Index i = 0; i < nData; i ++) ws.dtd[i] = dWeight[i] * td[i];
+    for (Index i = 0; i < nConst; i ++) ws.wc2[i] = wc[i] * wc[i];
+
+    //** cdx = C.T * (wc * roughness) * wm * lambda
+    for (Index i = 0; i < nConst; i ++) ws.tmpC[i] = wc[i] * roughness[i];
+    C.transMult(ws.tmpC, ws.cdx);
+    for (Index i = 0; i < nModel; i ++) ws.cdx[i] *= wm[i] * lambda;
 
     double accuracy = tol;
-    if (accuracy < 0.0) accuracy = max(TOLERANCE, 1e-08 * dot(r, r));
-    r = p;
+    if (accuracy < 0.0) {
+        //** r0 = S.T * (b * dWeight^2 * td) / tm - cdx
+        for (Index i = 0; i < nData; i ++) ws.tmpD[i] = b[i] * dWeight[i] * ws.dtd[i];
+        S.transMult(ws.tmpD, ws.r);
+        double normR0 = 0.0;
+        for (Index i = 0; i < nModel; i ++){
+            double ri = ws.r[i] / tm[i] - ws.cdx[i];
+            normR0 += ri * ri;
+        }
+        accuracy = max(TOLERANCE, 1e-08 * normR0);
+    }
 
-    double normR2 = dot(r, r), normR2old = 0.0;
-    double alpha = 0.0, beta = 0.0;
+    if (!warm){
+        //** z = (b - S * (x / tm) * td) * dWeight
+        for (Index i = 0; i < nModel; i ++) ws.tmpM[i] = x[i] / tm[i];
+        S.mult(ws.tmpM, ws.z);
+        for (Index i = 0; i < nData; i ++) ws.z[i] = b[i] * dWeight[i] - ws.z[i] * ws.dtd[i];
 
-    int count = 0;
+        //** cx = C * (wm * x), updated together with x
+        for (Index i = 0; i < nModel; i ++) ws.tmpM[i] = wm[i] * x[i];
+        C.mult(ws.tmpM, ws.cx);
+    }
 
-    Vec q(nData);
-    Vec wcp(nConst); // nBounds
+    double normR2 = cglsResidual_(S, C, ws.z, tm, wm, lambda, ws), normR2old = 0.0;
+    ws.p = ws.r;
+    double alpha = 0.0, beta = 0.0;
 
-//     std::cout.precision(14);
-//     std::cout << 0 << "  " << accuracy << std::endl;
+    int count = 0;
 
     while (count < maxIter && normR2 > accuracy){
         count ++;
-        q = S * Vec(p / tm) * dWeight * td;
-        wcp = wc * (C * Vec(p * wm));
-
-        alpha = normR2 / (dot(q, q) + lambda * dot(wcp, wcp));
-        x += p * alpha;
-        if((count % 10) == -1) { // TOM
-            z = b - S * Vec(x / tm) * td; // z exakt durch extra Mult.
-            z *= dWeight;
-        } else {
-            z -= q * alpha;
+        //** q = S * (p / tm) * dWeight * td
+        for (Index i = 0; i < nModel; i ++) ws.tmpM[i] = ws.p[i] / tm[i];
+        S.mult(ws.tmpM, ws.q);
+        double qq = 0.0;
+        for (Index i = 0; i < nData; i ++){
+            ws.q[i] *= ws.dtd[i];
+            qq += ws.q[i] * ws.q[i];
         }
-        r = transMult(S, Vec(z * dWeight * td)) / tm - transMult(C, Vec(wc * wc * (C * Vec(wm * x)))) * wm * lambda - cdx;
+        //** cp = C * (p * wm), |wc * cp|^2
+        for (Index i = 0; i < nModel; i ++) ws.tmpM[i] = ws.p[i] * wm[i];
+        C.mult(ws.tmpM, ws.cp);
+        double wcp2 = 0.0;
+        for (Index i = 0; i < nConst; i ++) wcp2 += ws.wc2[i] * ws.cp[i] * ws.cp[i];
+
+        alpha = normR2 / (qq + lambda * wcp2);
+        for (Index i = 0; i < nModel; i ++) x[i] += ws.p[i] * alpha;
+        for (Index i = 0; i < nConst; i ++) ws.cx[i] += ws.cp[i] * alpha;
+        for (Index i = 0; i < nData; i ++) ws.z[i] -= ws.q[i] * alpha;
 
         normR2old = normR2;
-        normR2 = dot(r, r);
+        normR2 = cglsResidual_(S, C, ws.z, tm, wm, lambda, ws);
         beta = normR2 / normR2old;
-        p = r + p * beta;
-
-//         if((count < 200)) {
-//             std::cout << count << "  " << normR2 << std::endl;
-//         }
+        for (Index i = 0; i < nModel; i ++) ws.p[i] = ws.r[i] + ws.p[i] * beta;
 
 #ifndef _WIN32
         if (verbose) std::cout << "\r[ " << count << "/" << normR2 << "]\t";
@@ -104,6 +182,203 @@ int solveCGLSCDWWhtrans(const MatrixBase & S, const MatrixBase & C,
 #ifdef _WIN32
     if (verbose) std::cout << "[ " << count << "/" << normR2 << "]\t" << std::endl;
 #endif
+    ws.iterations = count;
+    ws.residual = normR2;
+    return 1;
+}
+
+/*! Convenience call of \ref solveCGLSCDWWhtrans with a temporary workspace. */
+template < class Vec >
+int solveCGLSCDWWhtrans(const MatrixBase & S, const MatrixBase & C,
+                        const Vec & dWeight, const Vec & b, Vec & x,
+                        const Vec & wc, const Vec & wm,
+                        const Vec & tm, const Vec & td,
+                        double lambda, const Vec & roughness,
+                        int maxIter=200, double tol=-1.0,
+                        bool verbose=false){ //ALLOW_PYTHON_THREADS
+    CGLSWorkspace< Vec > ws;
+    return solveCGLSCDWWhtrans(S, C, dWeight, b, x, wc, wm, tm, td,
+                               lambda, roughness, ws, maxIter, tol, verbose);
+}
+
+template < class Vec > class CGLSLambdaMT : public BaseCalcMT {
+public:
+    CGLSLambdaMT(const MatrixBase & S, const MatrixBase & C,
+                 const Vec & dWeight, const Vec & b,
+                 const Vec & wc, const Vec & wm, const Vec & tm, const Vec & td,
+                 const Vec & roughness, const std::vector < double > & lambdas,
+                 std::vector < Vec > & x, std::vector < CGLSWorkspace< Vec > > & ws,
+                 int maxIter, double tol, bool parallel)
+    : BaseCalcMT(), S_(&S), C_(&C), dWeight_(&dWeight), b_(&b), wc_(&wc),
+      wm_(&wm), tm_(&tm), td_(&td), roughness_(&roughness), lambdas_(&lambdas),
+      x_(&x), ws_(&ws), maxIter_(maxIter), tol_(tol), parallel_(parallel){
+    }
+
+    virtual ~CGLSLambdaMT(){}
+
+    virtual void calc(Index tNr=0){
+        //** if the lambdas run in parallel already, the products of
+        //** S and C stay on this thread
+        LocalThreadCount single(parallel_ ? 1 : localThreadCount());
+        for (Index i = start_; i < end_; i ++){
+            solveCGLSCDWWhtrans(*S_, *C_, *dWeight_, *b_, (*x_)[i],
+                                *wc_, *wm_, *tm_, *td_,
+                                (*lambdas_)[i], *roughness_, (*ws_)[i],
+                                maxIter_, tol_, false);
+        }
+    }
+
+protected:
+    const MatrixBase * S_;
+    const MatrixBase * C_;
+    const Vec * dWeight_;
+    const Vec * b_;
+    const Vec * wc_;
+    const Vec * wm_;
+    const Vec * tm_;
+    const Vec * td_;
+    const Vec * roughness_;
+    const std::vector < double > * lambdas_;
+    std::vector < Vec > * x_;
+    std::vector < CGLSWorkspace< Vec > > * ws_;
+    int maxIter_;
+    double tol_;
+    bool parallel_;
+};
+
+/*! Solve \ref solveCGLSCDWWhtrans for several regularization strengths
+ * lambdas[i] concurrently on nThreads threads. x[i] are the start models
+ * and the solutions, ws[i] the workspaces. The products of S and C need
+ * to be safe for concurrent calls. They run single threaded while the
+ * lambdas are solved on several threads, see \ref setLocalThreadCount. */
+template < class Vec >
+void solveCGLSCDWWhtrans(const MatrixBase & S, const MatrixBase & C,
+                         const Vec & dWeight, const Vec & b,
+                         std::vector < Vec > & x,
+                         const Vec & wc, const Vec & wm,
+                         const Vec & tm, const Vec & td,
+                         const std::vector < double > & lambdas,
+                         const Vec & roughness,
+                         std::vector < CGLSWorkspace< Vec > > & ws,
+                         int maxIter, double tol, Index nThreads){
+    if (x.size() != lambdas.size() || ws.size() != lambdas.size()){
+        throwLengthError(1, WHERE_AM_I + " " + toStr(lambdas.size()) + " lambdas, "
+                         + toStr(x.size()) + " models, " + toStr(ws.size()) + " workspaces");
+    }
+    if (lambdas.empty()) return;
+
+    nThreads = max(Index(1), min(nThreads, Index(lambdas.size())));
+    distributeCalc(CGLSLambdaMT< Vec >(S, C, dWeight, b, wc, wm, tm, td,
+                                       roughness, lambdas, x, ws, maxIter, tol,
+                                       nThreads > 1),
+                   lambdas.size(), nThreads);
+}
+
+/*! Data space (Occam) variant of \ref solveCGLSCDWWhtrans for nData << nModel.
+ * With G = diag(dWeight * td) S diag(1 / tm) and W = diag(wc) C diag(wm)
+ * the same normal equations
+ * (G^T G + lambda W^T W) x = G^T (dWeight * b) - lambda W^T roughness
+ * are solved directly by x = x0 + M^-1 G^T (G M^-1 G^T + lambda I)^-1 (dWeight * b - G x0)
+ * with M = W^T W + eps I and x0 = -M^-1 W^T roughness.
+ * M is factorized once by \ref LinSolver, the dense nData x nData system
+ * by \ref solveCholesky. eps (relative to the mean diagonal of W^T W)
+ * makes M regular for smoothness constraints with a null space. The bias
+ * of this shift is removed by a few steps of iterative refinement with the
+ * unshifted normal equations.
+ * x is only the result. Return 0 if the data space system is singular. */
+inline int solveDataSpaceCDWWhtrans(const RMatrix & S, const RSparseMapMatrix & C,
+                                    const RVector & dWeight, const RVector & b, RVector & x,
+                                    const RVector & wc, const RVector & wm,
+                                    const RVector & tm, const RVector & td,
+                                    double lambda, const RVector & roughness,
+                                    double eps=1e-6, bool verbose=false){
+    Index nData = b.size();
+    Index nModel = S.cols();
+    if (S.rows() != nData || C.cols() != nModel || wc.size() != C.rows() ||
+        wm.size() != nModel || tm.size() != nModel || td.size() != nData ||
+        dWeight.size() != nData || roughness.size() != C.rows()){
+        throwLengthError(1, WHERE_AM_I + " size mismatch: J " + toStr(S.rows()) + "x"
+                         + toStr(S.cols()) + " C " + toStr(C.rows()) + "x"
+                         + toStr(C.cols()) + " data " + toStr(nData));
+    }
+    RVector dtd(dWeight * td);
+
+    //** M = W^T W, every constraint row contributes its outer product
+    RSparseMapMatrix M(nModel, nModel);
+    RSparseMapMatrix::const_iterator it = C.begin();
+    std::vector < std::pair< Index, double > > row;
+    while (it != C.end()){
+        Index r = C.idx1(it);
+        row.clear();
+        for (; it != C.end() && C.idx1(it) == r; it ++){
+            row.push_back(std::make_pair(C.idx2(it), C.val(it) * wm[C.idx2(it)] * wc[r]));
+        }
+        for (Index i = 0; i < row.size(); i ++){
+            for (Index j = 0; j < row.size(); j ++){
+                M.addVal(row[i].first, row[j].first, row[i].second * row[j].second);
+            }
+        }
+    }
+    double diagMean = 0.0;
+    for (Index i = 0; i < nModel; i ++) diagMean += M.getVal(i, i);
+    diagMean /= max(Index(1), nModel);
+    if (diagMean <= 0.0) diagMean = 1.0;
+    double shift = eps * diagMean;
+    for (Index i = 0; i < nModel; i ++) M.addVal(i, i, shift);
+
+    LinSolver solver(M, verbose);
+
+    //** x0 = -M^-1 W^T roughness
+    RVector wTr(C.transMult(RVector(wc * roughness)) * wm);
+    RVector x0(solver.solve(wTr));
+    x0 *= -1.0;
+
+    //** K = G M^-1 G^T, blockwise over the data to bound the memory
+    RMatrix K(nData, nData);
+    Index nb = max(Index(1), min(nData, Index(8000000 / max(Index(1), nModel))));
+    RMatrix B, Y, T;
+    for (Index d0 = 0; d0 < nData; d0 += nb){
+        Index d1 = min(nData, d0 + nb);
+        B.resize(d1 - d0, nModel);
+        for (Index i = d0; i < d1; i ++){
+            B[i - d0] = S[i] * dtd[i] / tm;
+        }
+        solver.solve(B, Y);
+        for (Index i = 0; i < Y.rows(); i ++) Y[i] /= tm;
+        matMult(S, Y, T, false, true); // nData x nb
+        for (Index i = 0; i < nData; i ++){
+            for (Index j = d0; j < d1; j ++) K[i][j] = T[i][j - d0] * dtd[i];
+        }
+    }
+    for (Index i = 0; i < nData; i ++) K[i][i] += lambda;
+    RMatrix KFactor(K);
+
+    RVector rhs(dWeight * b - S.mult(RVector(x0 / tm)) * dtd);
+    RVector alpha(nData);
+    if (!solveCholesky(KFactor, alpha, rhs)) {
+        std::cerr << WHERE_AM_I << " data space system not positive definite" << std::endl;
+        return 0;
+    }
+
+    RVector xs(x0 + solver.solve(RVector(S.transMult(RVector(alpha * dtd)) / tm)));
+
+    //** refinement: res = G^T (d - G x) - lambda (W^T W x + W^T roughness)
+    //** and x += (G^T G + lambda M)^-1 res with
+    //** (G^T G + lambda M)^-1 = (M^-1 - M^-1 G^T K^-1 G M^-1) / lambda
+    for (Index iter = 0; iter < 3 && shift > 0.0 && lambda != 0.0; iter ++){
+        RVector z(dWeight * b - S.mult(RVector(xs / tm)) * dtd);
+        RVector res(S.transMult(RVector(z * dtd)) / tm -
+                    (M.mult(xs) - xs * shift + wTr) * lambda);
+        RVector u(solver.solve(res));
+        KFactor = K;
+        if (!solveCholesky(KFactor, alpha, RVector(S.mult(RVector(u / tm)) * dtd))) break;
+        RVector dx((u - solver.solve(RVector(S.transMult(RVector(alpha * dtd)) / tm))) / lambda);
+        xs += dx;
+        if (norml2(dx) <= 1e-14 * norml2(xs)) break;
+    }
+    x = xs;
+    if (verbose) std::cout << "data space step: " << nData << " x " << nData
+                           << " system solved." << std::endl;
     return 1;
 }
 
@@ -17,6 +17,7 @@
  ******************************************************************************/
 
 #include "solverWrapper.h"
+#include "matrix.h"
 #include "sparsematrix.h"
 
 namespace GIMLI{
@@ -47,6 +48,27 @@ SolverWrapper::SolverWrapper(const CSparseMatrix & S,
 
 SolverWrapper::~SolverWrapper(){ }
 
+template < class ValueType >
+int solveRowWise_(SolverWrapper * solver,
+                  const Matrix < ValueType > & B, Matrix < ValueType > & X){
+    X.resize(B.rows(), B.cols());
+    int ret = 1;
+    for (Index i = 0; i < B.rows(); i ++){
+        Vector < ValueType > x(X[i]);
+        ret = solver->solve(B[i], x);
+        X[i] = x;
+    }
+    return ret;
+}
+
+int SolverWrapper::solve(const RMatrix & B, RMatrix & X){
+    return solveRowWise_(this, B, X);
+}
+
+int SolverWrapper::solve(const CMatrix & B, CMatrix & X){
+    return solveRowWise_(this, B, X);
+}
+
 
 } //namespace GIMLI;
 
@@ -37,6 +37,24 @@ public:
 
     virtual int solve(const CVector & rhs, CVector & solution){ THROW_TO_IMPL return 0;}
 
+    /*! Solve for a block of right hand sides, one per row of B, so that
+     * X[i] is the solution for B[i]. The default solves row by row.
+     * Iterative solvers start with the old content of X if it fits. */
+    virtual int solve(const RMatrix & B, RMatrix & X);
+
+    virtual int solve(const CMatrix & B, CMatrix & X);
+
+    /*! Factorize the new values of S with the symbolic analysis of the
+     * initial matrix. S need the same sparsity pattern. Return 0 if the
+     * solver cannot do this and need a full initialization. */
+    virtual int refactorise(RSparseMatrix & S){ return 0; }
+
+    virtual int refactorise(CSparseMatrix & S){ return 0; }
+
+    /*! Return true if solve can be called concurrently from several
+     * threads for the same factorization. */
+    virtual bool threadSafeSolve() const { return false; }
+
 protected:
 
     bool dummy_;
@@ -0,0 +1,427 @@
+/******************************************************************************
+ *   Copyright (C) 2006-2017 by the GIMLi development team                    *
+ *   Carsten Rücker carsten@resistivity.net                                   *
+ *                                                                            *
+ *   Licensed under the Apache License, Version 2.0 (the "License");          *
+ *   you may not use this file except in compliance with the License.         *
+ *   You may obtain a copy of the License at                                  *
+ *                                                                            *
+ *       http://www.apache.org/licenses/LICENSE-2.0                           *
+ *                                                                            *
+ *   Unless required by applicable law or agreed to in writing, software      *
+ *   distributed under the License is distributed on an "AS IS" BASIS,        *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. *
+ *   See the License for the specific language governing permissions and      *
+ *   limitations under the License.                                           *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "sparsematrix.h"
+#include "calculateMultiThread.h"
+
+#include <algorithm>
+
+#if USE_BOOST_THREAD
+    #include <boost/thread.hpp>
+    static boost::mutex __transposePatternMutex__;
+#else
+    #include <mutex>
+    static std::mutex __transposePatternMutex__;
+#endif
+
+namespace GIMLI{
+
+//! Minimum amount of nonzeros per thread for the threaded sparse products.
+static const Index __SPARSE_MT_MIN_VALS__ = 50000;
+
+template < class ValueType > class SparseMatrixMultMT : public BaseCalcMT{
+public:
+    SparseMatrixMultMT(const SparseMatrix < ValueType > & A,
+                       const Vector < ValueType > & a,
+                       Vector < ValueType > & ret, bool trans)
+    : BaseCalcMT(), A_(&A), a_(&a), ret_(&ret), trans_(trans){
+    }
+
+    virtual ~SparseMatrixMultMT(){}
+
+    virtual void calc(Index tNr=0){
+        A_->multRows(*a_, *ret_, start_, end_, trans_);
+    }
+
+protected:
+    const SparseMatrix < ValueType > * A_;
+    const Vector < ValueType >       * a_;
+    Vector < ValueType >             * ret_;
+    bool trans_;
+};
+
+template < class ValueType >
+void sparseMatrixMult_(const SparseMatrix < ValueType > & A,
+                       const Vector < ValueType > & a,
+                       Vector < ValueType > & ret, bool trans, Index nThreadsMax){
+    if (trans || A.stype() != 0){
+#if USE_BOOST_THREAD
+        boost::mutex::scoped_lock lock(__transposePatternMutex__);
+#else
+        std::unique_lock < std::mutex > lock(__transposePatternMutex__);
+#endif
+        A.updateTransposePattern();
+    }
+
+    if (nThreadsMax == 0) nThreadsMax = threadCount();
+    Index nThreads = std::min(nThreadsMax,
+                              std::max(Index(1), A.nVals() / __SPARSE_MT_MIN_VALS__));
+    nThreads = std::max(Index(1), std::min(nThreads, ret.size()));
+
+    distributeCalc(SparseMatrixMultMT< ValueType >(A, a, ret, trans),
+                   ret.size(), nThreads);
+}
+
+template < class ValueType > class SparseMatrixBlockMultMT : public BaseCalcMT{
+public:
+    SparseMatrixBlockMultMT(const SparseMatrix < ValueType > & A,
+                            const Matrix < ValueType > & X,
+                            Matrix < ValueType > & ret)
+    : BaseCalcMT(), A_(&A), X_(&X), ret_(&ret){
+    }
+
+    virtual ~SparseMatrixBlockMultMT(){}
+
+    /*! Rows [start_, end_) of A * X[j] for all j. Every matrix row is
+     * read once and applied to all vectors. */
+    virtual void calc(Index tNr=0){
+        const int * cP = &A_->vecColPtr()[0];
+        const int * rI = A_->vecRowIdx().empty() ? 0 : &A_->vecRowIdx()[0];
+        const ValueType * v = A_->vecVals().size() ? &A_->vecVals()[0] : 0;
+
+        Index nB = X_->rows();
+        std::vector < const ValueType * > x(nB);
+        for (Index j = 0; j < nB; j ++) x[j] = &(*X_)[j][0];
+        std::vector < ValueType > s(nB);
+        Index end = std::min(end_, ret_->cols());
+
+        for (Index i = start_; i < end; i ++){
+            std::fill(s.begin(), s.end(), ValueType(0.0));
+            for (int k = cP[i]; k < cP[i + 1]; k ++){
+                const ValueType & vk = v[k];
+                int c = rI[k];
+                for (Index j = 0; j < nB; j ++) s[j] += vk * x[j][c];
+            }
+            for (Index j = 0; j < nB; j ++) (*ret_)[j][i] = s[j];
+        }
+    }
+
+protected:
+    const SparseMatrix < ValueType > * A_;
+    const Matrix < ValueType >       * X_;
+    Matrix < ValueType >             * ret_;
+};
+
+template < class ValueType >
+void sparseMatrixMult_(const SparseMatrix < ValueType > & A,
+                       const Matrix < ValueType > & X,
+                       Matrix < ValueType > & ret, Index nThreadsMax){
+    ret.resize(X.rows(), A.rows());
+    if (X.rows() == 0) return;
+
+    if (X.cols() < A.cols()){
+        throwLengthError(1, WHERE_AM_I + " SparseMatrix cols(): " + toStr(A.cols()) +
+                            " X.cols(): " + toStr(X.cols()));
+    }
+
+    if (A.stype() != 0){
+        //** symmetric storage need the mirrored triangle, see multRows
+        for (Index j = 0; j < X.rows(); j ++){
+            sparseMatrixMult_(A, X[j], ret[j], false, nThreadsMax);
+        }
+        return;
+    }
+
+    if (nThreadsMax == 0) nThreadsMax = threadCount();
+    Index nThreads = std::min(nThreadsMax,
+                              std::max(Index(1), A.nVals() * X.rows() / __SPARSE_MT_MIN_VALS__));
+    nThreads = std::max(Index(1), std::min(nThreads, A.rows()));
+
+    distributeCalc(SparseMatrixBlockMultMT< ValueType >(A, X, ret),
+                   A.rows(), nThreads);
+}
+
+class SparsityPatternMT : public BaseCalcMT{
+public:
+    SparsityPatternMT(const std::vector < int > & cellNodePtr,
+                      const std::vector < int > & cellNodes,
+                      const std::vector < int > & nodeCellPtr,
+                      const std::vector < int > & nodeCells,
+                      std::vector < int > & colPtr,
+                      std::vector < int > * rowIdx)
+    : BaseCalcMT(), cellNodePtr_(&cellNodePtr), cellNodes_(&cellNodes),
+      nodeCellPtr_(&nodeCellPtr), nodeCells_(&nodeCells),
+      colPtr_(&colPtr), rowIdx_(rowIdx){
+    }
+
+    virtual ~SparsityPatternMT(){}
+
+    /*! Collect the sorted unique node ids of all cells touching the nodes
+     * [start_, end_). Count them into colPtr[i + 1] if no rowIdx is given,
+     * or fill them into rowIdx at colPtr[i] otherwise. */
+    virtual void calc(Index tNr=0){
+        const int * cNP = &(*cellNodePtr_)[0];
+        const int * cN  = &(*cellNodes_)[0];
+        const int * nCP = &(*nodeCellPtr_)[0];
+        const int * nC  = &(*nodeCells_)[0];
+
+        std::vector < int > row;
+        row.reserve(128);
+
+        for (Index i = start_; i < end_; i ++){
+            row.clear();
+            for (int c = nCP[i]; c < nCP[i + 1]; c ++){
+                row.insert(row.end(), cN + cNP[nC[c]], cN + cNP[nC[c] + 1]);
+            }
+            std::sort(row.begin(), row.end());
+            row.erase(std::unique(row.begin(), row.end()), row.end());
+
+            if (rowIdx_){
+                std::copy(row.begin(), row.end(), rowIdx_->begin() + (*colPtr_)[i]);
+            } else {
+                (*colPtr_)[i + 1] = row.size();
+            }
+        }
+    }
+
+protected:
+    const std::vector < int >   * cellNodePtr_;
+    const std::vector < int >   * cellNodes_;
+    const std::vector < int >   * nodeCellPtr_;
+    const std::vector < int >   * nodeCells_;
+    std::vector < int >         * colPtr_;
+    std::vector < int >         * rowIdx_;
+};
+
+void createSparsityPattern(const Mesh & mesh,
+                           std::vector < int > & colPtr,
+                           std::vector < int > & rowIdx){
+    Index nNodes = mesh.nodeCount();
+    Index nCells = mesh.cellCount();
+
+    colPtr.assign(nNodes + 1, 0);
+    rowIdx.clear();
+    if (nCells == 0) return;
+
+    //** cell to node and node to cell connectivity as flat arrays
+    std::vector < int > cellNodePtr(nCells + 1, 0);
+    for (Index c = 0; c < nCells; c ++){
+        cellNodePtr[c + 1] = cellNodePtr[c] + mesh.cell(c).nodeCount();
+    }
+
+    std::vector < int > cellNodes(cellNodePtr[nCells]);
+    std::vector < int > nodeCellPtr(nNodes + 1, 0);
+    for (Index c = 0; c < nCells; c ++){
+        const Cell & cell = mesh.cell(c);
+        for (Index j = 0; j < cell.nodeCount(); j ++){
+            cellNodes[cellNodePtr[c] + j] = cell.node(j).id();
+            nodeCellPtr[cell.node(j).id() + 1] ++;
+        }
+    }
+    for (Index i = 0; i < nNodes; i ++) nodeCellPtr[i + 1] += nodeCellPtr[i];
+
+    std::vector < int > nodeCells(nodeCellPtr[nNodes]);
+    {
+        std::vector < int > pos(nodeCellPtr.begin(), nodeCellPtr.end() - 1);
+        for (Index c = 0; c < nCells; c ++){
+            for (int j = cellNodePtr[c]; j < cellNodePtr[c + 1]; j ++){
+                nodeCells[pos[cellNodes[j]] ++] = c;
+            }
+        }
+    }
+
+    Index nThreads = std::max(Index(1), std::min(threadCount(),
+                                                 nNodes / 10000));
+
+    //** first pass: count the row sizes
+    distributeCalc(SparsityPatternMT(cellNodePtr, cellNodes,
+                                     nodeCellPtr, nodeCells,
+                                     colPtr, 0), nNodes, nThreads);
+
+    for (Index i = 0; i < nNodes; i ++) colPtr[i + 1] += colPtr[i];
+
+    //** second pass: fill the column indices
+    rowIdx.resize(colPtr[nNodes]);
+    distributeCalc(SparsityPatternMT(cellNodePtr, cellNodes,
+                                     nodeCellPtr, nodeCells,
+                                     colPtr, &rowIdx), nNodes, nThreads);
+}
+
+void MeshSparsityPattern::build(const Mesh & mesh){
+    createSparsityPattern(mesh, colPtr_, rowIdx_);
+    rows_ = 0;
+    for (Index i = 0; i < rowIdx_.size(); i ++){
+        rows_ = std::max(rows_, Index(rowIdx_[i] + 1));
+    }
+    if (rowIdx_.empty()) rows_ = size();
+
+    Index nCells = mesh.cellCount();
+    cellPtr_.assign(nCells + 1, 0);
+    for (Index c = 0; c < nCells; c ++){
+        Index n = mesh.cell(c).nodeCount();
+        cellPtr_[c + 1] = cellPtr_[c] + n * n;
+    }
+
+    //** rows are sorted, so the positions can be found by bisection
+    cellPos_.resize(cellPtr_[nCells]);
+    for (Index c = 0; c < nCells; c ++){
+        const Cell & cell = mesh.cell(c);
+        Index n = cell.nodeCount();
+        int * pos = &cellPos_[cellPtr_[c]];
+
+        for (Index a = 0; a < n; a ++){
+            Index row = cell.node(a).id();
+            const int * rStart = &rowIdx_[0] + colPtr_[row];
+            const int * rEnd = &rowIdx_[0] + colPtr_[row + 1];
+
+            for (Index b = 0; b < n; b ++){
+                const int * it = std::lower_bound(rStart, rEnd,
+                                                  int(cell.node(b).id()));
+                pos[a * n + b] = it - &rowIdx_[0];
+            }
+        }
+    }
+    buildColours_(mesh);
+}
+
+void MeshSparsityPattern::buildColours_(const Mesh & mesh){
+    Index nNodes = mesh.nodeCount();
+    Index nCells = mesh.cellCount();
+
+    //** node to cell connectivity as flat arrays
+    std::vector < int > nodeCellPtr(nNodes + 1, 0);
+    for (Index c = 0; c < nCells; c ++){
+        const Cell & cell = mesh.cell(c);
+        for (Index j = 0; j < cell.nodeCount(); j ++) nodeCellPtr[cell.node(j).id() + 1] ++;
+    }
+    for (Index i = 0; i < nNodes; i ++) nodeCellPtr[i + 1] += nodeCellPtr[i];
+
+    std::vector < int > nodeCells(nodeCellPtr[nNodes]);
+    {
+        std::vector < int > pos(nodeCellPtr.begin(), nodeCellPtr.end() - 1);
+        for (Index c = 0; c < nCells; c ++){
+            const Cell & cell = mesh.cell(c);
+            for (Index j = 0; j < cell.nodeCount(); j ++) nodeCells[pos[cell.node(j).id()] ++] = c;
+        }
+    }
+
+    //** greedy: take the smallest colour that no cell sharing a node has,
+    //** used[colour] == c marks the colours taken by the neighbours of c
+    std::vector < int > colour(nCells, -1);
+    std::vector < int > used;
+    for (Index c = 0; c < nCells; c ++){
+        const Cell & cell = mesh.cell(c);
+        for (Index j = 0; j < cell.nodeCount(); j ++){
+            Index n = cell.node(j).id();
+            for (int k = nodeCellPtr[n]; k < nodeCellPtr[n + 1]; k ++){
+                int col = colour[nodeCells[k]];
+                if (col >= 0) used[col] = c;
+            }
+        }
+        int col = 0;
+        while (col < (int)used.size() && used[col] == (int)c) col ++;
+        if (col == (int)used.size()) used.push_back(-1);
+        colour[c] = col;
+    }
+
+    colourPtr_.assign(used.size() + 1, 0);
+    for (Index c = 0; c < nCells; c ++) colourPtr_[colour[c] + 1] ++;
+    for (Index i = 0; i < used.size(); i ++) colourPtr_[i + 1] += colourPtr_[i];
+
+    colourCells_.resize(nCells);
+    std::vector < int > pos(colourPtr_.begin(), colourPtr_.end() - 1);
+    for (Index c = 0; c < nCells; c ++) colourCells_[pos[colour[c]] ++] = c;
+}
+
+class CellElementMatricesMT : public BaseCalcMT{
+public:
+    CellElementMatricesMT(const Mesh & mesh, const std::vector < int > & cellPtr,
+                          std::vector < double > & stiffness,
+                          std::vector < double > & mass)
+    : BaseCalcMT(), mesh_(&mesh), cellPtr_(&cellPtr),
+      stiffness_(&stiffness), mass_(&mass){
+    }
+
+    virtual ~CellElementMatricesMT(){}
+
+    virtual void calc(Index tNr=0){
+        ElementMatrix < double > Se;
+        for (Index c = start_; c < end_; c ++){
+            const Cell & cell = mesh_->cell(c);
+            Index n = cell.nodeCount();
+            double * K = &(*stiffness_)[(*cellPtr_)[c]];
+            double * M = &(*mass_)[(*cellPtr_)[c]];
+
+            Se.ux2uy2uz2(cell);
+            for (Index a = 0; a < n; a ++){
+                for (Index b = 0; b < n; b ++) K[a * n + b] = Se.getVal(a, b);
+            }
+            Se.u2(cell);
+            for (Index a = 0; a < n; a ++){
+                for (Index b = 0; b < n; b ++) M[a * n + b] = Se.getVal(a, b);
+            }
+        }
+    }
+
+protected:
+    const Mesh                  * mesh_;
+    const std::vector < int >   * cellPtr_;
+    std::vector < double >      * stiffness_;
+    std::vector < double >      * mass_;
+};
+
+void MeshSparsityPattern::buildElementMatrices(const Mesh & mesh){
+    if (!valid() || cellCount() != mesh.cellCount()){
+        throwLengthError(1, WHERE_AM_I + " sparsity pattern does not match the mesh " +
+                         toStr(cellCount()) + " != " + toStr(mesh.cellCount()));
+    }
+    Index nCells = mesh.cellCount();
+    cellStiffness_.resize(cellPos_.size());
+    cellMass_.resize(cellPos_.size());
+    if (nCells == 0) return;
+
+    Index nThreads = std::max(Index(1), std::min(threadCount(),
+                                                 nCells / 10000));
+    distributeCalc(CellElementMatricesMT(mesh, cellPtr_,
+                                         cellStiffness_, cellMass_),
+                   nCells, nThreads);
+}
+
+void MeshSparsityPattern::clear(){
+    colPtr_.clear();
+    rowIdx_.clear();
+    cellPtr_.clear();
+    cellPos_.clear();
+    cellStiffness_.clear();
+    cellMass_.clear();
+    colourPtr_.clear();
+    colourCells_.clear();
+    rows_ = 0;
+}
+
+void sparseMatrixMult(const RSparseMatrix & A, const RVector & a,
+                      RVector & ret, bool trans, Index nThreads){
+    sparseMatrixMult_(A, a, ret, trans, nThreads);
+}
+
+void sparseMatrixMult(const CSparseMatrix & A, const CVector & a,
+                      CVector & ret, bool trans, Index nThreads){
+    sparseMatrixMult_(A, a, ret, trans, nThreads);
+}
+
+void sparseMatrixMult(const RSparseMatrix & A, const RMatrix & X,
+                      RMatrix & ret, Index nThreads){
+    sparseMatrixMult_(A, X, ret, nThreads);
+}
+
+void sparseMatrixMult(const CSparseMatrix & A, const CMatrix & X,
+                      CMatrix & ret, Index nThreads){
+    sparseMatrixMult_(A, X, ret, nThreads);
+}
+
+} // namespace GIMLI
@@ -28,6 +28,7 @@
 #include "meshentities.h"
 #include "node.h"
 #include "stopwatch.h"
+#include "calculateMultiThread.h"
 
 #include <map>
 #include <set>
@@ -388,8 +389,15 @@ public:
     /*! Return this * a  */
     virtual Vector < ValueType > mult(const Vector < ValueType > & a) const {
         Vector < ValueType > ret(this->rows(), 0.0);
+        this->mult(a, ret);
+        return ret;
+    }
 
+    /*! Calculate ret = this * a into an existing vector. */
+    virtual void mult(const Vector < ValueType > & a, Vector < ValueType > & ret) const {
         ASSERT_EQUAL(this->cols(), a.size())
+        ret.resize(this->rows());
+        ret.fill(ValueType(0.0));
 
         if (stype_ == 0){
             for (const_iterator it = this->begin(); it != this->end(); it ++){
@@ -420,25 +428,48 @@ public:
             }
 
         }
-        return ret;
     }
 
     /*! Return this.T * a */
     virtual Vector < ValueType > transMult(const Vector < ValueType > & a) const {
         Vector < ValueType > ret(this->cols(), 0.0);
+        this->transMult(a, ret);
+        return ret;
+    }
 
+    /*! Calculate ret = this.T * a into an existing vector. */
+    virtual void transMult(const Vector < ValueType > & a, Vector < ValueType > & ret) const {
         ASSERT_EQUAL(this->rows(), a.size())
+        ret.resize(this->cols());
+        ret.fill(ValueType(0.0));
 
         if (stype_ == 0){
             for (const_iterator it = this->begin(); it != this->end(); it ++){
                 ret[it->first.second] += a[it->first.first] * it->second;
             }
         } else if (stype_ == -1){
-            THROW_TO_IMPL
+            for (const_iterator it = this->begin(); it != this->end(); it ++){
+                IndexType I = it->first.first;
+                IndexType J = it->first.second;
+
+                ret[J] += a[I] * conj(it->second);
+
+                if (J > I){
+                    ret[I] += a[J] * it->second;
+                }
+            }
         } else if (stype_ ==  1){
-            THROW_TO_IMPL
+            for (const_iterator it = this->begin(); it != this->end(); it ++){
+                IndexType I = it->first.first;
+                IndexType J = it->first.second;
+
+                ret[J] += a[I] * conj(it->second);
+
+                if (J < I){
+                    ret[I] += a[J] * it->second;
+                }
+            }
         }
-        return ret;
     }
 
     virtual Vector < ValueType > col(const Index i) {
@@ -645,6 +676,153 @@ void rank1Update (SparseMapMatrix< double, Index > & S, const Vec & u, const Vec
 //     return S * Vector< V2 >(a);
 // }
 
+/*! Calculate ret = A * a (trans=false) or ret = A.T * a (trans=true).
+ * The rows of ret are distributed over at most nThreads threads
+ * if the matrix is large enough to be worth it. nThreads=0 uses
+ * \ref threadCount(), callers running in a thread already pass 1. */
+DLLEXPORT void sparseMatrixMult(const RSparseMatrix & A, const RVector & a,
+                                RVector & ret, bool trans, Index nThreads=0);
+DLLEXPORT void sparseMatrixMult(const CSparseMatrix & A, const CVector & a,
+                                CVector & ret, bool trans, Index nThreads=0);
+
+/*! Calculate ret[j] = A * X[j] for all rows j of X. The sparse matrix is
+ * traversed once for the whole block of vectors and the rows of A are
+ * distributed over at most nThreads threads, 0 uses \ref threadCount(). */
+DLLEXPORT void sparseMatrixMult(const RSparseMatrix & A, const RMatrix & X,
+                                RMatrix & ret, Index nThreads=0);
+DLLEXPORT void sparseMatrixMult(const CSparseMatrix & A, const CMatrix & X,
+                                CMatrix & ret, Index nThreads=0);
+
+/*! Create the CRS sparsity pattern of the nodal connectivity of mesh.
+ * colPtr gets nodeCount() + 1 row offsets and rowIdx the sorted node ids
+ * of all cells sharing a node. Works on flat arrays in two passes
+ * (count, fill) that are threaded over the nodes. */
+DLLEXPORT void createSparsityPattern(const Mesh & mesh,
+                                     std::vector < int > & colPtr,
+                                     std::vector < int > & rowIdx);
+
+/*! Nodal sparsity pattern of a mesh together with the position of every
+ * cell element matrix entry in the CRS value array. Both depend only on the
+ * mesh topology, so they can be build once and reused for any assembly on
+ * the same mesh, e.g., for different wavenumbers or resistivities. */
+class DLLEXPORT MeshSparsityPattern{
+public:
+    MeshSparsityPattern() : rows_(0) { }
+
+    MeshSparsityPattern(const Mesh & mesh) : rows_(0) { build(mesh); }
+
+    /*! Build the sparsity pattern and the cell scatter map for mesh. */
+    void build(const Mesh & mesh);
+
+    void clear();
+
+    inline bool valid() const { return colPtr_.size() > 0; }
+
+    inline Index size() const { return valid() ? colPtr_.size() - 1 : 0; }
+    inline Index rows() const { return rows_; }
+    inline Index nVals() const { return rowIdx_.size(); }
+    inline Index cellCount() const { return valid() ? cellPtr_.size() - 1 : 0; }
+
+    inline const std::vector < int > & vecColPtr() const { return colPtr_; }
+    inline const std::vector < int > & vecRowIdx() const { return rowIdx_; }
+
+    /*! Return the value array positions of the element matrix entries of
+     * mesh.cell(i), row major and in cell node order, i.e., the entry (a, b)
+     * of the element matrix goes to vals[cellPos(i)[a * nodeCount + b]]. */
+    inline const int * cellPos(Index i) const { return &cellPos_[cellPtr_[i]]; }
+
+    /*! Build the mass (u2) and stiffness (ux2uy2uz2) element matrices of
+     * all cells, threaded over the cells. They depend only on the mesh
+     * geometry, so any assembly with a Helmholtz term k^2 u and cell wise
+     * coefficients is a scaled sum of them, see \ref SparseMatrix::add. */
+    void buildElementMatrices(const Mesh & mesh);
+
+    inline bool hasElementMatrices() const {
+        return valid() && cellStiffness_.size() == cellPos_.size();
+    }
+
+    /*! Return the stiffness element matrix of mesh.cell(i) row major with
+     * the layout of \ref cellPos. */
+    inline const double * cellStiffness(Index i) const { return &cellStiffness_[cellPtr_[i]]; }
+
+    /*! Return the mass element matrix of mesh.cell(i) row major with
+     * the layout of \ref cellPos. */
+    inline const double * cellMass(Index i) const { return &cellMass_[cellPtr_[i]]; }
+
+    /*! Return the amount of cell colours. Cells of the same colour do not
+     * share a node, so their element matrices can be added concurrently,
+     * see \ref assembleCells. */
+    inline Index colourCount() const { return valid() ? colourPtr_.size() - 1 : 0; }
+
+    /*! Return the amount of cells with colour c. */
+    inline Index colourSize(Index c) const { return colourPtr_[c + 1] - colourPtr_[c]; }
+
+    /*! Return the ascending cell indices with colour c. */
+    inline const int * colourCells(Index c) const { return &colourCells_[colourPtr_[c]]; }
+
+protected:
+    /*! Greedy colouring of the cells, called by \ref build. */
+    void buildColours_(const Mesh & mesh);
+
+    std::vector < int > colPtr_;
+    std::vector < int > rowIdx_;
+    std::vector < int > cellPtr_;
+    std::vector < int > cellPos_;
+    std::vector < double > cellStiffness_;
+    std::vector < double > cellMass_;
+    std::vector < int > colourPtr_;
+    std::vector < int > colourCells_;
+    Index rows_;
+};
+
+template < class Kernel > class ColourAssemblyMT : public BaseCalcMT{
+public:
+    ColourAssemblyMT(const MeshSparsityPattern & pattern, Index colour,
+                     const Kernel & kernel)
+    : BaseCalcMT(), pattern_(&pattern), colour_(colour), kernel_(kernel){
+    }
+
+    virtual ~ColourAssemblyMT(){}
+
+    virtual void calc(Index tNr=0){
+        const int * cells = pattern_->colourCells(colour_);
+        for (Index i = start_; i < end_; i ++) kernel_(cells[i]);
+    }
+
+protected:
+    const MeshSparsityPattern * pattern_;
+    Index colour_;
+    Kernel kernel_;
+};
+
+/*! Call kernel(i) for all cells i of the mesh of pattern. The kernel adds
+ * the element matrix of cell i with the positions pattern.cellPos(i). The
+ * cells of one colour share no node and write to different values, so
+ * every colour is distributed over nThreads threads without locking.
+ * Every thread works with its own copy of kernel. For one thread the cells
+ * are processed in mesh order. */
+template < class Kernel >
+void assembleCells(const MeshSparsityPattern & pattern, const Kernel & kernel,
+                   Index nThreads){
+    if (nThreads < 2 || pattern.colourCount() == 0){
+        Kernel k(kernel);
+        for (Index i = 0; i < pattern.cellCount(); i ++) k(i);
+        return;
+    }
+    for (Index c = 0; c < pattern.colourCount(); c ++){
+        Index n = pattern.colourSize(c);
+        Index nT = std::max(Index(1), std::min(nThreads, n / 1000));
+        distributeCalc(ColourAssemblyMT< Kernel >(pattern, c, kernel), n, nT);
+    }
+}
+
+//! Minimum cell count for the threaded fill of stiffness and mass matrices.
+static const Index __ASSEMBLY_MT_MIN_CELLS__ = 10000;
+
+/*! Kernel for \ref assembleCells, adds a[cell.id()] times the stiffness
+ * or the mass element matrix of every cell. */
+template < class ValueType > class CellMatrixKernel_;
+
 //! Sparse matrix in compressed row storage (CRS) form
 /*! Sparse matrix in compressed row storage (CRS) form.
 * IF you need native CCS format you need to transpose CRS
@@ -654,28 +832,30 @@ public:
 
   /*! Default constructor. Builds invalid sparse matrix */
     SparseMatrix()
-        : MatrixBase(), valid_(false), stype_(0), rows_(0), cols_(0){ }
+        : MatrixBase(), valid_(false), stype_(0), rows_(0), cols_(0),
+          transposeValid_(false){ }
 
     /*! Copy constructor. */
     SparseMatrix(const SparseMatrix < ValueType > & S)
         : MatrixBase(),
           colPtr_(S.vecColPtr()),
           rowIdx_(S.vecRowIdx()),
-          vals_(S.vecVals()), valid_(true), stype_(0){
+          vals_(S.vecVals()), valid_(true), stype_(0),
+          transposeValid_(false){
           rows_ = S.rows();
           cols_ = S.cols();
     }
 
     /*! Copy constructor. */
     SparseMatrix(const SparseMapMatrix< ValueType, Index > & S)
-        : MatrixBase(), valid_(true){
+        : MatrixBase(), valid_(true), transposeValid_(false){
         copy_(S);
     }
 
     /*! Create Sparsematrix from c-arrays. Can't check for valid ranges, so please be carefull. */
     SparseMatrix(uint dim, Index * colPtr, Index nVals, Index * rowIdx,
                  ValueType * vals, int stype=0)
-        : MatrixBase(){
+        : MatrixBase(), transposeValid_(false){
         colPtr_.reserve(dim + 1);
         colPtr_.resize(dim + 1);
 
@@ -705,6 +885,7 @@ public:
             valid_  = true;
             cols_ = S.cols();
             rows_ = S.rows();
+            transposeValid_ = false;
 
         } return *this;
     }
@@ -763,7 +944,9 @@ public:
         return *this;
     }
 
-    /*! Return this * a  */
+    /*! Return this * a. Rows are distributed over \ref threadCount() threads
+     * for large matrices. Symmetric storage (stype != 0) uses the cached
+     * transposed pattern, see \ref updateTransposePattern. */
     virtual Vector < ValueType > mult(const Vector < ValueType > & a) const {
         if (a.size() < this->cols()){
             throwLengthError(1, WHERE_AM_I + " SparseMatrix size(): " + toStr(this->cols()) + " a.size(): " +
@@ -771,50 +954,12 @@ public:
         }
 
         Vector < ValueType > ret(this->rows(), 0.0);
-
-        if (stype_ == 0){
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    ret[i] += a[this->vecRowIdx()[j]] * this->vecVals()[j];
-                }
-            }
-        } else if (stype_ == -1){
-            Index J;
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    J = this->vecRowIdx()[j];
-
-//                     __MS( i << "  " << J << " " << this->vecVals()[j])
-                    ret[i] += a[J] * conj(this->vecVals()[j]);
-
-                    if (J > i){
-//                         __MS( J << "  " << i << " " << this->vecVals()[j])
-                        ret[J] += a[i] * this->vecVals()[j];
-                    }
-                }
-            }
-
-            //#THROW_TO_IMPL
-        } else if (stype_ == 1){
-            Index J;
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    J = this->vecRowIdx()[j];
-
-//                     __MS( i << "  " << J << " " << this->vecVals()[j])
-                    ret[i] += a[J] * conj(this->vecVals()[j]);
-
-                    if (J < i){
-//                         __MS( J << "  " << i << " " << this->vecVals()[j])
-                        ret[J] += a[i] * this->vecVals()[j];
-                    }
-                }
-            }
-        }
+        sparseMatrixMult(*this, a, ret, false);
         return ret;
     }
 
-    /*! Return this.T * a */
+    /*! Return this.T * a. The product is gathered row by row from the
+     * cached transposed pattern, so it is threaded like \ref mult. */
     virtual Vector < ValueType > transMult(const Vector < ValueType > & a) const {
 
         if (a.size() < this->rows()){
@@ -823,20 +968,103 @@ public:
         }
 
         Vector < ValueType > ret(this->cols(), 0.0);
+        sparseMatrixMult(*this, a, ret, true);
+        return ret;
+    }
 
-        if (stype_ == 0){
-            for (Index i = 0; i < ret.size(); i++){
-                for (int j = this->vecColPtr()[i]; j < this->vecColPtr()[i + 1]; j ++){
-                    ret[this->vecRowIdx()[j]] += a[i] * this->vecVals()[j];
+    /*! Calculate ret = this * a into an existing vector. */
+    virtual void mult(const Vector < ValueType > & a, Vector < ValueType > & ret) const {
+        if (a.size() < this->cols()){
+            throwLengthError(1, WHERE_AM_I + " SparseMatrix size(): " + toStr(this->cols()) + " a.size(): " +
+                                toStr(a.size())) ;
+        }
+        ret.resize(this->rows());
+        sparseMatrixMult(*this, a, ret, false);
+    }
+
+    /*! Calculate ret = this.T * a into an existing vector. */
+    virtual void transMult(const Vector < ValueType > & a, Vector < ValueType > & ret) const {
+        if (a.size() < this->rows()){
+            throwLengthError(1, WHERE_AM_I + " SparseMatrix size(): " + toStr(this->rows()) + " a.size(): " +
+                                toStr(a.size())) ;
+        }
+        ret.resize(this->cols());
+        sparseMatrixMult(*this, a, ret, true);
+    }
+
+    /*! Calculate the rows [start, end) of this * a (trans=false) or
+     * this.T * a (trans=true) into ret. Every row is a pure gather,
+     * so disjoint row ranges can be calculated concurrently.
+     * For trans=true or symmetric storage \ref updateTransposePattern
+     * need to be called before. */
+    void multRows(const Vector < ValueType > & a, Vector < ValueType > & ret,
+                  Index start, Index end, bool trans) const {
+        const int * cP = colPtr_.empty() ? 0 : &colPtr_[0];
+        const int * rI = rowIdx_.empty() ? 0 : &rowIdx_[0];
+        const int * tCP = tColPtr_.empty() ? 0 : &tColPtr_[0];
+        const int * tRI = tRowIdx_.empty() ? 0 : &tRowIdx_[0];
+        const int * tP = tPerm_.empty() ? 0 : &tPerm_[0];
+        const ValueType * v = vals_.size() ? &vals_[0] : 0;
+        end = std::min(end, ret.size());
+
+        for (Index i = start; i < end; i ++){
+            ValueType s = 0.0;
+            int r = (int)i;
+
+            if (!trans){
+                if (stype_ == 0){
+                    for (int j = cP[i]; j < cP[i + 1]; j ++) s += a[rI[j]] * v[j];
+                } else {
+                    for (int j = cP[i]; j < cP[i + 1]; j ++) s += a[rI[j]] * conj(v[j]);
+                    // mirrored entries of the not stored triangle
+                    for (int j = tCP[i]; j < tCP[i + 1]; j ++){
+                        if ((stype_ < 0 && tRI[j] < r) || (stype_ > 0 && tRI[j] > r)){
+                            s += a[tRI[j]] * v[tP[j]];
+                        }
+                    }
+                }
+            } else {
+                if (stype_ == 0){
+                    for (int j = tCP[i]; j < tCP[i + 1]; j ++) s += a[tRI[j]] * v[tP[j]];
+                } else {
+                    for (int j = tCP[i]; j < tCP[i + 1]; j ++) s += a[tRI[j]] * conj(v[tP[j]]);
+                    // mirrored entries of the not stored triangle
+                    for (int j = cP[i]; j < cP[i + 1]; j ++){
+                        if ((stype_ < 0 && rI[j] > r) || (stype_ > 0 && rI[j] < r)){
+                            s += a[rI[j]] * v[j];
+                        }
+                    }
                 }
             }
+            ret[i] = s;
+        }
+    }
 
-        } else if (stype_ == -1){
-            THROW_TO_IMPL
-        } else if (stype_ ==  1){
-            THROW_TO_IMPL
+    /*! Build the transposed sparsity pattern (CRS of this.T) together with
+     * the position of each transposed entry in \ref vecVals. The pattern is
+     * only rebuild if the sparsity pattern has changed, new values are
+     * allowed. Not thread safe, the threaded \ref mult and \ref transMult
+     * serialize the call. */
+    void updateTransposePattern() const {
+        if (transposeValid_) return;
+
+        Index nT = std::max(std::max(this->size(), rows_), cols_);
+        tColPtr_.assign(nT + 1, 0);
+        tRowIdx_.resize(rowIdx_.size());
+        tPerm_.resize(rowIdx_.size());
+
+        for (Index j = 0; j < rowIdx_.size(); j ++) tColPtr_[rowIdx_[j] + 1] ++;
+        for (Index i = 0; i < nT; i ++) tColPtr_[i + 1] += tColPtr_[i];
+
+        std::vector < int > pos(tColPtr_.begin(), tColPtr_.end() - 1);
+        for (Index i = 0; i < this->size(); i ++){
+            for (int j = colPtr_[i]; j < colPtr_[i + 1]; j ++){
+                int p = pos[rowIdx_[j]] ++;
+                tRowIdx_[p] = i;
+                tPerm_[p] = j;
+            }
         }
-        return ret;
+        transposeValid_ = true;
     }
 
     SparseMatrix< ValueType > & add(const ElementMatrix< double > & A){
@@ -862,6 +1090,7 @@ public:
         valid_ = false;
         cols_ = 0;
         rows_ = 0;
+        clearTransposePattern_();
     }
 
     void setVal(int i, int j, ValueType val){
@@ -953,72 +1182,77 @@ public:
     }
 
     void buildSparsityPattern(const Mesh & mesh){
-        Stopwatch swatch(true);
+        clearTransposePattern_();
 
-        colPtr_.resize(mesh.nodeCount() + 1);
+        createSparsityPattern(mesh, colPtr_, rowIdx_);
 
-        //*** much to slow
-        //RSparseMapMatrix S(mesh.nodeCount(), mesh.nodeCount());
-
-        Index col = 0, row = 0;
+        vals_.resize(rowIdx_.size());
+        vals_.fill(ValueType(0.0));
 
-        // need unique(sort) maybe to slow
-//        std::vector < std::vector< Index > > idxMap(mesh.nodeCount());
-//         for (std::vector < std::vector< Index > >::iterator mIt = idxMap.begin(); mIt != idxMap.end(); mIt++){
-//             (*mIt).reserve(100);
-//         }
-
-// using set is by a factor of approx 5 more expensive
-        std::vector < std::set< Index > > idxMap(mesh.nodeCount());
-
-        Cell *cell = 0;
-        uint nc = 0;
-
-        for (uint c = 0; c < mesh.cellCount(); c ++){
-            cell = &mesh.cell(c);
-            nc = cell->nodeCount();
-
-            for (uint i = 0; i < nc; i ++){
-                for (uint j = 0; j < nc; j ++){
-                    row = cell->node(i).id();
-                    col = cell->node(j).id();
-                    //idxMap[col].push_back(row);
-                    idxMap[col].insert(row);
-                    //S[col][row] = 1;
-                }
-            }
-        }
+        valid_ = true;
+        cols_ = colPtr_.size() - 1;
+        rows_ = rowIdx_.empty() ? cols_ : max(rowIdx_) + 1;
+    }
 
-        int nVals = 0;
-        for (std::vector < std::set< Index > >::iterator mIt = idxMap.begin();
-             mIt != idxMap.end(); mIt++){
-            //std::sort((*mIt).begin(), (*mIt).end());
-            nVals += (*mIt).size();
+    /*! Take over the sparsity pattern of a \ref MeshSparsityPattern and
+     * clean all values. Nothing is reallocated if the matrix has the pattern
+     * already, see \ref hasPattern. */
+    void buildSparsityPattern(const MeshSparsityPattern & pattern){
+        if (!hasPattern(pattern)){
+            clearTransposePattern_();
+            colPtr_ = pattern.vecColPtr();
+            rowIdx_ = pattern.vecRowIdx();
+            vals_.resize(rowIdx_.size());
+            cols_ = pattern.size();
+            rows_ = pattern.rows();
         }
+        stype_ = 0;
+        valid_ = true;
+        clean();
+    }
 
-//         std::cout << "timwe: " << swatch.duration( true) << std::endl;
-//         exit(0);
+    /*! Return true if the matrix uses the sparsity pattern of pattern,
+     * i.e., it was not extended after \ref buildSparsityPattern. */
+    bool hasPattern(const MeshSparsityPattern & pattern) const {
+        return valid_ && vals_.size() == pattern.nVals() &&
+               colPtr_ == pattern.vecColPtr() &&
+               rowIdx_ == pattern.vecRowIdx();
+    }
 
-        rowIdx_.reserve(nVals);
-        rowIdx_.resize(nVals);
-        vals_.resize(nVals);
+    /*! Add scale * A with precomputed value positions pos, e.g., from
+     * \ref MeshSparsityPattern::cellPos. There is no search in the pattern,
+     * so pos need to be valid for this matrix. */
+    SparseMatrix< ValueType > & add(const ElementMatrix< double > & A,
+                                    ValueType scale, const int * pos){
+        if (!valid_) SPARSE_NOT_VALID;
+        Index n = A.size();
+        for (Index i = 0; i < n; i++){
+            for (Index j = 0; j < n; j++){
+                vals_[pos[i * n + j]] += scale * A.getVal(i, j);
+            }
+        }
+        return *this;
+    }
 
-        colPtr_[0] = 0;
-        Index k = 0;
-        row = 0;
-        for (std::vector < std::set< Index > >::iterator mIt = idxMap.begin(); mIt != idxMap.end(); mIt++){
-            for (std::set< Index >::iterator sIt = (*mIt).begin(); sIt != (*mIt).end(); sIt++){
-                rowIdx_[k] = (*sIt);
-                vals_[k] = (ValueType)0.0;
-                k++;
+    /*! Add scale * (A + b * B) for the row major n x n element matrices
+     * A and B with precomputed value positions pos, e.g., from
+     * \ref MeshSparsityPattern::cellStiffness and cellMass. B is ignored
+     * if b is zero. */
+    SparseMatrix< ValueType > & add(Index n, const double * A,
+                                    const double * B, double b,
+                                    ValueType scale, const int * pos){
+        if (!valid_) SPARSE_NOT_VALID;
+        Index n2 = n * n;
+        if (b != 0.0){
+            for (Index i = 0; i < n2; i++){
+                vals_[pos[i]] += scale * (A[i] + b * B[i]);
+            }
+        } else {
+            for (Index i = 0; i < n2; i++){
+                vals_[pos[i]] += scale * A[i];
             }
-            row++;
-            colPtr_[row] = k;
         }
-        valid_ = true;
-        cols_ = colPtr_.size() - 1;
-        rows_ = max(rowIdx_) + 1;
-        //** freeing idxMap ist expensive
+        return *this;
     }
 
     void fillStiffnessMatrix(const Mesh & mesh){
@@ -1028,6 +1262,7 @@ public:
 
     void fillStiffnessMatrix(const Mesh & mesh, const RVector & a){
         clean();
+        if (fillMT_(mesh, a, false)) return;
         buildSparsityPattern(mesh);
         ElementMatrix < double > A_l;
 
@@ -1044,6 +1279,7 @@ public:
 
     void fillMassMatrix(const Mesh & mesh, const RVector & a){
         clean();
+        if (fillMT_(mesh, a, true)) return;
         buildSparsityPattern(mesh);
         ElementMatrix < double > A_l;
 
@@ -1099,6 +1335,24 @@ public:
 
 protected:
 
+    void clearTransposePattern_(){
+        tColPtr_.clear();
+        tRowIdx_.clear();
+        tPerm_.clear();
+        transposeValid_ = false;
+    }
+
+    /*! Threaded fill for \ref fillStiffnessMatrix and \ref fillMassMatrix.
+     * Return false and do nothing for one thread or small meshes. */
+    bool fillMT_(const Mesh & mesh, const RVector & a, bool mass){
+        if (threadCount() < 2 || mesh.cellCount() < __ASSEMBLY_MT_MIN_CELLS__) return false;
+        MeshSparsityPattern pattern(mesh);
+        buildSparsityPattern(pattern);
+        assembleCells(pattern, CellMatrixKernel_< ValueType >(*this, mesh, a, pattern, mass),
+                      threadCount());
+        return true;
+    }
+
     // int to be cholmod compatible!!!!!!!!
 
     std::vector < int > colPtr_;
@@ -1109,6 +1363,40 @@ protected:
     int stype_;
     Index rows_;
     Index cols_;
+
+    // transposed pattern cache for transMult and symmetric mult
+    mutable std::vector < int > tColPtr_;
+    mutable std::vector < int > tRowIdx_;
+    mutable std::vector < int > tPerm_;
+    mutable bool transposeValid_;
+};
+
+template < class ValueType > class CellMatrixKernel_{
+public:
+    CellMatrixKernel_(SparseMatrix< ValueType > & S, const Mesh & mesh,
+                      const RVector & a, const MeshSparsityPattern & pattern,
+                      bool mass)
+    : S_(&S), mesh_(&mesh), a_(&a), pattern_(&pattern), mass_(mass){
+    }
+
+    /*! Copy without the element matrix workspace. */
+    CellMatrixKernel_(const CellMatrixKernel_ & k)
+    : S_(k.S_), mesh_(k.mesh_), a_(k.a_), pattern_(k.pattern_), mass_(k.mass_){
+    }
+
+    void operator()(Index i){
+        const Cell & cell = mesh_->cell(i);
+        if (mass_) A_l_.u2(cell); else A_l_.ux2uy2uz2(cell);
+        S_->add(A_l_, ValueType((*a_)[cell.id()]), pattern_->cellPos(i));
+    }
+
+protected:
+    SparseMatrix< ValueType >   * S_;
+    const Mesh                  * mesh_;
+    const RVector               * a_;
+    const MeshSparsityPattern   * pattern_;
+    bool mass_;
+    ElementMatrix < double > A_l_;
 };
 
 template < class ValueType >
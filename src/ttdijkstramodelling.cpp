@@ -22,6 +22,7 @@
 #define NEWREGION 33333
 
 #include "blockmatrix.h"
+#include "calculateMultiThread.h"
 #include "datacontainer.h"
 #include "elementmatrix.h"
 #include "pos.h"
@@ -332,6 +333,93 @@ RVector TravelTimeDijkstraModelling::response(const RVector & slowness) {
     return  resp;
 }
 
+/*! Travel times for the cell slowness rows [start_, end_).
+ * Every thread uses its own graph and Dijkstra. */
+class TTResponsesMT : public BaseCalcMT{
+public:
+    TTResponsesMT(RMatrix & resp, const TravelTimeDijkstraModelling & fop,
+                  const RMatrix & cellSlowness,
+                  const std::vector < Index > & shotNodeId,
+                  const std::vector < Index > & receNodeId,
+                  const std::vector < Index > & dataShot,
+                  const std::vector < Index > & dataRece, bool verbose)
+    : BaseCalcMT(0, verbose), resp_(&resp), fop_(&fop),
+      cellSlowness_(&cellSlowness), shotNodeId_(&shotNodeId),
+      receNodeId_(&receNodeId), dataShot_(&dataShot), dataRece_(&dataRece){
+    }
+
+    virtual ~TTResponsesMT(){}
+
+    virtual void calc(Index tNr=0){
+        Index nShots = shotNodeId_->size();
+        Index nRecei = receNodeId_->size();
+        Index nData = dataShot_->size();
+        RMatrix dMap(nShots, nRecei);
+        Index end = std::min(end_, resp_->rows());
+
+        for (Index i = start_; i < end; i ++){
+            Dijkstra dijkstra(fop_->createGraph((*cellSlowness_)[i]));
+
+            for (Index shot = 0; shot < nShots; shot ++) {
+                dijkstra.setStartNode((*shotNodeId_)[shot]);
+                for (Index j = 0; j < nRecei; j ++) {
+                    dMap[shot][j] = dijkstra.distance((*receNodeId_)[j]);
+                }
+            }
+
+            RVector & resp = (*resp_)[i];
+            resp.resize(nData);
+            for (Index j = 0; j < nData; j ++) {
+                resp[j] = dMap[(*dataShot_)[j]][(*dataRece_)[j]];
+            }
+        }
+    }
+
+protected:
+    RMatrix                             * resp_;
+    const TravelTimeDijkstraModelling   * fop_;
+    const RMatrix                       * cellSlowness_;
+    const std::vector < Index >         * shotNodeId_;
+    const std::vector < Index >         * receNodeId_;
+    const std::vector < Index >         * dataShot_;
+    const std::vector < Index >         * dataRece_;
+};
+
+RMatrix TravelTimeDijkstraModelling::responses(const RMatrix & slowness) {
+    if (background_ < TOLERANCE) {
+        std::cout << "Background: " << background_ << "->" << 1e16 << std::endl;
+        background_ = 1e16;
+    }
+
+    Index nModels = slowness.rows();
+    RMatrix resp(nModels, 0);
+    if (nModels == 0) return resp;
+
+    //** mapping writes the mesh cell attributes, so do it in serial
+    RMatrix cellSlowness(nModels, 0);
+    for (Index i = 0; i < nModels; i ++) {
+        this->mapModel(slowness[i], background_);
+        cellSlowness[i] = mesh_->cellAttributes();
+    }
+
+    //** data to shot/receiver number is the same for all models
+    Index nData = dataContainer_->size();
+    std::vector < Index > dataShot(nData), dataRece(nData);
+    for (Index dataIdx = 0; dataIdx < nData; dataIdx ++) {
+        dataShot[dataIdx] = shotsInv_[Index((*dataContainer_)("s")[dataIdx])];
+        dataRece[dataIdx] = receiInv_[Index((*dataContainer_)("g")[dataIdx])];
+    }
+
+    Index nThreads = max(Index(1), min(threadCount(), nModels));
+
+    ALLOW_PYTHON_THREADS
+    distributeCalc(TTResponsesMT(resp, *this, cellSlowness,
+                                 shotNodeId_, receNodeId_,
+                                 dataShot, dataRece, verbose_),
+                   nModels, nThreads, verbose_);
+    return resp;
+}
+
 void TravelTimeDijkstraModelling::initJacobian(){
     if (jacobian_ && ownJacobian_){
         delete jacobian_;
@@ -472,6 +560,25 @@ RVector TTModellingWithOffset::response(const RVector & model) {
     return resp;
 }
 
+RMatrix TTModellingWithOffset::responses(const RMatrix & models) {
+    Index nSlowness = models.cols() - shots_.size();
+    RMatrix slowness(models.rows(), nSlowness);
+    for (Index i = 0; i < models.rows(); i ++) {
+        slowness[i] = RVector(models[i], 0, nSlowness);
+    }
+
+    RMatrix resp(TravelTimeDijkstraModelling::responses(slowness)); //! normal responses
+    RVector shotpos = dataContainer_->get("s");
+
+    for (Index i = 0; i < models.rows(); i ++){
+        RVector offsets(models[i], nSlowness, models.cols());
+        for (Index j = 0; j < resp[i].size(); j ++){
+            resp[i][j] += offsets[shotMap_[Index(shotpos[j])]];
+        }
+    }
+    return resp;
+}
+
 void TTModellingWithOffset::initJacobian(){
     if (jacobian_ && ownJacobian_){
         delete jacobian_;
@@ -102,6 +102,11 @@ public:
     /*! Interface. Calculate response */
     virtual RVector response(const RVector & slowness);
 
+    /*! Calculate the responses for several slowness models (rows).
+     * The models are mapped to the mesh one by one, graph creation and
+     * shortest paths run on \ref threadCount threads. */
+    virtual RMatrix responses(const RMatrix & slowness);
+
     /*! Interface. */
     virtual void createJacobian(const RVector & slowness);
 
@@ -151,6 +156,8 @@ public:
 
     virtual RVector response(const RVector & model);
 
+    virtual RMatrix responses(const RMatrix & models);
+
     void initJacobian();
 
     virtual void createJacobian(const RVector & slowness);
@@ -60,8 +60,128 @@
 #endif
 
 
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    #include <malloc.h>
+#endif
+#include <new>
+
+//** Element-wise kernels are compiled for AVX-512, AVX2 and the default
+//** target. The matching clone is chosen at load time (ifunc, gcc on linux).
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 && \
+    defined(__x86_64__) && defined(__linux__) && !defined(PYGIMLI_CAST)
+    #define EXPRVEC_SIMD_KERNEL __attribute__((target_clones("avx512f", "avx2", "default"), \
+                                               optimize("tree-vectorize", "vect-cost-model=dynamic")))
+    #define EXPRVEC_IVDEP _Pragma("GCC ivdep")
+#else
+    #define EXPRVEC_SIMD_KERNEL
+    #define EXPRVEC_IVDEP
+#endif
+
 namespace GIMLI{
 
+//! Alignment in byte of the \ref Vector and \ref Matrix memory, suits AVX-512.
+static const Index VECTOR_MEMORY_ALIGNMENT = 64;
+
+/*! Allocate aligned memory for n default initialized values. */
+template < class ValueType > ValueType * alignedNew(Index n){
+    void * mem = 0;
+    Index bytes = std::max(Index(1), n) * sizeof(ValueType);
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    mem = _aligned_malloc(bytes, VECTOR_MEMORY_ALIGNMENT);
+#else
+    if (posix_memalign(&mem, VECTOR_MEMORY_ALIGNMENT, bytes) != 0) mem = 0;
+#endif
+    if (!mem) throw std::bad_alloc();
+    ValueType * data = static_cast< ValueType * >(mem);
+    for (Index i = 0; i < n; i ++) new (data + i) ValueType;
+    return data;
+}
+
+/*! Free memory from \ref alignedNew with n values. */
+template < class ValueType > void alignedDelete(ValueType * data, Index n){
+    if (!data) return;
+    for (Index i = 0; i < n; i ++) data[i].~ValueType();
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+//! Below this size the kernels run inline, a clone call does not pay off.
+static const Index SIMD_KERNEL_MIN_SIZE = 16;
+
+/*! x[i] = expr[i]. The expression reads only the same index, so there is
+ * no dependency between the iterations even if x is part of expr. */
+template < class ValueType, class Expr > EXPRVEC_SIMD_KERNEL
+void simdAssignKernel_(ValueType * x, const Expr & expr, Index n){
+    EXPRVEC_IVDEP
+    for (Index i = 0; i < n; i ++) x[i] = expr[i];
+}
+
+/*! x[i] = Op(x[i], v[i]) */
+template < class Op, class ValueType > EXPRVEC_SIMD_KERNEL
+void simdUpdateKernel_(ValueType * x, const ValueType * v, Index n){
+    Op op;
+    EXPRVEC_IVDEP
+    for (Index i = 0; i < n; i ++) x[i] = op(x[i], v[i]);
+}
+
+/*! x[i] = Op(x[i], v) */
+template < class Op, class ValueType > EXPRVEC_SIMD_KERNEL
+void simdUpdateKernel_(ValueType * x, const ValueType v, Index n){
+    Op op;
+    for (Index i = 0; i < n; i ++) x[i] = op(x[i], v);
+}
+
+/*! ret[i] = Op(a[i], b[i]) */
+template < class Op, class ValueType > EXPRVEC_SIMD_KERNEL
+void simdCompareKernel_(bool * ret, const ValueType * a, const ValueType * b, Index n){
+    Op op;
+    for (Index i = 0; i < n; i ++) ret[i] = op(a[i], b[i]);
+}
+
+/*! ret[i] = Op(a[i], b) */
+template < class Op, class ValueType > EXPRVEC_SIMD_KERNEL
+void simdCompareKernel_(bool * ret, const ValueType * a, const ValueType b, Index n){
+    Op op;
+    for (Index i = 0; i < n; i ++) ret[i] = op(a[i], b);
+}
+
+template < class ValueType, class Expr >
+inline void simdAssign(ValueType * x, const Expr & expr, Index n){
+    if (n >= SIMD_KERNEL_MIN_SIZE) return simdAssignKernel_(x, expr, n);
+    for (Index i = 0; i < n; i ++) x[i] = expr[i];
+}
+
+template < class Op, class ValueType >
+inline void simdUpdate(ValueType * x, const ValueType * v, Index n){
+    if (n >= SIMD_KERNEL_MIN_SIZE) return simdUpdateKernel_< Op >(x, v, n);
+    Op op;
+    for (Index i = 0; i < n; i ++) x[i] = op(x[i], v[i]);
+}
+
+template < class Op, class ValueType >
+inline void simdUpdate(ValueType * x, const ValueType v, Index n){
+    if (n >= SIMD_KERNEL_MIN_SIZE) return simdUpdateKernel_< Op >(x, v, n);
+    Op op;
+    for (Index i = 0; i < n; i ++) x[i] = op(x[i], v);
+}
+
+template < class Op, class ValueType >
+inline void simdCompare(bool * ret, const ValueType * a, const ValueType * b, Index n){
+    if (n >= SIMD_KERNEL_MIN_SIZE) return simdCompareKernel_< Op >(ret, a, b, n);
+    Op op;
+    for (Index i = 0; i < n; i ++) ret[i] = op(a[i], b[i]);
+}
+
+template < class Op, class ValueType >
+inline void simdCompare(bool * ret, const ValueType * a, const ValueType b, Index n){
+    if (n >= SIMD_KERNEL_MIN_SIZE) return simdCompareKernel_< Op >(ret, a, b, n);
+    Op op;
+    for (Index i = 0; i < n; i ++) ret[i] = op(a[i], b);
+}
+
 template < class ValueType, class A > class __VectorExpr;
 
 IndexArray find(const BVector & v);
@@ -193,13 +313,13 @@ public:
 // this constructor is dangerous for IndexArray in pygimli ..
 // there is an autocast from int -> IndexArray(int)
     Vector()
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
     // explicit Vector(Index n = 0) : data_(NULL), begin_(NULL), end_(NULL) {
         resize(0);
         clean();
     }
     Vector(Index n)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
     // explicit Vector(Index n = 0) : data_(NULL), begin_(NULL), end_(NULL) {
         resize(n);
         clean();
@@ -209,7 +329,7 @@ public:
      * Construct one-dimensional array of size n, and fill it with val
      */
     Vector(Index n, const ValueType & val)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
         resize(n);
         fill(val);
     }
@@ -218,7 +338,7 @@ public:
      * Construct vector from file. Shortcut for Vector::load
      */
     Vector(const std::string & filename, IOFormat format=Ascii)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
         this->load(filename, format);
     }
 
@@ -226,7 +346,7 @@ public:
      * Copy constructor. Create new vector as a deep copy of v.
      */
     Vector(const Vector< ValueType > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
         resize(v.size());
         copy_(v);
     }
@@ -235,7 +355,7 @@ public:
      * Copy constructor. Create new vector as a deep copy of the slice v[start, end)
      */
     Vector(const Vector< ValueType > & v, Index start, Index end)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
         resize(end - start);
         std::copy(&v[start], &v[end], data_);
     }
@@ -244,7 +364,7 @@ public:
      * Copy constructor. Create new vector from expression
      */
     template < class A > Vector(const __VectorExpr< ValueType, A > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
         resize(v.size());
         assign_(v);
     }
@@ -254,14 +374,14 @@ public:
      * Copy constructor. Create new vector as a deep copy of std::vector(Valuetype)
      */
     Vector(const std::vector< ValueType > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
         resize(v.size());
         for (Index i = 0; i < v.size(); i ++) data_[i] = v[i];
         //std::copy(&v[0], &v[v.size()], data_);
     }
 
     template < class ValueType2 > Vector(const Vector< ValueType2 > & v)
-        : size_(0), data_(0), capacity_(0){
+        : size_(0), data_(0), capacity_(0), view_(false){
         resize(v.size());
         for (Index i = 0; i < v.size(); i ++) data_[i] = ValueType(v[i]);
         //std::copy(&v[0], &v[v.size()], data_);
@@ -590,8 +710,7 @@ public:
 
         BVector ret(this->size(), 0);
 
-        std::less<ValueType> l;
-        for (Index i = 0; i < v.size(); i ++) ret[i] = l(data_[i], v[i]);
+        simdCompare< std::less< ValueType > >(ret.data(), data_, v.data_, v.size());
         return ret;
     }
 #endif
@@ -600,8 +719,7 @@ public:
     BVector operator OP (const Vector< ValueType > & v) const { \
         ASSERT_EQUAL(this->size(), v.size()) \
         BVector ret(this->size(), 0); \
-        FUNCT<ValueType> f; \
-        for (Index i = 0; i < v.size(); i ++) ret[i] = f(data_[i], v[i]); \
+        simdCompare< FUNCT< ValueType > >(ret.data(), data_, v.data_, v.size()); \
         return ret; \
     } \
 
@@ -614,8 +732,7 @@ DEFINE_COMPARE_OPERATOR_VEC__(>, std::greater)
 #define DEFINE_COMPARE_OPERATOR__(OP, FUNCT) \
     inline BVector operator OP (const ValueType & v) const { \
         BVector ret(this->size(), 0); \
-        FUNCT<ValueType> f; \
-        for (Index i = 0; i < this->size(); i ++){ ret[i] = f(data_[i], v); } \
+        simdCompare< FUNCT< ValueType > >(ret.data(), data_, v, this->size()); \
         return ret;\
     } \
 
@@ -638,9 +755,9 @@ DEFINE_COMPARE_OPERATOR__(>, std::greater)
 #define DEFINE_UNARY_MOD_OPERATOR__(OP, FUNCT) \
   inline Vector< ValueType > & operator OP##= (const Vector < ValueType > & v) { \
         ASSERT_EMPTY(v) \
-        std::transform(data_, data_ + size_, &v[0], data_, FUNCT()); return *this; } \
+        simdUpdate< FUNCT >(data_, v.data_, size_); return *this; } \
   inline Vector< ValueType > & operator OP##= (const ValueType & val) { \
-        for (Index i = 0; i < size_; i ++) data_[i] OP##= val; return *this; } \
+        simdUpdate< FUNCT >(data_, val, size_); return *this; } \
 
 DEFINE_UNARY_MOD_OPERATOR__(+, PLUS)
 DEFINE_UNARY_MOD_OPERATOR__(-, MINUS)
@@ -676,11 +793,13 @@ DEFINE_UNARY_MOD_OPERATOR__(*, MULT)
         }
 //         __MS(n << " " << capacity_ << " " << newCapacity)
 
-        if (newCapacity != capacity_) {
-            ValueType * buffer = new ValueType[newCapacity];
+        //** a view always gets its own memory, even if the capacity fits
+        if (newCapacity != capacity_ || view_) {
+            ValueType * buffer = alignedNew< ValueType >(newCapacity);
 
             std::memcpy(buffer, data_, sizeof(ValueType) * min(capacity_, newCapacity));
-            if (data_)  delete [] data_;
+            if (data_ && !view_) alignedDelete(data_, capacity_);
+            view_ = false;
             data_  = buffer;
             capacity_ = newCapacity;
             //std::copy(&tmp[0], &tmp[min(tmp.size(), n)], data_);
@@ -871,10 +990,22 @@ tolerance);
 protected:
 
     void free_(){
+        if (data_ && !view_) alignedDelete(data_, capacity_);
         size_ = 0;
         capacity_ = 0;
-        if (data_)  delete [] data_;
         data_  = NULL;
+        view_ = false;
+    }
+
+    /*! Let this vector refer to foreign memory [data, data + size), e.g.,
+     * one row of a \ref Matrix. The memory is not freed by this vector.
+     * Any resize to a different size gives the vector its own copy. */
+    void setView_(ValueType * data, Index size){
+        free_();
+        data_ = data;
+        size_ = size;
+        capacity_ = size;
+        view_ = true;
     }
 
     void copy_(const Vector< ValueType > & v){
@@ -900,6 +1031,10 @@ protected:
     Index size_;
     ValueType * data_;
     Index capacity_;
+    //! data_ is owned by someone else, see \ref setView_
+    bool view_;
+
+    template < class T > friend class Matrix;
 
     static const Index minSizePerThread = 10000;
     static const int maxThreads = 8;
@@ -976,10 +1111,8 @@ template< class ValueType, class Iter > void assignResult(Vector< ValueType > &
 
     #else  // no std algo
         #ifdef EXPRVEC_USE_INDIRECTION
-            ValueType * iter = v.begin().ptr();
-
-            // Inlined expression
-            for (Index i = v.size(); i--;) iter[i] = result2[i];
+            // Inlined expression, vectorized
+            simdAssign(v.begin().ptr(), result2, v.size());
         #else
             ValueType * iter = v.begin().ptr();
             ValueType * end  = v.end().ptr();
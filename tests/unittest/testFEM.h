@@ -7,6 +7,9 @@
 #include <meshentities.h>
 #include <elementmatrix.h>
 #include <integration.h>
+#include <meshgenerators.h>
+#include <sparsematrix.h>
+#include <linSolver.h>
 
 class FEMTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST_SUITE(FEMTest);
@@ -16,6 +19,8 @@ class FEMTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST(testFEM1D);
     CPPUNIT_TEST(testFEM2D);
     CPPUNIT_TEST(testFEM3D);
+    CPPUNIT_TEST(testMeshSparsityPattern);
+    CPPUNIT_TEST(testPCG);
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -68,6 +73,86 @@ public:
         testStiffness3D();
     }
 
+    void testMeshSparsityPattern(){
+        GIMLI::Mesh mesh(GIMLI::createMesh2D(4, 3));
+        GIMLI::MeshSparsityPattern pattern(mesh);
+
+        GIMLI::RSparseMatrix S1, S2;
+        S1.fillStiffnessMatrix(mesh);
+        S2.buildSparsityPattern(pattern);
+        CPPUNIT_ASSERT(S2.hasPattern(pattern));
+        CPPUNIT_ASSERT(S1.vecRowIdx() == S2.vecRowIdx());
+
+        GIMLI::ElementMatrix < double > A_l;
+        for (GIMLI::Index i = 0; i < mesh.cellCount(); i ++){
+            A_l.ux2uy2uz2(mesh.cell(i));
+            S2.add(A_l, 1.0, pattern.cellPos(i));
+        }
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(S1.vecVals() - S2.vecVals())) < TOLERANCE);
+
+        S2.buildSparsityPattern(pattern);
+        CPPUNIT_ASSERT(GIMLI::sum(GIMLI::abs(S2.vecVals())) == 0.0);
+
+        //** cached element matrices: 2 * (K + 0.25 * M)
+        pattern.buildElementMatrices(mesh);
+        CPPUNIT_ASSERT(pattern.hasElementMatrices());
+        S1.buildSparsityPattern(pattern);
+        for (GIMLI::Index i = 0; i < mesh.cellCount(); i ++){
+            S1.add(A_l.ux2uy2uz2(mesh.cell(i)), 2.0, pattern.cellPos(i));
+            S1.add(A_l.u2(mesh.cell(i)), 0.5, pattern.cellPos(i));
+            S2.add(mesh.cell(i).nodeCount(), pattern.cellStiffness(i),
+                   pattern.cellMass(i), 0.25, 2.0, pattern.cellPos(i));
+        }
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(S1.vecVals() - S2.vecVals())) < TOLERANCE);
+
+        //** no two cells of one colour share a node
+        GIMLI::Index nColoured = 0;
+        for (GIMLI::Index c = 0; c < pattern.colourCount(); c ++){
+            std::set < GIMLI::Index > nodes;
+            for (GIMLI::Index j = 0; j < pattern.colourSize(c); j ++){
+                const GIMLI::Cell & cell = mesh.cell(pattern.colourCells(c)[j]);
+                for (GIMLI::Index n = 0; n < cell.nodeCount(); n ++){
+                    CPPUNIT_ASSERT(nodes.insert(cell.node(n).id()).second);
+                }
+                nColoured ++;
+            }
+        }
+        CPPUNIT_ASSERT(nColoured == mesh.cellCount());
+
+        //** threaded fill by colour
+        GIMLI::Mesh mesh2(GIMLI::createMesh2D(120, 100));
+        GIMLI::RSparseMatrix S3, S4;
+        S3.fillStiffnessMatrix(mesh2);
+        GIMLI::Index nThreads = GIMLI::threadCount();
+        GIMLI::setThreadCount(4);
+        S4.fillStiffnessMatrix(mesh2);
+        GIMLI::setThreadCount(nThreads);
+        CPPUNIT_ASSERT(S3.vecRowIdx() == S4.vecRowIdx());
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(S3.vecVals() - S4.vecVals())) < TOLERANCE);
+    }
+
+    void testPCG(){
+        GIMLI::Mesh mesh(GIMLI::createMesh2D(10, 10));
+        GIMLI::MeshSparsityPattern pattern(mesh);
+        GIMLI::RSparseMatrix S;
+        S.buildSparsityPattern(pattern);
+
+        GIMLI::ElementMatrix < double > A_l;
+        for (GIMLI::Index i = 0; i < mesh.cellCount(); i ++){
+            S.add(A_l.ux2uy2uz2(mesh.cell(i)), 1.0, pattern.cellPos(i));
+            S.add(A_l.u2(mesh.cell(i)), 1.0, pattern.cellPos(i));
+        }
+        GIMLI::RVector x(S.rows());
+        for (GIMLI::Index i = 0; i < x.size(); i ++) x[i] = std::sin(0.1 * i);
+        GIMLI::RVector b(S * x);
+
+        GIMLI::LinSolver solver(S, GIMLI::PCG);
+        CPPUNIT_ASSERT(solver.solverName() == "PCG");
+        GIMLI::RVector x1(S.rows(), 0.0);
+        solver.solve(b, x1);
+        CPPUNIT_ASSERT(GIMLI::norml2(x1 - x) / GIMLI::norml2(x) < 1e-6);
+    }
+
     void testStiffness1D(){
         
         std::vector < GIMLI::Node * > n(2);
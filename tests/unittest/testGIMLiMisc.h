@@ -6,12 +6,16 @@
 #include <gimli.h>
 #include <ipcClient.h>
 #include <memwatch.h>
+#include <asyncWriter.h>
 
 #include <matrix.h>
 
 #include <polynomial.h>
 #include <pos.h>
 
+#include <cstdio>
+#include <thread>
+
 class GIMLIMiscTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST_SUITE(GIMLIMiscTest);
     CPPUNIT_TEST(testGimliMisc);
@@ -20,6 +24,7 @@ class GIMLIMiscTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST(testStringFunctions);
     //CPPUNIT_TEST(testIPCSHM);
     CPPUNIT_TEST(testMemWatch);
+    CPPUNIT_TEST(testAsyncWriter);
     CPPUNIT_TEST(testPolynomialFunction);
 //     CPPUNIT_TEST(testRotationByQuaternion);
     
@@ -33,6 +38,20 @@ public:
 // 		CPPUNIT_ASSERT(GIMLI::fileExist("unittest.sh") == true);
         std::cout << "number of CPU: " << GIMLI::numberOfCPU() << std::endl;
         GIMLI::showSizes();
+
+        //** the thread count limit holds for the calling thread only
+        GIMLI::Index nThreads = GIMLI::threadCount();
+        GIMLI::setThreadCount(4);
+        {
+            GIMLI::LocalThreadCount single(1);
+            CPPUNIT_ASSERT(GIMLI::threadCount() == 1);
+            GIMLI::Index other = 0;
+            std::thread t([&other](){ other = GIMLI::threadCount(); });
+            t.join();
+            CPPUNIT_ASSERT(other == 4);
+        }
+        CPPUNIT_ASSERT(GIMLI::threadCount() == 4);
+        GIMLI::setThreadCount(nThreads);
     }
 
     void testBooleanLogic(){
@@ -118,6 +137,25 @@ public:
         GIMLI::MemWatch::pInstance()->info(WHERE);
     }
     
+    void testAsyncWriter(){
+        GIMLI::AsyncWriter writer;
+        GIMLI::RVector v(100, 1.0);
+        int count = 0;
+        for (int i = 0; i < 10; i ++) writer.push([&count](){ count ++; });
+        writer.save(v, "asyncWriter.bvec", GIMLI::Binary);
+        v *= 2.0; // the queued snapshot is not affected
+        writer.push([](){ GIMLI::throwError(1, "expected failure"); });
+        writer.flush();
+        CPPUNIT_ASSERT(writer.pending() == 0);
+        CPPUNIT_ASSERT(count == 10);
+        CPPUNIT_ASSERT(GIMLI::RVector("asyncWriter.bvec", GIMLI::Binary) == GIMLI::RVector(100, 1.0));
+        std::remove("asyncWriter.bvec");
+
+        writer.setActive(false);
+        writer.push([&count](){ count ++; });
+        CPPUNIT_ASSERT(count == 11);
+    }
+
     void testPolynomialFunction(){
         CPPUNIT_ASSERT(GIMLI::PolynomialFunction< double > (GIMLI::RVector(0.0))(GIMLI::RVector3(3.14, 0.0, 0.0)) == 0.0);
         
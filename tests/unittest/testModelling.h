@@ -0,0 +1,388 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <gimli.h>
+#include <modellingbase.h>
+#include <dc1dmodelling.h>
+#include <em1dmodelling.h>
+#include <matrix.h>
+#include <inversion.h>
+#include <datacontainer.h>
+#include <trans.h>
+
+#include <cstdio>
+#include <fstream>
+
+//** Forward operator counting its response calls
+class CountingModelling : public GIMLI::ModellingBase {
+public:
+    CountingModelling() : GIMLI::ModellingBase(), count(0) { }
+
+    virtual GIMLI::RVector response(const GIMLI::RVector & model){
+        count ++;
+        return model * 2.0;
+    }
+
+    GIMLI::Index count;
+};
+
+//** Linear forward operator A * m with a read only response
+class LinearModelling : public GIMLI::ModellingBase {
+public:
+    LinearModelling(const GIMLI::RMatrix & A) : GIMLI::ModellingBase(), A_(A) { }
+
+    virtual GIMLI::RVector response(const GIMLI::RVector & model){
+        return A_ * model;
+    }
+
+    virtual GIMLI::RVector response_mt(const GIMLI::RVector & model, GIMLI::Index i=0) const {
+        return A_ * model;
+    }
+
+protected:
+    GIMLI::RMatrix A_;
+};
+
+//** Nonlinear forward operator m * m with a read only response
+class SquareModelling : public GIMLI::ModellingBase {
+public:
+    virtual GIMLI::RVector response(const GIMLI::RVector & model){
+        return response_mt(model);
+    }
+
+    virtual GIMLI::RVector response_mt(const GIMLI::RVector & model, GIMLI::Index i=0) const {
+        return model * model;
+    }
+};
+
+//** Counting forward operator that refuses the response cache
+class StatefulModelling : public CountingModelling {
+public:
+    virtual bool responseCacheable() const { return false; }
+};
+
+class ModellingTest : public CppUnit::TestFixture  {
+    CPPUNIT_TEST_SUITE(ModellingTest);
+    CPPUNIT_TEST(testJacobianMT);
+    CPPUNIT_TEST(testJacobianTrans);
+    CPPUNIT_TEST(testResponses);
+    CPPUNIT_TEST(testCheckpoint);
+    CPPUNIT_TEST(testResponseCache);
+    CPPUNIT_TEST(testLineSearchParallel);
+    CPPUNIT_TEST(testDataSpaceSolver);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+
+    void testJacobianMT(){
+        // 5 model parameters do not split evenly over 4 threads
+        GIMLI::RVector ab2(ab2_()), mn2(ab2.size(), 0.5);
+        GIMLI::RVector model(model_());
+
+        GIMLI::DC1dModelling fop(3, ab2, mn2);
+        fop.createJacobian(model);
+        GIMLI::RMatrix J(*dynamic_cast< GIMLI::RMatrix * >(fop.jacobian()));
+
+        GIMLI::DC1dModelling fopMT(3, ab2, mn2);
+        fopMT.setThreadCount(4);
+        fopMT.setMultiThreadJacobian(4);
+        fopMT.createJacobian(model);
+        GIMLI::RMatrix JMT(*dynamic_cast< GIMLI::RMatrix * >(fopMT.jacobian()));
+
+        CPPUNIT_ASSERT(JMT.rows() == J.rows());
+        CPPUNIT_ASSERT(JMT.cols() == J.cols());
+        for (GIMLI::Index i = 0; i < J.rows(); i ++){
+            CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(JMT[i] - J[i])) < 1e-12);
+        }
+
+        // read only response of the EM operators
+        GIMLI::RVector periods(8);
+        for (GIMLI::Index i = 0; i < periods.size(); i ++) periods[i] = std::pow(10.0, -2.0 + 0.5 * i);
+        GIMLI::MT1dModelling mt(periods, 3);
+        mt.createJacobian(model);
+        GIMLI::RMatrix JMt(*dynamic_cast< GIMLI::RMatrix * >(mt.jacobian()));
+
+        GIMLI::MT1dModelling mtMT(periods, 3);
+        mtMT.setMultiThreadJacobian(4);
+        mtMT.createJacobian(model);
+        GIMLI::RMatrix JMtMT(*dynamic_cast< GIMLI::RMatrix * >(mtMT.jacobian()));
+        CPPUNIT_ASSERT(JMtMT.rows() == 2 * periods.size());
+        for (GIMLI::Index i = 0; i < JMt.rows(); i ++){
+            CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(JMtMT[i] - JMt[i])) < 1e-12);
+        }
+    }
+
+    void testJacobianTrans(){
+        // forward differences of m * m are m + mUp
+        GIMLI::RVector model(3, 1.0);
+        model[1] = 2.0; model[2] = 4.0;
+
+        SquareModelling fop;
+        fop.setJacobianFiniteDifference(0.1);
+        fop.createJacobian(model);
+        GIMLI::RMatrix * J = dynamic_cast< GIMLI::RMatrix * >(fop.jacobian());
+        for (GIMLI::Index i = 0; i < model.size(); i ++){
+            CPPUNIT_ASSERT(std::fabs((*J)[i][i] - 2.1 * model[i]) < 1e-12);
+        }
+
+        // linear transformation perturbs by the absolute step
+        GIMLI::Trans< GIMLI::RVector > lin;
+        fop.setJacobianTrans(&lin);
+        fop.setMultiThreadJacobian(2);
+        fop.createJacobian(model);
+        J = dynamic_cast< GIMLI::RMatrix * >(fop.jacobian());
+        for (GIMLI::Index i = 0; i < model.size(); i ++){
+            CPPUNIT_ASSERT(std::fabs((*J)[i][i] - (2.0 * model[i] + 0.1)) < 1e-12);
+            CPPUNIT_ASSERT((*J)[(i + 1) % 3][i] == 0.0);
+        }
+
+        // bounded transformation keeps the perturbed model inside the bounds
+        GIMLI::TransLogLU< GIMLI::RVector > logLU(0.0, 4.1);
+        fop.setJacobianTrans(&logLU);
+        fop.setJacobianFiniteDifference(0.5, true);
+        fop.createJacobian(model);
+        J = dynamic_cast< GIMLI::RMatrix * >(fop.jacobian());
+        GIMLI::RVector m2(1, 4.0);
+        double mUp = logLU.invTrans(logLU.trans(m2) + 0.5)[0];
+        double mLo = logLU.invTrans(logLU.trans(m2) - 0.5)[0];
+        CPPUNIT_ASSERT(mUp < 4.1);
+        CPPUNIT_ASSERT(std::fabs((*J)[2][2] - (mUp + mLo)) < 1e-10);
+        fop.setJacobianTrans(NULL);
+    }
+
+    void testResponses(){
+        // 5 models on 4 threads
+        GIMLI::RVector ab2(ab2_()), mn2(ab2.size(), 0.5);
+        GIMLI::RMatrix models(5, 0);
+        for (GIMLI::Index i = 0; i < models.rows(); i ++){
+            models[i] = model_() * (1.0 + 0.1 * i);
+        }
+
+        GIMLI::DC1dModelling fop(3, ab2, mn2);
+        GIMLI::RMatrix resp(fop.responses(models));
+        CPPUNIT_ASSERT(resp.rows() == models.rows());
+
+        GIMLI::DC1dModelling fopMT(3, ab2, mn2);
+        fopMT.setThreadCount(4);
+        fopMT.setMultiThreadJacobian(4);
+        GIMLI::RMatrix respMT(fopMT.responses(models));
+        CPPUNIT_ASSERT(respMT.rows() == models.rows());
+
+        for (GIMLI::Index i = 0; i < models.rows(); i ++){
+            GIMLI::RVector r(fop.response(models[i]));
+            CPPUNIT_ASSERT(resp[i] == r);
+            CPPUNIT_ASSERT(respMT[i] == r);
+        }
+    }
+
+    void testCheckpoint(){
+        GIMLI::RVector ab2(ab2_()), mn2(ab2.size(), 0.5);
+        GIMLI::RVector model(model_());
+        GIMLI::DC1dModelling fop(3, ab2, mn2);
+        GIMLI::RVector data(fop.response(model));
+        fop.createJacobian(model);
+
+        GIMLI::RInversion inv(data, fop);
+        inv.setRelativeError(0.03);
+        inv.setModel(model * 1.1);
+        inv.setResponse(data * 0.9);
+        inv.setLambda(42.0);
+        inv.setReferenceModel(model);
+
+        std::string filename("testCheckpoint.bin");
+        CPPUNIT_ASSERT(inv.saveCheckpoint(filename, true));
+
+        // round trip
+        GIMLI::DC1dModelling fop2(3, ab2, mn2);
+        fop2.initJacobian();
+        GIMLI::RInversion inv2(data, fop2);
+        CPPUNIT_ASSERT(inv2.loadCheckpoint(filename));
+        CPPUNIT_ASSERT(inv2.iter() == inv.iter());
+        CPPUNIT_ASSERT(inv2.lambda() == 42.0);
+        CPPUNIT_ASSERT(inv2.model() == inv.model());
+        CPPUNIT_ASSERT(inv2.response() == inv.response());
+        CPPUNIT_ASSERT(inv2.error() == inv.error());
+        const GIMLI::RMatrix & J = *dynamic_cast< GIMLI::RMatrix * >(fop.jacobian());
+        const GIMLI::RMatrix & J2 = *dynamic_cast< GIMLI::RMatrix * >(fop2.jacobian());
+        CPPUNIT_ASSERT(J2.rows() == J.rows() && J2.cols() == J.cols());
+        for (GIMLI::Index i = 0; i < J.rows(); i ++) CPPUNIT_ASSERT(J2[i] == J[i]);
+
+        // a truncated file is rejected and leaves the inversion untouched
+        std::string buf;
+        {
+            std::ifstream in(filename.c_str(), std::ios::binary);
+            buf.assign(std::istreambuf_iterator< char >(in),
+                       std::istreambuf_iterator< char >());
+        }
+        {
+            std::ofstream out(filename.c_str(), std::ios::binary);
+            out.write(buf.data(), buf.size() / 2);
+        }
+        GIMLI::RInversion inv3(data, fop2);
+        inv3.setLambda(1.0);
+        GIMLI::RVector model3(inv3.model());
+        CPPUNIT_ASSERT(!inv3.loadCheckpoint(filename));
+        CPPUNIT_ASSERT(inv3.lambda() == 1.0);
+        CPPUNIT_ASSERT(inv3.model() == model3);
+
+        // a bogus size is rejected before allocating
+        {
+            std::string bad(buf);
+            GIMLI::int64 huge = GIMLI::int64(1) << 60;
+            bad.replace(24, sizeof(huge), reinterpret_cast< const char * >(&huge), sizeof(huge));
+            std::ofstream out(filename.c_str(), std::ios::binary);
+            out.write(bad.data(), bad.size());
+        }
+        CPPUNIT_ASSERT(!inv3.loadCheckpoint(filename));
+        CPPUNIT_ASSERT(inv3.model() == model3);
+
+        std::remove(filename.c_str());
+    }
+
+    void testResponseCache(){
+        CountingModelling fop;
+        GIMLI::RVector m1(3, 1.0), m2(3, 2.0);
+
+        // disabled by default
+        fop.cachedResponse(m1); fop.cachedResponse(m1);
+        CPPUNIT_ASSERT(fop.count == 2);
+
+        fop.setResponseCacheSize(2);
+        fop.count = 0;
+        CPPUNIT_ASSERT(fop.cachedResponse(m1) == m1 * 2.0);
+        CPPUNIT_ASSERT(fop.cachedResponse(m2) == m2 * 2.0);
+        CPPUNIT_ASSERT(fop.count == 2);
+        // hits do not call response
+        CPPUNIT_ASSERT(fop.cachedResponse(m1) == m1 * 2.0);
+        CPPUNIT_ASSERT(fop.cachedResponse(m2) == m2 * 2.0);
+        CPPUNIT_ASSERT(fop.count == 2);
+
+        // new data forces recalculation
+        GIMLI::DataContainer data;
+        fop.setData(data);
+        CPPUNIT_ASSERT(fop.cachedResponse(m1) == m1 * 2.0);
+        CPPUNIT_ASSERT(fop.count == 3);
+        CPPUNIT_ASSERT(fop.cachedResponse(m1) == m1 * 2.0);
+        CPPUNIT_ASSERT(fop.count == 3);
+
+        // a third model evicts the least recently used one, here m2
+        GIMLI::RVector m3(3, 3.0);
+        fop.cachedResponse(m2);
+        fop.cachedResponse(m1);
+        CPPUNIT_ASSERT(fop.count == 4);
+        fop.cachedResponse(m3);
+        CPPUNIT_ASSERT(fop.count == 5);
+        fop.cachedResponse(m1);
+        fop.cachedResponse(m3);
+        CPPUNIT_ASSERT(fop.count == 5);
+        CPPUNIT_ASSERT(fop.cachedResponse(m2) == m2 * 2.0);
+        CPPUNIT_ASSERT(fop.count == 6);
+
+        // operators keeping a response state always recalculate
+        StatefulModelling sfop;
+        sfop.setResponseCacheSize(2);
+        sfop.cachedResponse(m1); sfop.cachedResponse(m1);
+        CPPUNIT_ASSERT(sfop.count == 2);
+    }
+
+    void testLineSearchParallel(){
+        GIMLI::RMatrix A(4, 3);
+        for (GIMLI::Index i = 0; i < A.rows(); i ++){
+            for (GIMLI::Index j = 0; j < A.cols(); j ++) A[i][j] = 1.0 + i * j;
+        }
+        GIMLI::RVector mTrue(3, 2.0), m0(3, 1.0);
+        LinearModelling fop(A);
+        fop.setThreadCount(2);
+
+        GIMLI::RInversion inv(A * mTrue, fop);
+        GIMLI::Trans< GIMLI::RVector > tM, tD;
+        inv.setTransModel(tM);
+        inv.setTransData(tD);
+        inv.setAbsoluteError(1.0);
+        inv.setLocalRegularization(true);
+        inv.setModel(m0);
+        inv.setResponse(A * m0);
+        inv.setLineSearchParallel(2);
+
+        // phi is a parabola in tau with its minimum at tau = 0.35, off the
+        // grid 0, 0.5, 1, the refinement finds it
+        GIMLI::RVector modelNew(m0 + (mTrue - m0) / 0.35), responseNew;
+        double tau = inv.linesearchParallel(modelNew, responseNew);
+        CPPUNIT_ASSERT(std::fabs(tau - 0.35) < 1e-8);
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(modelNew - mTrue)) < 1e-8);
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(responseNew - A * mTrue)) < 1e-8);
+
+        // a step in the wrong direction is not accepted, only the small
+        // fallback step remains
+        modelNew = m0 - (mTrue - m0);
+        tau = inv.linesearchParallel(modelNew, responseNew);
+        CPPUNIT_ASSERT(tau == 0.03);
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(modelNew - (m0 - (mTrue - m0) * 0.03))) < 1e-12);
+    }
+
+    void testDataSpaceSolver(){
+        // 4 data, 12 model cells, first order smoothness with constant null space
+        GIMLI::Index nData = 4, nModel = 12;
+        GIMLI::RMatrix S(nData, nModel);
+        for (GIMLI::Index i = 0; i < nData; i ++){
+            for (GIMLI::Index j = 0; j < nModel; j ++){
+                S[i][j] = 1.0 + std::sin(1.0 + i * 3.1 + j * 0.7);
+            }
+        }
+        GIMLI::RSparseMapMatrix C(nModel - 1, nModel);
+        for (GIMLI::Index i = 0; i < nModel - 1; i ++){
+            C.setVal(i, i, -1.0);
+            C.setVal(i, i + 1, 1.0);
+        }
+        GIMLI::RVector b(nData), dWeight(nData), td(nData);
+        for (GIMLI::Index i = 0; i < nData; i ++){
+            b[i] = std::cos(i * 1.3);
+            dWeight[i] = 1.0 + 0.1 * i;
+            td[i] = 0.5 + 0.2 * i;
+        }
+        GIMLI::RVector wm(nModel), tm(nModel), wc(nModel - 1), roughness(nModel - 1);
+        for (GIMLI::Index i = 0; i < nModel; i ++){
+            wm[i] = 1.0 + 0.05 * i;
+            tm[i] = 2.0 - 0.1 * i;
+        }
+        for (GIMLI::Index i = 0; i < nModel - 1; i ++){
+            wc[i] = 1.0 + 0.02 * i;
+            roughness[i] = 0.1 * std::sin(i * 0.9);
+        }
+        double lambda = 2.0;
+
+        GIMLI::RVector xCG(nModel, 0.0);
+        GIMLI::solveCGLSCDWWhtrans(S, C, dWeight, b, xCG, wc, wm, tm, td,
+                                   lambda, roughness, 1000, 1e-28);
+
+        GIMLI::RVector xDS(nModel, 0.0);
+        CPPUNIT_ASSERT(GIMLI::solveDataSpaceCDWWhtrans(S, C, dWeight, b, xDS,
+                                                       wc, wm, tm, td, lambda,
+                                                       roughness) == 1);
+        CPPUNIT_ASSERT(GIMLI::max(GIMLI::abs(xDS - xCG)) < 1e-10 * GIMLI::max(GIMLI::abs(xCG)));
+
+        // negative lambda: data space system not positive definite
+        GIMLI::RVector x(nModel, 1.0);
+        CPPUNIT_ASSERT(GIMLI::solveDataSpaceCDWWhtrans(S, C, dWeight, b, x,
+                                                       wc, wm, tm, td, -1e6,
+                                                       roughness) == 0);
+        CPPUNIT_ASSERT(x == GIMLI::RVector(nModel, 1.0));
+    }
+
+protected:
+    //** Schlumberger spacings of a 1d sounding
+    GIMLI::RVector ab2_(){
+        GIMLI::RVector ab2(12);
+        for (GIMLI::Index i = 0; i < ab2.size(); i ++) ab2[i] = std::pow(10.0, i / 6.0);
+        return ab2;
+    }
+
+    //** 3 layers, i.e. 5 parameters: 2 thicknesses and 3 resistivities
+    GIMLI::RVector model_(){
+        GIMLI::RVector model(5);
+        model[0] = 2.0; model[1] = 5.0;
+        model[2] = 100.0; model[3] = 10.0; model[4] = 500.0;
+        return model;
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ModellingTest);
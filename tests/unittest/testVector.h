@@ -6,6 +6,7 @@
 #include <blockmatrix.h>
 #include <matrix.h>
 #include <sparsematrix.h>
+#include <linSolver.h>
 #include <vectortemplates.h>
 #include <vector>
 
@@ -30,6 +31,7 @@ class VectorTest : public CppUnit::TestFixture  {
     CPPUNIT_TEST(testMatrix);
     CPPUNIT_TEST(testBlockMatrix);
     CPPUNIT_TEST(testSparseMapMatrix);
+    CPPUNIT_TEST(testSparseMatrixMult);
     CPPUNIT_TEST(testFind);
     CPPUNIT_TEST(testIO);
 
@@ -106,6 +108,26 @@ public:
         CPPUNIT_ASSERT(RVector(abs(v + 1e-6)) == RVector(exp10(log10(abs(v + 1e-6)))));
         CPPUNIT_ASSERT(RVector(abs(v + 1e-6)) == RVector(exp(log(abs(v + 1e-6)))));
         CPPUNIT_ASSERT(RVector(abs(v + 1e-6)) != RVector(exp10(log(abs(v + 1e-6)))));
+
+        // vectorized exp/log against libm, both sides of the inline size
+        for (Index n = 5; n < 2000; n *= 20){
+            RVector x(n); randn(x); x *= 50.0;
+            RVector ex(exp(x)), lx(log(abs(x)));
+            for (Index i = 0; i < n; i ++){
+                CPPUNIT_ASSERT(::fabs(ex[i] - std::exp(x[i])) <= 4e-16 * std::exp(x[i]));
+                CPPUNIT_ASSERT(::fabs(lx[i] - std::log(::fabs(x[i]))) <= 4e-16 * ::fabs(std::log(::fabs(x[i]))));
+            }
+        }
+        RVector s(20, 1.0);
+        s[0] = 0.0; s[1] = -1.0; s[2] = 1e-310; s[3] = 800.0; s[4] = -800.0;
+        s[5] = std::numeric_limits< double >::infinity();
+        s[6] = std::numeric_limits< double >::quiet_NaN();
+        RVector es(exp(s)), ls(log(s));
+        CPPUNIT_ASSERT(es[0] == 1.0 && ls[0] == -std::numeric_limits< double >::infinity());
+        CPPUNIT_ASSERT(std::isnan(ls[1]) && ::fabs(ls[2] - std::log(1e-310)) < 1e-12);
+        CPPUNIT_ASSERT(std::isinf(es[3]) && es[4] == 0.0);
+        CPPUNIT_ASSERT(std::isinf(es[5]) && std::isinf(ls[5]));
+        CPPUNIT_ASSERT(std::isnan(es[6]) && std::isnan(ls[6]));
     }
     template < class ValueType > void testUnaryOperations_(const ValueType & fac){
         typedef Vector < ValueType > Vec;
@@ -135,6 +157,13 @@ public:
 //         __MS(t1)
 //         __MS(t2)
         CPPUNIT_ASSERT(t1 == t2);
+
+        // aligned storage and in place evaluation with the target in the expression
+        RVector a(1001, 3.0);
+        CPPUNIT_ASSERT(size_t(&a[0]) % VECTOR_MEMORY_ALIGNMENT == 0);
+        a = a * a + a / 3.0;
+        CPPUNIT_ASSERT(a == RVector(1001, 10.0));
+        CPPUNIT_ASSERT(find(a > RVector(1001, 9.0)).size() == 1001);
 //         exit(0);
     }
 
@@ -379,6 +408,30 @@ public:
         A[1].fill(2);
         CPPUNIT_ASSERT(sum(A.row(1)) == A.cols()*2);
         CPPUNIT_ASSERT(sum(A.col(1)) == A.rows()*2);
+
+        // test contiguous row storage
+        CPPUNIT_ASSERT(A.isContiguous());
+        CPPUNIT_ASSERT(&A[1][0] == A.data() + A.cols());
+        A.push_back(A[1]);
+        CPPUNIT_ASSERT(A.isContiguous());
+        CPPUNIT_ASSERT(A.back() == A[1]);
+        A[0].resize(2);
+        CPPUNIT_ASSERT(!A.isContiguous());
+        CPPUNIT_ASSERT_THROW(A.compact(), std::length_error);
+        A[0] = A[1];
+        A.compact();
+        CPPUNIT_ASSERT(A.isContiguous());
+        CPPUNIT_ASSERT(A[0] == A[1]);
+        // shrinking a row within its capacity detaches it too
+        Mat W(2, 4);
+        W[0].resize(3);
+        CPPUNIT_ASSERT(&W[0][0] + 4 != &W[1][0]);
+        W[0].resize(4);
+        CPPUNIT_ASSERT(!W.isContiguous());
+        W.compact();
+        CPPUNIT_ASSERT(W.isContiguous());
+        CPPUNIT_ASSERT(::fabs(sum(A.mult(b)) -
+                       sum(A.transMult(Vec(A.rows(), 1.0)) * b)) < TOLERANCE);
     }
 
     void testFind(){
@@ -426,7 +479,81 @@ public:
 //         std::cout << l(Complex(.0, 0.0), Complex(.0, 0.0)) << std::endl;
     }
 
+    template < class ValueType > void testMatMult_(){
+        typedef Matrix < ValueType > Mat;
+        Mat A(7, 5), B(5, 3), AT(5, 7), BT(3, 5);
+        for (Index i = 0; i < A.rows(); i ++){
+            for (Index j = 0; j < A.cols(); j ++){
+                A[i][j] = ValueType(i + 1.0) - ValueType(0.5 * j); AT[j][i] = A[i][j];
+            }
+        }
+        for (Index i = 0; i < B.rows(); i ++){
+            for (Index j = 0; j < B.cols(); j ++){
+                B[i][j] = ValueType(i * j + 1.0); BT[j][i] = B[i][j];
+            }
+        }
+        Mat C(7, 3);
+        for (Index i = 0; i < C.rows(); i ++){
+            for (Index j = 0; j < C.cols(); j ++){
+                for (Index k = 0; k < A.cols(); k ++) C[i][j] += A[i][k] * B[k][j];
+            }
+        }
+        // old values of the result must not survive, not even NaN
+        Mat R(C.rows(), C.cols());
+        R[2][1] = ValueType(std::numeric_limits< double >::quiet_NaN());
+        matMult(A, B, R);               CPPUNIT_ASSERT(R == C);
+        matMult(AT, B, R, true, false); CPPUNIT_ASSERT(R == C);
+        matMult(A, BT, R, false, true); CPPUNIT_ASSERT(R == C);
+        matMult(AT, BT, R, true, true); CPPUNIT_ASSERT(R == C);
+        CPPUNIT_ASSERT(A.mult(B.mult(Vector< ValueType >(3, 1.0))) ==
+                       C.mult(Vector< ValueType >(3, 1.0)));
+        CPPUNIT_ASSERT(AT.transMult(Vector< ValueType >(5, 1.0)) ==
+                       A.mult(Vector< ValueType >(5, 1.0)));
+    }
+
     void testMatrix(){
+        testMatMult_< double >();
+        testMatMult_< Complex >();
+
+        RMatrix J(9, 4);
+        RVector w(9);
+        for (Index i = 0; i < J.rows(); i ++){
+            w[i] = 0.5 + i;
+            for (Index j = 0; j < J.cols(); j ++) J[i][j] = ::sin(i + 2.0 * j);
+        }
+        RMatrix JTDJ(4, 4), DJ(J);
+        JTDJ[1][2] = std::numeric_limits< double >::infinity();
+        for (Index i = 0; i < J.rows(); i ++) DJ[i] *= w[i];
+        matTransDiagMult(J, w, JTDJ);
+        RMatrix JTDJ2; matMult(J, DJ, JTDJ2, true, false);
+        for (Index i = 0; i < JTDJ.rows(); i ++){
+            CPPUNIT_ASSERT(max(abs(JTDJ[i] - JTDJ2[i])) < TOLERANCE);
+            CPPUNIT_ASSERT(JTDJ[i][3 - i] == JTDJ[3 - i][i]);
+        }
+
+        // dense Cholesky solve of the (regularized) J^T D J, J has rank 2
+        for (Index i = 0; i < JTDJ.rows(); i ++) JTDJ[i][i] += 1.0;
+        RVector x(4), b(JTDJ.mult(RVector(4, 1.0)));
+        RMatrix L(JTDJ);
+        CPPUNIT_ASSERT(solveCholesky(L, x, b) == 1);
+        CPPUNIT_ASSERT(max(abs(x - 1.0)) < 1e-8);
+        L = JTDJ; L[2][2] = -1.0;
+        CPPUNIT_ASSERT(solveCholesky(L, x, b) == 0);
+
+        // more threads than the rows split into, no range may run past A
+        Index nThreads = threadCount();
+        setThreadCount(16);
+        RMatrix T(20, 100000);
+        for (Index i = 0; i < T.rows(); i ++) T[i].fill(i + 1.0);
+        RVector t(T.mult(RVector(T.cols(), 1.0)));
+        for (Index i = 0; i < T.rows(); i ++){
+            CPPUNIT_ASSERT(::fabs(t[i] - (i + 1.0) * T.cols()) < TOLERANCE);
+        }
+        CPPUNIT_ASSERT(T.transMult(RVector(T.rows(), 1.0)) == RVector(T.cols(), 210.0));
+        RMatrix TTT; matMult(T, T, TTT, false, true);
+        CPPUNIT_ASSERT(TTT.rows() == 20 && ::fabs(TTT[19][19] - 400.0 * T.cols()) < TOLERANCE);
+        setThreadCount(nThreads);
+
         testMatrix_< double >();
 //        testMatrix_< float >();
     }
@@ -478,6 +605,57 @@ public:
         CPPUNIT_ASSERT(((C+C)*2.0).getVal(1, 1) == 8.0);
     }
 
+    void testSparseMatrixMult(){
+        // full, lower and upper storage of the same symmetric matrix
+        GIMLI::RSparseMapMatrix F(4, 4), L(4, 4, -1), U(4, 4, 1);
+        for (GIMLI::Index i = 0; i < 4; i ++){
+            for (GIMLI::Index j = 0; j < 4; j ++){
+                if (i == j || i + 1 == j || j + 1 == i){
+                    double v = 1.0 + i + j;
+                    F.addVal(i, j, v); L.addVal(i, j, v); U.addVal(i, j, v);
+                }
+            }
+        }
+        GIMLI::RVector a(4); a.fill(x__ + 1.0);
+        GIMLI::RVector b(F.mult(a));
+
+        GIMLI::RSparseMatrix SF(F), SL(L), SU(U);
+        CPPUNIT_ASSERT(SL.stype() == -1 && SU.stype() == 1);
+        CPPUNIT_ASSERT(norml2(SF.mult(a) - b) < TOLERANCE);
+        CPPUNIT_ASSERT(norml2(SF.transMult(a) - b) < TOLERANCE);
+        CPPUNIT_ASSERT(norml2(SL.mult(a) - b) < TOLERANCE);
+        CPPUNIT_ASSERT(norml2(SU.mult(a) - b) < TOLERANCE);
+        CPPUNIT_ASSERT(norml2(SL.transMult(a) - b) < TOLERANCE);
+        CPPUNIT_ASSERT(norml2(SU.transMult(a) - b) < TOLERANCE);
+        CPPUNIT_ASSERT(norml2(L.transMult(a) - b) < TOLERANCE);
+
+        // non symmetric
+        F.addVal(0, 3, 5.0);
+        SF = F;
+        CPPUNIT_ASSERT(norml2(SF.mult(a) - F.mult(a)) < TOLERANCE);
+        CPPUNIT_ASSERT(norml2(SF.transMult(a) - F.transMult(a)) < TOLERANCE);
+        CPPUNIT_ASSERT(::fabs(SF.transMult(a)[3] - SF.mult(a)[3] - 5.0 * a[0]) < TOLERANCE);
+
+        // block of vectors
+        GIMLI::RMatrix X(3, 4), R;
+        for (GIMLI::Index j = 0; j < 3; j ++) X[j] = a * (j + 1.0);
+        GIMLI::sparseMatrixMult(SF, X, R);
+        CPPUNIT_ASSERT(R.rows() == 3 && R.cols() == 4);
+        for (GIMLI::Index j = 0; j < 3; j ++){
+            CPPUNIT_ASSERT(norml2(R[j] - SF.mult(X[j])) < TOLERANCE);
+        }
+        GIMLI::sparseMatrixMult(SL, X, R);
+        CPPUNIT_ASSERT(norml2(R[1] - b * 2.0) < TOLERANCE);
+
+        // products into existing vectors through the MatrixBase interface
+        GIMLI::RVector r(7, 1.0);
+        const GIMLI::MatrixBase & MF = F, & MS = SF;
+        MF.mult(a, r);
+        CPPUNIT_ASSERT(r.size() == 4 && norml2(r - F.mult(a)) < TOLERANCE);
+        MS.transMult(a, r);
+        CPPUNIT_ASSERT(norml2(r - F.transMult(a)) < TOLERANCE);
+    }
+
     void testIO(){
         RVector v(100);
         randn(v);
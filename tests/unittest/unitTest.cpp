@@ -16,6 +16,7 @@
     #include "testShape.h"
     #include "testGeometry.h"
     #include "testFEM.h"
+    #include "testModelling.h"
     #include "testExternals.h"
 
 #endif // HAVE_UNITTEST